@@ -0,0 +1,507 @@
+// Benchmarks of the DTW functions, the lower bounds and the 1-NN search.
+//
+// Build from the root of the repository (add -DTSDIST_STATS for the pruning ratios):
+//
+//     g++ -std=c++11 -O3 -pthread -Iinclude bench/benchmark.cpp src/*.cpp -o benchmark
+//
+// Every measurement is printed as one JSON object per line (JSON Lines), so the output can be
+// compared across versions by a script. Run with --help for the parameters.
+#include <sys/resource.h>
+#include <algorithm> // std::min, std::max
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+#include "TSdist.h"
+
+using namespace TSdist;
+
+// ================================================================================================
+/* Parameters */
+// ================================================================================================
+struct Options
+{
+    std::vector<std::string> benchmarks = { "dtw", "batched", "backtrack", "envelop", "keogh",
+                                            "improved", "nn", "nn_sorted" };
+    std::vector<int> lengths = { 128, 512 };
+    std::vector<double> windows = { 0, 0.1 };
+    std::vector<int> norms = { 1, 2 };
+    std::vector<int> diag_weights = { 1, 2 };
+    std::vector<int> sizes = { 1000 };
+    int queries = 10;
+    int threads = 1;
+    double min_time = 0.2;
+    unsigned seed = 42;
+    std::string ucr;
+    std::string ucr_queries;
+};
+
+static void usage()
+{
+    std::printf(
+        "Usage: benchmark [options]\n"
+        "  --bench LIST        dtw,batched,backtrack,envelop,keogh,improved,nn,nn_sorted\n"
+        "                      (default all, nn_sorted is single-threaded)\n"
+        "  --lengths LIST      lengths of the random walks (default 128,512)\n"
+        "  --windows LIST      window sizes as fractions of the length, 0 = none (default 0,0.1)\n"
+        "  --p LIST            norms (default 1,2)\n"
+        "  --diag LIST         diagonal weights (default 1,2)\n"
+        "  --sizes LIST        database sizes of the 1-NN search (default 1000)\n"
+        "  --queries N         queries per 1-NN measurement (default 10)\n"
+        "  --threads N         threads of the 1-NN search, 0 = all (default 1)\n"
+        "  --min-time S        minimum seconds per measurement (default 0.2)\n"
+        "  --seed N            seed of the random walks (default 42)\n"
+        "  --ucr PATH          use a dataset in UCR format instead of random walks\n"
+        "  --ucr-queries PATH  1-NN queries in UCR format (default: the last series of --ucr)\n");
+}
+
+static std::vector<std::string> split(const std::string& list)
+{
+    std::vector<std::string> items;
+    std::size_t begin = 0;
+
+    while (begin <= list.size())
+    {
+        std::size_t end = list.find(',', begin);
+        if (end == std::string::npos) end = list.size();
+
+        if (end > begin) items.push_back(list.substr(begin, end - begin));
+        begin = end + 1;
+    }
+
+    return items;
+}
+
+template<typename T>
+static std::vector<T> parseList(const std::string& list)
+{
+    std::vector<T> values;
+    for (const std::string& item : split(list)) values.push_back((T) std::atof(item.c_str()));
+
+    if (values.empty())
+        throw("Empty list of parameters.");
+
+    return values;
+}
+
+static Options parseOptions(int argc, char** argv)
+{
+    Options options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string name = argv[i];
+
+        if (name == "--help") {
+            usage();
+            std::exit(0);
+        }
+
+        if (i + 1 >= argc)
+            throw("Missing value of a parameter.");
+
+        std::string value = argv[++i];
+
+        if (name == "--bench") options.benchmarks = split(value);
+        else if (name == "--lengths") options.lengths = parseList<int>(value);
+        else if (name == "--windows") options.windows = parseList<double>(value);
+        else if (name == "--p") options.norms = parseList<int>(value);
+        else if (name == "--diag") options.diag_weights = parseList<int>(value);
+        else if (name == "--sizes") options.sizes = parseList<int>(value);
+        else if (name == "--queries") options.queries = std::atoi(value.c_str());
+        else if (name == "--threads") options.threads = std::atoi(value.c_str());
+        else if (name == "--min-time") options.min_time = std::atof(value.c_str());
+        else if (name == "--seed") options.seed = std::atoi(value.c_str());
+        else if (name == "--ucr") options.ucr = value;
+        else if (name == "--ucr-queries") options.ucr_queries = value;
+        else throw("Unknown parameter, see --help.");
+    }
+
+    return options;
+}
+
+// ================================================================================================
+/* Measurements */
+// ================================================================================================
+
+// Results are added here so that the compiler cannot drop the calls
+static volatile double sink = 0;
+
+// Calls 'run' until 'min_time' seconds have passed (at least once), returns seconds per call
+static double timeCalls(const std::function<double()>& run, double min_time, long long& calls)
+{
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    calls = 0;
+
+    while (calls == 0 || elapsed < min_time)
+    {
+        sink = sink + run();
+        calls++;
+
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+        elapsed = seconds.count();
+    }
+
+    return elapsed / calls;
+}
+
+// Peak resident memory of the process so far, in kilobytes
+static long peakMemoryKB()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Cells inside the slanted band of the DTW functions (see windowLimits in kernels.h)
+static long long bandCells(int nx, int ny, int window_size)
+{
+    if (window_size < 1) return (long long) nx * ny;
+
+    long long cells = 0;
+
+    for (int i = 1; i <= nx; i++)
+    {
+        int j1 = std::max(1, (int) std::ceil((double) i * ny / nx - window_size));
+        int j2 = std::min(ny, (int) std::floor((double) i * ny / nx + window_size));
+        if (j2 >= j1) cells += j2 - j1 + 1;
+    }
+
+    return cells;
+}
+
+// One line of output, fields are appended as "key": value
+class Record
+{
+public:
+    explicit Record(const std::string& benchmark) :
+        _line("{\"benchmark\": \"" + benchmark + "\"")
+    { }
+
+    Record& add(const std::string& key, double value) {
+        char buffer[64];
+        if (std::isfinite(value)) std::snprintf(buffer, sizeof(buffer), "%.6g", value);
+        else std::snprintf(buffer, sizeof(buffer), "null");
+
+        _line += ", \"" + key + "\": " + buffer;
+        return *this;
+    }
+
+    Record& add(const std::string& key, const std::string& value) {
+        _line += ", \"" + key + "\": \"";
+
+        for (char c : value) {
+            if (c == '"' || c == '\\') _line += '\\';
+            _line += c;
+        }
+
+        _line += "\"";
+        return *this;
+    }
+
+    void print() {
+        std::printf("%s, \"peak_memory_kb\": %ld}\n", _line.c_str(), peakMemoryKB());
+        std::fflush(stdout);
+    }
+
+private:
+    std::string _line;
+};
+
+// Window size in cells from a fraction of the length, no window is the same as the whole length
+static int windowSize(double fraction, int length)
+{
+    if (fraction <= 0) return length;
+    return std::max(1, (int) std::lround(fraction * length));
+}
+
+#ifdef TSDIST_STATS
+static const char* LOWER_BOUND_NAMES[NUM_LOWER_BOUNDS] = {
+    "kim", "kim_fl", "keogh", "reverse_keogh", "improved", "enhanced"
+};
+#endif
+
+// ================================================================================================
+/* Benchmarks */
+// ================================================================================================
+
+// Series of one length to benchmark with, and the queries of the 1-NN search
+struct Data
+{
+    std::string source;
+    Dataset series;
+    Dataset queries;
+};
+
+static void benchmarkPairs(const Options& options, const Data& data, const std::string& name)
+{
+    std::vector<TimeSeriesView<double>> series = data.series.views();
+    int count = std::min<int>(series.size(), 32);
+    int n = series[0].length();
+
+    DTWWorkspace workspace;
+    std::vector<double> lower(n), upper(n), H(n);
+    std::vector<int> idx, idy;
+    std::vector<double> distances(count);
+
+    for (double fraction : options.windows)
+    {
+        int w = windowSize(fraction, n);
+
+        // the envelope does not depend on the norm or the step pattern
+        if (name == "envelop") {
+            int k = 0;
+            long long calls;
+
+            double seconds = timeCalls([&]() {
+                computeEnvelop(series[k++ % count], w, lower.data(), upper.data(),
+                               workspace);
+                return lower[0];
+            }, options.min_time, calls);
+
+            Record(name).add("source", data.source).add("length", n).add("window", w)
+                .add("calls", calls).add("seconds_per_call", seconds)
+                .add("series_per_second", 1 / seconds).print();
+
+            continue;
+        }
+
+        for (int p : options.norms)
+        {
+            for (int diag_weight : options.diag_weights)
+            {
+                // the lower bounds do not depend on the step pattern
+                bool bound = name == "keogh" || name == "improved";
+                if (bound && diag_weight != options.diag_weights[0]) continue;
+
+                int k = 0;
+                long long calls;
+                std::function<double()> run;
+
+                if (name == "dtw") {
+                    run = [&]() {
+                        k++;
+                        return computeDTW(series[k % count], series[(k + 1) % count], w, p,
+                                          diag_weight, workspace);
+                    };
+
+                } else if (name == "batched") {
+                    // one call computes all series against the first one
+                    run = [&]() {
+                        computeBatchedDTW(series.data(), count, series[0], w, p, diag_weight,
+                                          nullptr, distances.data(), workspace);
+                        return distances[count - 1];
+                    };
+
+                } else if (name == "backtrack") {
+                    run = [&]() {
+                        k++;
+                        return backtrackDTW(series[k % count], series[(k + 1) % count], w, p,
+                                            diag_weight, idx, idy, workspace);
+                    };
+
+                } else if (name == "keogh") {
+                    computeEnvelop(series[0], w, lower.data(), upper.data());
+                    TimeSeriesView<double> L(lower.data(), n), U(upper.data(), n);
+
+                    run = [&, L, U]() {
+                        return lbKeogh(series[k++ % count], series[0], p, L, U);
+                    };
+
+                } else {
+                    run = [&]() {
+                        k++;
+                        return lbImproved(series[k % count], series[(k + 1) % count],
+                                          w, p, lower.data(), upper.data(),
+                                          H.data(), workspace);
+                    };
+                }
+
+                double seconds = timeCalls(run, options.min_time, calls);
+                Record record(name);
+
+                record.add("source", data.source).add("length", n).add("window", w)
+                    .add("p", p).add("calls", calls).add("seconds_per_call", seconds);
+
+                if (name == "dtw" || name == "batched" || name == "backtrack") {
+                    int pairs = name == "batched" ? count : 1;
+
+                    record.add("diag_weight", diag_weight)
+                        .add("cells_per_second", pairs * bandCells(n, n, w) / seconds)
+                        .add("workspace_bytes", (double) workspace.bytes());
+
+                } else {
+                    record.add("series_per_second", 1 / seconds);
+                }
+
+                record.print();
+            }
+        }
+    }
+}
+
+static void benchmarkSearch(const Options& options, const Data& data, const std::string& name)
+{
+    std::vector<TimeSeriesView<double>> all = data.series.views();
+    std::vector<TimeSeriesView<double>> queries = data.queries.views();
+    int n = queries[0].length();
+
+    for (int size : options.sizes)
+    {
+        if (size > (int) all.size()) continue;
+        std::vector<TimeSeriesView<double>> tsdb(all.begin(), all.begin() + size);
+
+        for (double fraction : options.windows)
+        {
+            int w = windowSize(fraction, n);
+
+            for (int p : options.norms)
+            {
+                for (int diag_weight : options.diag_weights)
+                {
+                    DTWWorkspace workspace;
+                    SearchStats stats;
+                    workspace.setStats(&stats);
+
+                    // candidates visited by increasing LB_Keogh
+                    bool sorted = name == "nn_sorted";
+                    int threads = sorted ? 1 : options.threads;
+
+                    auto start = std::chrono::steady_clock::now();
+
+                    for (const TimeSeriesView<double>& query : queries)
+                    {
+                        if (sorted)
+                            sink = sink + sortedNearestNeighborDTW(tsdb, query, w, p,
+                                                                   diag_weight, workspace);
+                        else if (threads == 1)
+                            sink = sink + nearestNeighborDTW(tsdb, query, w, p, diag_weight,
+                                                             workspace);
+                        else
+                            sink = sink + nearestNeighborDTW(tsdb, query, w, p, diag_weight,
+                                                             LBCascade(), options.threads,
+                                                             stats);
+                    }
+
+                    std::chrono::duration<double> seconds =
+                        std::chrono::steady_clock::now() - start;
+
+                    Record record(name);
+
+                    record.add("source", data.source).add("length", n).add("window", w)
+                        .add("p", p).add("diag_weight", diag_weight).add("db_size", size)
+                        .add("threads", threads).add("queries", queries.size())
+                        .add("seconds", seconds.count())
+                        .add("queries_per_second", queries.size() / seconds.count());
+
+#ifdef TSDIST_STATS
+                    double candidates = std::max<double>(stats.candidates, 1);
+                    double pruned = 0;
+
+                    for (int stage = 0; stage < NUM_LOWER_BOUNDS; stage++)
+                    {
+                        pruned += stats.pruned[stage];
+                        record.add(std::string("pruned_") + LOWER_BOUND_NAMES[stage],
+                                   stats.pruned[stage] / candidates);
+                    }
+
+                    record.add("pruned", pruned / candidates)
+                        .add("dtw_abandoned", stats.dtw_abandoned / candidates)
+                        .add("cells_per_second", stats.cells_computed / stats.dtw_seconds);
+#endif
+
+                    record.print();
+                }
+            }
+        }
+    }
+}
+
+static void runBenchmarks(const Options& options, const Data& data)
+{
+    for (const std::string& name : options.benchmarks)
+    {
+        if (name == "nn" || name == "nn_sorted")
+            benchmarkSearch(options, data, name);
+        else if (name == "dtw" || name == "batched" || name == "backtrack" || name == "envelop" ||
+                 name == "keogh" || name == "improved")
+            benchmarkPairs(options, data, name);
+        else
+            throw("Unknown benchmark, see --help.");
+    }
+}
+
+// Random walks of every length, the database is as large as the largest size
+static void runRandomWalks(const Options& options)
+{
+    int size = 32;
+    for (int s : options.sizes) size = std::max(size, s);
+
+    for (int length : options.lengths)
+    {
+        Data data;
+        data.source = "random_walk";
+        data.series = randomWalkDataset(size, length, 1, options.seed);
+        data.queries = randomWalkDataset(options.queries, length, 1, options.seed + 1);
+
+        runBenchmarks(options, data);
+    }
+}
+
+// One UCR file, the queries are another file or the last series of the same one
+static void runUCR(const Options& options)
+{
+    Data data;
+    data.source = options.ucr;
+    Dataset dataset = loadUCRDataset(options.ucr);
+
+    if (dataset.size() < 2)
+        throw("The dataset needs at least two series.");
+
+    int held_out = options.ucr_queries.empty() ? std::min(options.queries, dataset.size() - 1)
+                                               : 0;
+
+    for (int k = 0; k < dataset.size(); k++)
+    {
+        if (dataset.length(k) != dataset.length(0))
+            throw("Series of the dataset must have the same length.");
+
+        if (k < dataset.size() - held_out) data.series.add(dataset.view(k), dataset.label(k));
+        else data.queries.add(dataset.view(k), dataset.label(k));
+    }
+
+    if (!options.ucr_queries.empty()) {
+        Dataset queries = loadUCRDataset(options.ucr_queries);
+
+        for (int k = 0; k < queries.size() && k < options.queries; k++)
+            data.queries.add(queries.view(k), queries.label(k));
+    }
+
+    // the whole file is the database
+    Options ucr_options = options;
+    ucr_options.sizes = { data.series.size() };
+
+    runBenchmarks(ucr_options, data);
+}
+
+int main(int argc, char** argv)
+{
+    try {
+        Options options = parseOptions(argc, argv);
+
+        if (options.ucr.empty())
+            runRandomWalks(options);
+        else
+            runUCR(options);
+
+    } catch (const char* error) {
+        std::fprintf(stderr, "Error: %s\n", error);
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,83 +1,1270 @@
 #ifndef _1NN_H
 #define _1NN_H
 
+#include <algorithm> // std::push_heap, std::pop_heap, std::sort_heap, std::sort
 #include <cmath>
 #include <limits>
+#include <vector>
 #include "dtw.h"
 #include "lb.h"
+#include "parallel.h"
+#include "stats.h"
+#include "workspace.h"
 
 namespace TSdist {
 
+/*
+ * Every search has an overload that takes the lower bounds to apply to each candidate before
+ * DTW (see LBCascade in lb.h) right before the workspace or the number of threads. The others
+ * use the default cascade: LB_KimFL, LB_Keogh and LB_Improved.
+ */
+
+/** Search result: position of a series in the database and its DTW distance to the query */
+struct Neighbor
+{
+    int index;
+    double distance;
+};
+
+// Closer first, ties broken by database order
+inline bool operator<(const Neighbor& a, const Neighbor& b)
+{
+    return a.distance < b.distance || (a.distance == b.distance && a.index < b.index);
+}
+
+namespace detail {
+
+// Relative slack added to thresholds before comparing them with lower bounds (rounding of pow)
+static const double THRESHOLD_SLACK = 1e-10;
+
+// Largest batch of candidates whose DTW distances are computed together (AVX-512 lanes)
+static const int MAX_BATCH_LANES = 8;
+
+// |diff|^p with the common cases written out
+inline double lbTerm(double diff, int p)
+{
+    return p == 1 ? diff : p == 2 ? diff * diff : std::pow(diff, p);
+}
+
+/*
+ * Lower bounds (see LBCascade in lb.h) followed by DTW for one query against candidates of the
+ * same length, shared by the searches. All scratch memory comes from the workspace.
+ *
+ * Lower bounds are accumulated as p-th powers and every stage stops as soon as it exceeds the
+ * threshold. Multivariate series add the terms of every variable, which bounds both the
+ * dependent DTW of computeDTW and the independent one of computeIndependentDTW. LB_Kim needs
+ * univariate summaries, so multivariate series use LB_KimFL in its place.
+ */
+template<typename T>
+class QueryFilter
+{
+public:
+
+    QueryFilter(const TimeSeriesView<T>& query, int window_size, int p, int diag_weight,
+                const LBCascade& cascade, DTWWorkspace& workspace, bool independent = false) :
+        _query(query) ,
+        _window_size(window_size) ,
+        _p(p) ,
+        _diag_weight(diag_weight) ,
+        _independent(independent) ,
+        _cascade(cascade) ,
+        _workspace(workspace)
+    {
+        // envelopes and H are packed, one value per variable at each time index
+        int size = query.length() * query.numVars();
+
+        _L = workspace.envelopsOf<T>(7 * size);
+        _U = _L + size;
+        _H = _U + size;
+        _LH = _H + size;
+        _UH = _LH + size;
+        _LC = _UH + size;
+        _UC = _LC + size;
+
+        // Window size checked here
+        computeEnvelop(query, window_size, _L, _U, workspace);
+
+        if (query.numVars() == 1)
+            _summary = summarizeSeries(query);
+
+        // the batched kernel has no independent or multivariate version
+        bool batched = !independent && query.numVars() == 1 && (p == 1 || p == 2);
+        _lanes = batched ? std::min(batchedDTWLanes(), MAX_BATCH_LANES) : 1;
+    }
+
+    /*
+     * Returns the DTW distance between 'candidate' and the query, or infinity if it is larger
+     * than 'threshold'.
+     */
+    double evaluate(const TimeSeriesView<T>& candidate, double threshold)
+    {
+        if (prune(candidate, threshold))
+            return std::numeric_limits<double>::infinity();
+
+        TSDIST_STATS_ONLY(SearchStats* stats = _workspace.stats();)
+        TSDIST_STATS_ONLY(StatsTimer timer(stats ? &stats->dtw_seconds : nullptr);)
+
+        if (_independent)
+            return independentDTW(candidate, threshold);
+
+        // DTW distance, abandoned as soon as it exceeds the threshold
+        return computePrunedDTW(candidate, _query, _window_size, _p, _diag_weight, threshold,
+                                _workspace);
+    }
+
+    /*
+     * Whether a lower bound of the cascade shows that the DTW distance between 'candidate' and
+     * the query is larger than 'threshold'.
+     */
+    bool prune(const TimeSeriesView<T>& candidate, double threshold)
+    {
+        if (candidate.length() != _query.length())
+            throw("Length mismatch between the query and the database.");
+
+        if (candidate.numVars() != _query.numVars())
+            throw("Series must have the same number of variables.");
+
+        // lower bounds are p-th powers, the slack keeps candidates tied with the threshold
+        double bound = std::pow(threshold, _p);
+        bound += bound * THRESHOLD_SLACK;
+
+        // LB_Keogh is computed at most once, LB_Improved builds on it
+        _keogh = -1;
+
+        TSDIST_STATS_ONLY(SearchStats* stats = _workspace.stats();)
+        TSDIST_STATS_ONLY(if (stats) stats->candidates++;)
+
+        for (LowerBound stage : _cascade.stages)
+        {
+            TSDIST_STATS_ONLY(StatsTimer timer(stats ? &stats->lb_seconds[(int) stage] : nullptr);)
+
+            if (lowerBound(stage, candidate, bound) > bound) {
+                TSDIST_STATS_ONLY(if (stats) stats->pruned[(int) stage]++;)
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /*
+     * LB_Keogh of 'candidate' as a p-th power, computed in full (no threshold) and without the
+     * projection needed by LB_Improved. Branch-free with independent partial sums, so that it
+     * vectorizes; the order of the sum differs from the cascade's LB_Keogh, which the slack of
+     * the thresholds covers.
+     */
+    double keoghBound(const TimeSeriesView<T>& candidate)
+    {
+        if (candidate.length() != _query.length())
+            throw("Length mismatch between the query and the database.");
+
+        if (candidate.numVars() != _query.numVars())
+            throw("Series must have the same number of variables.");
+
+        int size = candidate.length() * candidate.numVars();
+
+        // packed series are one flat array, like the envelope
+        if (candidate.stride() == candidate.numVars())
+            return keoghSum(candidate.data(), size);
+
+        T* packed = _workspace.candidatesOf<T>(size);
+
+        for (int i = 0; i < candidate.length(); i++)
+            for (int k = 0; k < candidate.numVars(); k++)
+                packed[i * candidate.numVars() + k] = candidate[i][k];
+
+        return keoghSum(packed, size);
+    }
+
+    // Envelope of the query, packed like the query
+    const T* lowerEnvelop() const { return _L; }
+    const T* upperEnvelop() const { return _U; }
+
+    // Candidates whose DTW distances evaluateBatch computes together, 1 if it is not worth it
+    int lanes() const { return _lanes; }
+
+    /*
+     * DTW distances of 'count' candidates that passed prune, infinity for those larger than
+     * 'threshold' (see computeBatchedDTW in dtw.h).
+     */
+    void evaluateBatch(const TimeSeriesView<T>* candidates, int count, double threshold,
+                       double* distances)
+    {
+        TSDIST_STATS_ONLY(SearchStats* stats = _workspace.stats();)
+        TSDIST_STATS_ONLY(StatsTimer timer(stats ? &stats->dtw_seconds : nullptr);)
+
+        double bounds[MAX_BATCH_LANES];
+        std::fill(bounds, bounds + count, threshold);
+
+        computeBatchedDTW(candidates, count, _query, _window_size, _p, _diag_weight, bounds,
+                          distances, _workspace);
+    }
+
+private:
+
+    // Independent DTW, each variable abandoned once the sum exceeds the threshold
+    double independentDTW(const TimeSeriesView<T>& candidate, double threshold)
+    {
+        const double INF = std::numeric_limits<double>::infinity();
+
+        // same bound as the lower bounds
+        double bound = std::pow(threshold, _p);
+        bound += bound * THRESHOLD_SLACK;
+
+        int n = candidate.length();
+        double sum = 0;
+
+        for (int k = 0; k < candidate.numVars(); k++)
+        {
+            TimeSeriesView<T> x(candidate.data() + k, n, 1, candidate.stride());
+            TimeSeriesView<T> y(_query.data() + k, n, 1, _query.stride());
+
+            // what is left of the bound for this variable
+            double budget = threshold == INF ? INF
+                                             : std::pow(std::max(bound - sum, 0.0), 1.0 / _p);
+            double dtw = computePrunedDTW(x, y, _window_size, _p, _diag_weight, budget,
+                                          _workspace);
+
+            if (dtw == INF) return INF;
+            sum += std::pow(dtw, _p);
+        }
+
+        double distance = std::pow(sum, 1.0 / _p);
+        return distance <= threshold ? distance : INF;
+    }
+
+    // Distances of x to the envelope, 4 partial sums
+    double keoghSum(const T* x, int size)
+    {
+        double sum[4] = { 0, 0, 0, 0 };
+        int i = 0;
+
+        for (; i + 4 <= size; i += 4)
+        {
+            for (int j = 0; j < 4; j++)
+            {
+                double above = std::max((double) x[i + j] - _U[i + j], 0.0);
+                double below = std::max((double) _L[i + j] - x[i + j], 0.0);
+                sum[j] += lbTerm(above + below, _p);
+            }
+        }
+
+        for (; i < size; i++)
+        {
+            double above = std::max((double) x[i] - _U[i], 0.0);
+            double below = std::max((double) _L[i] - x[i], 0.0);
+            sum[0] += lbTerm(above + below, _p);
+        }
+
+        return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+    }
+
+    double lowerBound(LowerBound stage, const TimeSeriesView<T>& candidate, double bound)
+    {
+        switch (stage)
+        {
+            case LowerBound::Kim:
+                if (_query.numVars() > 1) return lbKimFL(candidate);
+                return std::pow(lbKim(summarizeSeries(candidate), _summary, _p), _p);
+
+            case LowerBound::KimFL:
+                return lbKimFL(candidate);
+
+            case LowerBound::Keogh:
+                return lbKeogh(candidate, bound);
+
+            case LowerBound::ReverseKeogh:
+                return lbReverseKeogh(candidate, bound);
+
+            case LowerBound::Improved:
+                return lbImproved(candidate, bound);
+
+            case LowerBound::Enhanced:
+                return lbEnhanced(candidate, bound);
+        }
+
+        return 0;
+    }
+
+    double lbKimFL(const TimeSeriesView<T>& candidate)
+    {
+        int n = candidate.length();
+        double lb = 0;
+
+        for (int k = 0; k < candidate.numVars(); k++)
+        {
+            lb += lbTerm(std::abs((double) candidate[0][k] - _query[0][k]), _p);
+            if (n > 1) lb += lbTerm(std::abs((double) candidate[n - 1][k] - _query[n - 1][k]), _p);
+        }
+
+        return lb;
+    }
+
+    // Candidate against the query envelope, also projects the candidate onto it (H)
+    double lbKeogh(const TimeSeriesView<T>& candidate, double bound)
+    {
+        if (_keogh >= 0) return _keogh;
+
+        int num_vars = candidate.numVars();
+        double lb = 0;
+
+        for (int i = 0; i < candidate.length(); i++)
+        {
+            for (int k = 0; k < num_vars; k++)
+            {
+                int e = i * num_vars + k;
+
+                if (candidate[i][k] > _U[e]) {
+                    _H[e] = _U[e];
+                    lb += lbTerm((double) candidate[i][k] - _U[e], _p);
+
+                } else if (candidate[i][k] < _L[e]) {
+                    _H[e] = _L[e];
+                    lb += lbTerm((double) _L[e] - candidate[i][k], _p);
+
+                } else {
+                    _H[e] = candidate[i][k];
+                }
+            }
+
+            if (lb > bound) return lb;
+        }
+
+        return _keogh = lb;
+    }
+
+    // Query against the envelope in L and U (packed), starting from 'lb'
+    double queryAgainst(const T* L, const T* U, double lb, double bound)
+    {
+        int num_vars = _query.numVars();
+
+        for (int i = 0; i < _query.length(); i++)
+        {
+            for (int k = 0; k < num_vars; k++)
+            {
+                int e = i * num_vars + k;
+
+                if (_query[i][k] > U[e])
+                    lb += lbTerm((double) _query[i][k] - U[e], _p);
+                else if (_query[i][k] < L[e])
+                    lb += lbTerm((double) L[e] - _query[i][k], _p);
+            }
+
+            if (lb > bound) break;
+        }
+
+        return lb;
+    }
+
+    // Query against the candidate envelope
+    double lbReverseKeogh(const TimeSeriesView<T>& candidate, double bound)
+    {
+        computeEnvelop(candidate, _window_size, _LC, _UC, _workspace);
+        return queryAgainst(_LC, _UC, 0, bound);
+    }
+
+    // LB_Keogh plus the query against the envelope of H
+    double lbImproved(const TimeSeriesView<T>& candidate, double bound)
+    {
+        double lb = lbKeogh(candidate, bound);
+        if (lb > bound) return lb;
+
+        computeEnvelop(TimeSeriesView<T>(_H, _query.length(), _query.numVars()), _window_size,
+                       _LH, _UH, _workspace);
+
+        return queryAgainst(_LH, _UH, lb, bound);
+    }
+
+    // L-shaped bands at both ends, LB_Keogh in between (see lbEnhanced in lb.h)
+    double lbEnhanced(const TimeSeriesView<T>& candidate, double bound)
+    {
+        const TimeSeriesView<T>& x = candidate;
+        const TimeSeriesView<T>& y = _query;
+
+        int n = x.length();
+        int num_vars = x.numVars();
+        int bands = std::min(_cascade.enhanced_bands, n / 2);
+        int w = _window_size;
+
+        double lb = 0;
+
+        for (int i = 0; i < bands; i++)
+        {
+            int r = n - 1 - i;
+
+            for (int k = 0; k < num_vars; k++)
+            {
+                double front = std::abs((double) x[i][k] - y[i][k]);
+                double back = std::abs((double) x[r][k] - y[r][k]);
+
+                for (int j = std::max(0, i - w); j < i; j++)
+                {
+                    front = std::min(front, std::abs((double) x[i][k] - y[j][k]));
+                    front = std::min(front, std::abs((double) x[j][k] - y[i][k]));
+
+                    int s = n - 1 - j;
+                    back = std::min(back, std::abs((double) x[r][k] - y[s][k]));
+                    back = std::min(back, std::abs((double) x[s][k] - y[r][k]));
+                }
+
+                lb += lbTerm(front, _p) + lbTerm(back, _p);
+            }
+
+            if (lb > bound) return lb;
+        }
+
+        for (int i = bands; i < n - bands; i++)
+        {
+            for (int k = 0; k < num_vars; k++)
+            {
+                int e = i * num_vars + k;
+
+                if (x[i][k] > _U[e])
+                    lb += lbTerm((double) x[i][k] - _U[e], _p);
+                else if (x[i][k] < _L[e])
+                    lb += lbTerm((double) _L[e] - x[i][k], _p);
+            }
+
+            if (lb > bound) break;
+        }
+
+        return lb;
+    }
+
+    TimeSeriesView<T> _query;
+    int _window_size;
+    int _p;
+    int _diag_weight;
+    bool _independent;
+    LBCascade _cascade;
+    DTWWorkspace& _workspace;
+
+    // query envelope, projection H and its envelope, candidate envelope
+    T *_L, *_U, *_H, *_LH, *_UH, *_LC, *_UC;
+
+    SeriesSummary _summary;
+    double _keogh;
+    int _lanes;
+};
+
+/*
+ * Sequential scan of 'size' candidates (candidate(k) returns the k-th one as a view, which must
+ * stay valid) with the lower bounds of 'filter'. threshold() is the current pruning threshold
+ * and accept(k, distance) receives every candidate that is not pruned, in database order, with
+ * its DTW distance or infinity if it exceeds the threshold.
+ *
+ * The candidates left by the lower bounds are queued and their DTW distances computed a batch at
+ * a time (see computeBatchedDTW in dtw.h), using the threshold at the time of the batch. It can
+ * only be lower than when they were queued, and a distance is exact whenever it is below the
+ * threshold, so a search that keeps candidates strictly below it gets the same result as with
+ * filter.evaluate on each candidate in turn.
+ */
+template<typename T, typename Candidate, typename Threshold, typename Accept>
+void scanCandidates(QueryFilter<T>& filter, int size, Candidate candidate, Threshold threshold,
+                    Accept accept)
+{
+    int lanes = filter.lanes();
+
+    if (lanes == 1) {
+        for (int k = 0; k < size; k++)
+            accept(k, filter.evaluate(candidate(k), threshold()));
+
+        return;
+    }
+
+    TimeSeriesView<T> batch[MAX_BATCH_LANES];
+    int indices[MAX_BATCH_LANES];
+    double distances[MAX_BATCH_LANES];
+    int count = 0;
+
+    for (int k = 0; k <= size; k++)
+    {
+        if (k < size && !filter.prune(candidate(k), threshold())) {
+            batch[count] = candidate(k);
+            indices[count++] = k;
+        }
+
+        if (count == lanes || (k == size && count > 0)) {
+            filter.evaluateBatch(batch, count, threshold(), distances);
+
+            for (int b = 0; b < count; b++)
+                accept(indices[b], distances[b]);
+
+            count = 0;
+        }
+    }
+}
+
+// View of x, its values are copied (packed) to 'buffer' if it is not contiguous
+inline TimeSeriesView<double> contiguousView(const TimeSeriesBase& x, double* buffer)
+{
+    if (isContiguous(x))
+        return viewOf(x);
+
+    int num_vars = x.numVars();
+
+    for (int i = 0; i < x.length(); i++)
+        for (int k = 0; k < num_vars; k++)
+            buffer[i * num_vars + k] = x[i][k];
+
+    return TimeSeriesView<double>(buffer, x.length(), num_vars);
+}
+
+/*
+ * The k nearest neighbors seen so far, kept in a max-heap so that the k-th distance (the pruning
+ * threshold) is always at the front.
+ */
+class NeighborHeap
+{
+public:
+
+    explicit NeighborHeap(int k) :
+        _k(k)
+    {
+        if (k <= 0)
+            throw("Number of neighbors must be positive.");
+
+        _heap.reserve(k);
+    }
+
+    // Distance a candidate must not exceed to enter the heap
+    double threshold() const {
+        return (int) _heap.size() < _k ? std::numeric_limits<double>::infinity()
+                                       : _heap.front().distance;
+    }
+
+    // Candidates are offered in database order, so ties with the k-th one are not kept
+    void offer(int index, double distance) {
+        if ((int) _heap.size() < _k) {
+            _heap.push_back({ index, distance });
+            std::push_heap(_heap.begin(), _heap.end());
+
+        } else if (distance < _heap.front().distance) {
+            std::pop_heap(_heap.begin(), _heap.end());
+            _heap.back() = { index, distance };
+            std::push_heap(_heap.begin(), _heap.end());
+        }
+    }
+
+    // Sorted neighbors, the heap is left empty
+    std::vector<Neighbor> release() {
+        std::sort_heap(_heap.begin(), _heap.end());
+        return std::move(_heap);
+    }
+
+private:
+    int _k;
+    std::vector<Neighbor> _heap;
+};
+
+// Candidates handed to a thread at a time in the parallel searches
+static const int SEARCH_CHUNK_SIZE = 32;
+
+/*
+ * Parallel 1-NN over 'size' candidates, candidate(k, workspace) returns the k-th one as a view.
+ *
+ * Each thread has its own workspace (and so its own envelopes and scratch series) and keeps its
+ * own best candidate, but the best distance found so far is shared so that all threads prune
+ * with it. Candidates tied with the bound are not pruned, so the result is the first nearest
+ * neighbor in database order regardless of scheduling.
+ */
+template<typename T, typename Candidate>
+int parallelNearestNeighbor(int size, Candidate candidate, const TimeSeriesView<T>& query,
+                            int window_size, int p, int diag_weight,
+                            const LBCascade& cascade, int num_threads, SearchStats& stats)
+{
+    if (num_threads <= 0) num_threads = defaultNumThreads();
+    num_threads = std::max(1, std::min(num_threads, (size + SEARCH_CHUNK_SIZE - 1) /
+                                                    SEARCH_CHUNK_SIZE));
+
+    std::vector<DTWWorkspace> workspaces(num_threads);
+    std::vector<SearchStats> thread_stats(num_threads);
+    std::vector<double> distances(num_threads, std::numeric_limits<double>::infinity());
+    std::vector<int> neighbors(num_threads, -1);
+
+    SharedMinimum bound(std::numeric_limits<double>::infinity());
+    WorkCounter counter(size, SEARCH_CHUNK_SIZE);
+
+    runThreads(num_threads, [&](int thread) {
+        DTWWorkspace& workspace = workspaces[thread];
+        workspace.setStats(&thread_stats[thread]);
+
+        QueryFilter<T> filter(query, window_size, p, diag_weight, cascade, workspace);
+
+        double d = std::numeric_limits<double>::infinity();
+        int NN = -1;
+        int begin, end;
+
+        // chunks are handed out in increasing order, so ties keep the first candidate
+        while (counter.next(begin, end)) {
+            for (int k = begin; k < end; k++)
+            {
+                double dtw = filter.evaluate(candidate(k, workspace), bound.load());
+
+                if (dtw < d) {
+                    NN = k;
+                    d = dtw;
+                    bound.update(d);
+                }
+            }
+        }
+
+        distances[thread] = d;
+        neighbors[thread] = NN;
+    });
+
+    for (const SearchStats& counters : thread_stats)
+        stats.merge(counters);
+
+    // smallest distance, smallest index among ties
+    int NN = -1;
+    double d = std::numeric_limits<double>::infinity();
+
+    for (int thread = 0; thread < num_threads; thread++)
+    {
+        int k = neighbors[thread];
+        if (k < 0) continue;
+
+        if (NN < 0 || distances[thread] < d || (distances[thread] == d && k < NN)) {
+            NN = k;
+            d = distances[thread];
+        }
+    }
+
+    return NN;
+}
+
+}
+
+/** 1-Nearest-Neighbor in DTW space exploiting its lower bounds, contiguous version
+
+    All series in the database should have the same length and number of variables as 'query'.
+    Multivariate series use the dependent DTW of computeDTW, see nearestNeighborIndependentDTW
+    below for the independent one.
+
+    The index of the nearest neighbor in 'tsdb' is returned, or -1 if 'tsdb' is empty.
+ */
+template<typename T>
+int nearestNeighborDTW(const std::vector<TimeSeriesView<T>>& tsdb, const TimeSeriesView<T>& query,
+                       int window_size, int p, int diag_weight,
+                       const LBCascade& cascade, DTWWorkspace& workspace)
+{
+    detail::QueryFilter<T> filter(query, window_size, p, diag_weight, cascade, workspace);
+
+    // Initial DTW distance
+    double d = std::numeric_limits<double>::infinity();
+
+    // To return
+    int NN = -1;
+
+    detail::scanCandidates(
+        filter, (int) tsdb.size(),
+        [&](int k) -> const TimeSeriesView<T>& { return tsdb[k]; },
+        [&]() { return d; },
+        [&](int k, double dtw) {
+            if (dtw < d) {
+                NN = k;
+                d = dtw;
+            }
+        });
+
+    return NN;
+}
+
+template<typename T>
+int nearestNeighborDTW(const std::vector<TimeSeriesView<T>>& tsdb, const TimeSeriesView<T>& query,
+                       int window_size, int p, int diag_weight,
+                       DTWWorkspace& workspace)
+{
+    return nearestNeighborDTW(tsdb, query, window_size, p, diag_weight, LBCascade(), workspace);
+}
+
+template<typename T>
+int nearestNeighborDTW(const std::vector<TimeSeriesView<T>>& tsdb, const TimeSeriesView<T>& query,
+                       int window_size, int p, int diag_weight)
+{
+    DTWWorkspace workspace;
+    return nearestNeighborDTW(tsdb, query, window_size, p, diag_weight, workspace);
+}
+
+/** 1-Nearest-Neighbor in DTW space visiting candidates by increasing lower bound
+
+    Same result as nearestNeighborDTW (ties go to the first series in 'tsdb'), but LB_Keogh is
+    first computed for every candidate in one pass, and candidates are then visited from the
+    lowest bound up, each one still going through the cascade before DTW. The nearest neighbor
+    usually has one of the lowest bounds, so the best-so-far is tight from the first candidates
+    on, and the search stops as soon as the next bound exceeds it: the remaining candidates are
+    never touched again.
+
+    Pays off when few candidates survive the cascade anyway, at the cost of one full LB_Keogh
+    per candidate and a sort. All series in the database should have the same length and number
+    of variables as 'query'.
+ */
+template<typename T>
+int sortedNearestNeighborDTW(const std::vector<TimeSeriesView<T>>& tsdb,
+                             const TimeSeriesView<T>& query,
+                             int window_size, int p, int diag_weight,
+                             const LBCascade& cascade, DTWWorkspace& workspace)
+{
+    detail::QueryFilter<T> filter(query, window_size, p, diag_weight, cascade, workspace);
+
+    // (index, LB_Keogh as a p-th power) of every candidate, lowest bound first
+    std::vector<Neighbor> order(tsdb.size());
+
+    TSDIST_STATS_ONLY(SearchStats* stats = workspace.stats();)
+
+    {
+        TSDIST_STATS_ONLY(int stage = (int) LowerBound::Keogh;)
+        TSDIST_STATS_ONLY(StatsTimer timer(stats ? &stats->lb_seconds[stage] : nullptr);)
+
+        for (int k = 0; k < (int) tsdb.size(); k++)
+            order[k] = { k, filter.keoghBound(tsdb[k]) };
+
+        std::sort(order.begin(), order.end());
+    }
+
+    double d = std::numeric_limits<double>::infinity();
+    int NN = -1;
+
+    for (int r = 0; r < (int) order.size(); r++)
+    {
+        // same slack as the cascade, so that candidates tied with the best are still visited
+        double bound = std::pow(d, p);
+        bound += bound * detail::THRESHOLD_SLACK;
+
+        if (order[r].distance > bound) {
+            TSDIST_STATS_ONLY(if (stats) {
+                stats->candidates += order.size() - r;
+                stats->pruned[(int) LowerBound::Keogh] += order.size() - r;
+            })
+
+            break;
+        }
+
+        int k = order[r].index;
+        double dtw = filter.evaluate(tsdb[k], d);
+
+        // visited out of database order, ties go to the smallest index
+        if (dtw < d || (dtw == d && k < NN)) {
+            NN = k;
+            d = dtw;
+        }
+    }
+
+    return NN;
+}
+
+template<typename T>
+int sortedNearestNeighborDTW(const std::vector<TimeSeriesView<T>>& tsdb,
+                             const TimeSeriesView<T>& query,
+                             int window_size, int p, int diag_weight,
+                             DTWWorkspace& workspace)
+{
+    return sortedNearestNeighborDTW(tsdb, query, window_size, p, diag_weight, LBCascade(),
+                                    workspace);
+}
+
+template<typename T>
+int sortedNearestNeighborDTW(const std::vector<TimeSeriesView<T>>& tsdb,
+                             const TimeSeriesView<T>& query,
+                             int window_size, int p, int diag_weight)
+{
+    DTWWorkspace workspace;
+    return sortedNearestNeighborDTW(tsdb, query, window_size, p, diag_weight, workspace);
+}
+
+/** Multithreaded 1-Nearest-Neighbor in DTW space exploiting its lower bounds, contiguous version
+
+    Same result as the single-threaded version (ties go to the first series in 'tsdb'), but the
+    database is scanned by several threads that share the best distance found so far for
+    pruning.
+
+    Parameter num_threads is the number of threads to use, 0 means one per hardware thread
+    Parameter stats, if given, receives the statistics of all threads (see stats.h)
+ */
+template<typename T>
+int nearestNeighborDTW(const std::vector<TimeSeriesView<T>>& tsdb, const TimeSeriesView<T>& query,
+                       int window_size, int p, int diag_weight,
+                       const LBCascade& cascade, int num_threads, SearchStats& stats)
+{
+    return detail::parallelNearestNeighbor(
+        (int) tsdb.size(),
+        [&](int k, DTWWorkspace&) -> const TimeSeriesView<T>& { return tsdb[k]; },
+        query, window_size, p, diag_weight, cascade, num_threads, stats);
+}
+
+template<typename T>
+int nearestNeighborDTW(const std::vector<TimeSeriesView<T>>& tsdb, const TimeSeriesView<T>& query,
+                       int window_size, int p, int diag_weight,
+                       const LBCascade& cascade, int num_threads)
+{
+    SearchStats stats;
+    return nearestNeighborDTW(tsdb, query, window_size, p, diag_weight, cascade, num_threads,
+                              stats);
+}
+
+template<typename T>
+int nearestNeighborDTW(const std::vector<TimeSeriesView<T>>& tsdb, const TimeSeriesView<T>& query,
+                       int window_size, int p, int diag_weight, int num_threads)
+{
+    return nearestNeighborDTW(tsdb, query, window_size, p, diag_weight, LBCascade(), num_threads);
+}
+
 /** 1-Nearest-Neighbor in DTW space exploiting its lower bounds
 
     All series in the database should have the same length as 'query'
 
     This assumes the time-series database (TSDB) supports iterators that reference/point to
     TimeSeriesBase derivatives (see ts.h).
+
+    Series that expose contiguous storage are used directly, others are copied to the workspace
+    one at a time.
  */
 template<typename TSDB, typename TS>
 const TS nearestNeighborDTW(const TSDB& tsdb, const TS& query,
-                             int window_size, int p, int diag_weight)
+                             int window_size, int p, int diag_weight,
+                             const LBCascade& cascade, DTWWorkspace& workspace)
 {
-    TS L(query), U(query), H(query);
+    int n = query.length();
+    int size = n * query.numVars();
+    double* buffer = workspace.candidates(2 * size);
 
-    // Window size and length checked here
-    computeEnvelop(query, window_size, L, U);
+    detail::QueryFilter<double> filter(detail::contiguousView(query, buffer),
+                                       window_size, p, diag_weight, cascade, workspace);
 
     // Initial DTW distance
-    double d = std::numeric_limits<double>::max();
+    double d = std::numeric_limits<double>::infinity();
 
     // To return
     const TS *NN = nullptr;
 
     for (const TS& REF : tsdb)
     {
-        double lb = 0;
+        if (REF.length() != n)
+            throw("Length mismatch between the query and the database.");
 
-        // LB_Keogh
-        for (int i = 0; i < REF.length(); i++)
-        {
-            if (REF[i][0] > U[i][0]) {
-                H[i][0] = U[i][0];
-                lb += std::pow(REF[i][0] - U[i][0], p);
+        if (REF.numVars() != query.numVars())
+            throw("Series must have the same number of variables.");
 
-            } else if (REF[i][0] < L[i][0]) {
-                H[i][0] = L[i][0];
-                lb += std::pow(L[i][0] - REF[i][0], p);
+        double dtw = filter.evaluate(detail::contiguousView(REF, buffer + size), d);
 
-            } else {
-                H[i][0] = REF[i][0];
-            }
+        if (dtw < d) {
+            NN = &REF;
+            d = dtw;
         }
+    }
 
-        if (lb < d) {
-            // LB_Improved
-            computeEnvelop(H, window_size, L, U);
+    if (tsdb.begin() == tsdb.end())
+        throw("The database is empty.");
 
-            for (int i = 0; i < query.length(); i++)
-            {
-                if (query[i][0] > U[i][0])
-                    lb += std::pow(query[i][0] - U[i][0], p);
-                else if (query[i][0] < L[i][0])
-                    lb += std::pow(L[i][0] - query[i][0], p);
-            }
+    // e.g. NaN values, or a window that leaves no warping path
+    if (NN == nullptr)
+        throw("No series of the database is at a finite DTW distance from the query.");
 
-            if (lb < d) {
-                // DTW distance
-                double dtw = computeDTW(REF, query, window_size, p, diag_weight);
-                dtw = std::pow(dtw, p);
+    return *NN;
+}
 
-                if (dtw < d) {
-                    NN = &REF;
-                    d = dtw;
-                }
-            }
+template<typename TSDB, typename TS>
+const TS nearestNeighborDTW(const TSDB& tsdb, const TS& query,
+                             int window_size, int p, int diag_weight,
+                             DTWWorkspace& workspace)
+{
+    return nearestNeighborDTW(tsdb, query, window_size, p, diag_weight, LBCascade(), workspace);
+}
+
+template<typename TSDB, typename TS>
+const TS nearestNeighborDTW(const TSDB& tsdb, const TS& query,
+                             int window_size, int p, int diag_weight)
+{
+    DTWWorkspace workspace;
+    return nearestNeighborDTW(tsdb, query, window_size, p, diag_weight, workspace);
+}
+
+/** Multithreaded 1-Nearest-Neighbor in DTW space exploiting its lower bounds
+
+    Same as the single-threaded version, see the contiguous one for the details. The series in
+    the database are first collected so that threads can access them by index.
+
+    Parameter num_threads is the number of threads to use, 0 means one per hardware thread
+    Parameter stats, if given, receives the statistics of all threads (see stats.h)
+ */
+template<typename TSDB, typename TS>
+const TS nearestNeighborDTW(const TSDB& tsdb, const TS& query,
+                             int window_size, int p, int diag_weight,
+                             const LBCascade& cascade, int num_threads, SearchStats& stats)
+{
+    int n = query.length();
+
+    std::vector<const TS*> refs;
+    for (const TS& REF : tsdb) {
+        if (REF.length() != n)
+            throw("Length mismatch between the query and the database.");
+
+        if (REF.numVars() != query.numVars())
+            throw("Series must have the same number of variables.");
+
+        refs.push_back(&REF);
+    }
+
+    if (refs.empty())
+        throw("The database is empty.");
+
+    int size = n * query.numVars();
+    std::vector<double> query_buffer(isContiguous(query) ? 0 : size);
+
+    int NN = detail::parallelNearestNeighbor(
+        (int) refs.size(),
+        [&](int k, DTWWorkspace& workspace) {
+            return detail::contiguousView(*refs[k], workspace.candidates(size));
+        },
+        detail::contiguousView(query, query_buffer.data()),
+        window_size, p, diag_weight, cascade, num_threads, stats);
+
+    if (NN < 0)
+        throw("No series of the database is at a finite DTW distance from the query.");
+
+    return *refs[NN];
+}
+
+template<typename TSDB, typename TS>
+const TS nearestNeighborDTW(const TSDB& tsdb, const TS& query,
+                             int window_size, int p, int diag_weight,
+                             const LBCascade& cascade, int num_threads)
+{
+    SearchStats stats;
+    return nearestNeighborDTW(tsdb, query, window_size, p, diag_weight, cascade, num_threads,
+                              stats);
+}
+
+template<typename TSDB, typename TS>
+const TS nearestNeighborDTW(const TSDB& tsdb, const TS& query,
+                             int window_size, int p, int diag_weight, int num_threads)
+{
+    return nearestNeighborDTW(tsdb, query, window_size, p, diag_weight, LBCascade(), num_threads);
+}
+
+/** 1-Nearest-Neighbor in independent DTW space exploiting its lower bounds, contiguous version
+
+    Same as nearestNeighborDTW with the distance of computeIndependentDTW, where every variable
+    of a multivariate series has its own warping path. The lower bounds are the same (they hold
+    for both), and each variable is abandoned as soon as the sum exceeds the best distance.
+
+    All series in the database should have the same length and number of variables as 'query'
+
+    The index of the nearest neighbor in 'tsdb' is returned, or -1 if 'tsdb' is empty.
+ */
+template<typename T>
+int nearestNeighborIndependentDTW(const std::vector<TimeSeriesView<T>>& tsdb,
+                                  const TimeSeriesView<T>& query,
+                                  int window_size, int p, int diag_weight,
+                                  const LBCascade& cascade, DTWWorkspace& workspace)
+{
+    detail::QueryFilter<T> filter(query, window_size, p, diag_weight, cascade, workspace, true);
+
+    double d = std::numeric_limits<double>::infinity();
+    int NN = -1;
+
+    for (int k = 0; k < (int) tsdb.size(); k++)
+    {
+        double dtw = filter.evaluate(tsdb[k], d);
+
+        if (dtw < d) {
+            NN = k;
+            d = dtw;
         }
     }
 
+    return NN;
+}
+
+template<typename T>
+int nearestNeighborIndependentDTW(const std::vector<TimeSeriesView<T>>& tsdb,
+                                  const TimeSeriesView<T>& query,
+                                  int window_size, int p, int diag_weight,
+                                  DTWWorkspace& workspace)
+{
+    return nearestNeighborIndependentDTW(tsdb, query, window_size, p, diag_weight, LBCascade(),
+                                         workspace);
+}
+
+template<typename T>
+int nearestNeighborIndependentDTW(const std::vector<TimeSeriesView<T>>& tsdb,
+                                  const TimeSeriesView<T>& query,
+                                  int window_size, int p, int diag_weight)
+{
+    DTWWorkspace workspace;
+    return nearestNeighborIndependentDTW(tsdb, query, window_size, p, diag_weight, workspace);
+}
+
+/** 1-Nearest-Neighbor in independent DTW space exploiting its lower bounds
+
+    Same as the contiguous version, for any TSDB like nearestNeighborDTW.
+ */
+template<typename TSDB, typename TS>
+const TS nearestNeighborIndependentDTW(const TSDB& tsdb, const TS& query,
+                                        int window_size, int p, int diag_weight,
+                                        const LBCascade& cascade, DTWWorkspace& workspace)
+{
+    int n = query.length();
+    int size = n * query.numVars();
+    double* buffer = workspace.candidates(2 * size);
+
+    detail::QueryFilter<double> filter(detail::contiguousView(query, buffer),
+                                       window_size, p, diag_weight, cascade, workspace, true);
+
+    double d = std::numeric_limits<double>::infinity();
+    const TS *NN = nullptr;
+
+    for (const TS& REF : tsdb)
+    {
+        if (REF.length() != n)
+            throw("Length mismatch between the query and the database.");
+
+        if (REF.numVars() != query.numVars())
+            throw("Series must have the same number of variables.");
+
+        double dtw = filter.evaluate(detail::contiguousView(REF, buffer + size), d);
+
+        if (dtw < d) {
+            NN = &REF;
+            d = dtw;
+        }
+    }
+
+    if (tsdb.begin() == tsdb.end())
+        throw("The database is empty.");
+
+    // e.g. NaN values, or a window that leaves no warping path
+    if (NN == nullptr)
+        throw("No series of the database is at a finite DTW distance from the query.");
+
     return *NN;
 }
 
+template<typename TSDB, typename TS>
+const TS nearestNeighborIndependentDTW(const TSDB& tsdb, const TS& query,
+                                        int window_size, int p, int diag_weight,
+                                        DTWWorkspace& workspace)
+{
+    return nearestNeighborIndependentDTW(tsdb, query, window_size, p, diag_weight, LBCascade(),
+                                         workspace);
+}
+
+template<typename TSDB, typename TS>
+const TS nearestNeighborIndependentDTW(const TSDB& tsdb, const TS& query,
+                                        int window_size, int p, int diag_weight)
+{
+    DTWWorkspace workspace;
+    return nearestNeighborIndependentDTW(tsdb, query, window_size, p, diag_weight, workspace);
+}
+
+/** k-Nearest-Neighbors in DTW space exploiting its lower bounds, contiguous version
+
+    All series in the database should have the same length as 'query'
+
+    The k-th best distance found so far is used as the threshold for the lower bounds and the
+    early abandoning DTW.
+
+    Returns (index, distance) for the min(k, tsdb.size()) series closest to 'query', sorted by
+    distance; ties are broken by position in 'tsdb'.
+ */
+template<typename T>
+std::vector<Neighbor> kNearestNeighborsDTW(const std::vector<TimeSeriesView<T>>& tsdb,
+                                           const TimeSeriesView<T>& query, int k,
+                                           int window_size, int p, int diag_weight,
+                                           const LBCascade& cascade, DTWWorkspace& workspace)
+{
+    detail::NeighborHeap heap(k);
+    detail::QueryFilter<T> filter(query, window_size, p, diag_weight, cascade, workspace);
+
+    detail::scanCandidates(
+        filter, (int) tsdb.size(),
+        [&](int i) -> const TimeSeriesView<T>& { return tsdb[i]; },
+        [&]() { return heap.threshold(); },
+        [&](int i, double dtw) {
+            if (dtw < std::numeric_limits<double>::infinity())
+                heap.offer(i, dtw);
+        });
+
+    return heap.release();
+}
+
+template<typename T>
+std::vector<Neighbor> kNearestNeighborsDTW(const std::vector<TimeSeriesView<T>>& tsdb,
+                                           const TimeSeriesView<T>& query, int k,
+                                           int window_size, int p, int diag_weight,
+                                           DTWWorkspace& workspace)
+{
+    return kNearestNeighborsDTW(tsdb, query, k, window_size, p, diag_weight, LBCascade(),
+                                workspace);
+}
+
+template<typename T>
+std::vector<Neighbor> kNearestNeighborsDTW(const std::vector<TimeSeriesView<T>>& tsdb,
+                                           const TimeSeriesView<T>& query, int k,
+                                           int window_size, int p, int diag_weight)
+{
+    DTWWorkspace workspace;
+    return kNearestNeighborsDTW(tsdb, query, k, window_size, p, diag_weight, workspace);
+}
+
+/** Range query in DTW space exploiting its lower bounds, contiguous version
+
+    All series in the database should have the same length as 'query'
+
+    Returns (index, distance) for every series whose distance to 'query' is not larger than
+    'radius', sorted by distance; ties are broken by position in 'tsdb'.
+ */
+template<typename T>
+std::vector<Neighbor> rangeQueryDTW(const std::vector<TimeSeriesView<T>>& tsdb,
+                                    const TimeSeriesView<T>& query, double radius,
+                                    int window_size, int p, int diag_weight,
+                                    const LBCascade& cascade, DTWWorkspace& workspace)
+{
+    std::vector<Neighbor> result;
+    detail::QueryFilter<T> filter(query, window_size, p, diag_weight, cascade, workspace);
+
+    detail::scanCandidates(
+        filter, (int) tsdb.size(),
+        [&](int i) -> const TimeSeriesView<T>& { return tsdb[i]; },
+        [&]() { return radius; },
+        [&](int i, double dtw) {
+            if (dtw <= radius)
+                result.push_back({ i, dtw });
+        });
+
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+template<typename T>
+std::vector<Neighbor> rangeQueryDTW(const std::vector<TimeSeriesView<T>>& tsdb,
+                                    const TimeSeriesView<T>& query, double radius,
+                                    int window_size, int p, int diag_weight,
+                                    DTWWorkspace& workspace)
+{
+    return rangeQueryDTW(tsdb, query, radius, window_size, p, diag_weight, LBCascade(), workspace);
+}
+
+template<typename T>
+std::vector<Neighbor> rangeQueryDTW(const std::vector<TimeSeriesView<T>>& tsdb,
+                                    const TimeSeriesView<T>& query, double radius,
+                                    int window_size, int p, int diag_weight)
+{
+    DTWWorkspace workspace;
+    return rangeQueryDTW(tsdb, query, radius, window_size, p, diag_weight, workspace);
+}
+
+/** k-Nearest-Neighbors in DTW space exploiting its lower bounds
+
+    Same as the contiguous version, indices are positions in the iteration order of 'tsdb'.
+    Series that expose contiguous storage are used directly, others are copied to the workspace
+    one at a time.
+ */
+template<typename TSDB, typename TS>
+std::vector<Neighbor> kNearestNeighborsDTW(const TSDB& tsdb, const TS& query, int k,
+                                           int window_size, int p, int diag_weight,
+                                           const LBCascade& cascade, DTWWorkspace& workspace)
+{
+    int n = query.length();
+    int size = n * query.numVars();
+    double* buffer = workspace.candidates(2 * size);
+
+    detail::NeighborHeap heap(k);
+    detail::QueryFilter<double> filter(detail::contiguousView(query, buffer),
+                                       window_size, p, diag_weight, cascade, workspace);
+
+    int i = 0;
+    for (const TS& REF : tsdb)
+    {
+        if (REF.length() != n)
+            throw("Length mismatch between the query and the database.");
+
+        if (REF.numVars() != query.numVars())
+            throw("Series must have the same number of variables.");
+
+        double dtw = filter.evaluate(detail::contiguousView(REF, buffer + size), heap.threshold());
+
+        if (dtw < std::numeric_limits<double>::infinity())
+            heap.offer(i, dtw);
+
+        i++;
+    }
+
+    return heap.release();
+}
+
+template<typename TSDB, typename TS>
+std::vector<Neighbor> kNearestNeighborsDTW(const TSDB& tsdb, const TS& query, int k,
+                                           int window_size, int p, int diag_weight,
+                                           DTWWorkspace& workspace)
+{
+    return kNearestNeighborsDTW(tsdb, query, k, window_size, p, diag_weight, LBCascade(),
+                                workspace);
+}
+
+template<typename TSDB, typename TS>
+std::vector<Neighbor> kNearestNeighborsDTW(const TSDB& tsdb, const TS& query, int k,
+                                           int window_size, int p, int diag_weight)
+{
+    DTWWorkspace workspace;
+    return kNearestNeighborsDTW(tsdb, query, k, window_size, p, diag_weight, workspace);
+}
+
+/** Range query in DTW space exploiting its lower bounds
+
+    Same as the contiguous version, indices are positions in the iteration order of 'tsdb'.
+ */
+template<typename TSDB, typename TS>
+std::vector<Neighbor> rangeQueryDTW(const TSDB& tsdb, const TS& query, double radius,
+                                    int window_size, int p, int diag_weight,
+                                    const LBCascade& cascade, DTWWorkspace& workspace)
+{
+    int n = query.length();
+    int size = n * query.numVars();
+    double* buffer = workspace.candidates(2 * size);
+
+    std::vector<Neighbor> result;
+    detail::QueryFilter<double> filter(detail::contiguousView(query, buffer),
+                                       window_size, p, diag_weight, cascade, workspace);
+
+    int i = 0;
+    for (const TS& REF : tsdb)
+    {
+        if (REF.length() != n)
+            throw("Length mismatch between the query and the database.");
+
+        if (REF.numVars() != query.numVars())
+            throw("Series must have the same number of variables.");
+
+        double dtw = filter.evaluate(detail::contiguousView(REF, buffer + size), radius);
+
+        if (dtw <= radius)
+            result.push_back({ i, dtw });
+
+        i++;
+    }
+
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+template<typename TSDB, typename TS>
+std::vector<Neighbor> rangeQueryDTW(const TSDB& tsdb, const TS& query, double radius,
+                                    int window_size, int p, int diag_weight,
+                                    DTWWorkspace& workspace)
+{
+    return rangeQueryDTW(tsdb, query, radius, window_size, p, diag_weight, LBCascade(), workspace);
+}
+
+template<typename TSDB, typename TS>
+std::vector<Neighbor> rangeQueryDTW(const TSDB& tsdb, const TS& query, double radius,
+                                    int window_size, int p, int diag_weight)
+{
+    DTWWorkspace workspace;
+    return rangeQueryDTW(tsdb, query, radius, window_size, p, diag_weight, workspace);
+}
+
 }
 
 #endif // _1NN_H
@@ -5,5 +5,17 @@
 #include "dtw.h"
 #include "lb.h"
 #include "1nn.h"
+#include "batch.h"
+#include "index.h"
+#include "paatree.h"
+#include "subsequence.h"
+#include "streaming.h"
+#include "pairwise.h"
+#include "quantized.h"
+#include "tsdb.h"
+#include "fastdtw.h"
+#include "dba.h"
+#include "datasets.h"
+#include "stats.h"
 
 #endif // _TSdist_H
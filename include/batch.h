@@ -0,0 +1,241 @@
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#include <algorithm> // std::min, std::max
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+#include "dtw.h"
+#include "lb.h"
+#include "1nn.h"
+#include "parallel.h"
+#include "stats.h"
+#include "workspace.h"
+
+namespace TSdist {
+
+namespace detail {
+
+// Bytes of reference data (series and both envelopes) processed per tile, about half an L2
+static const std::size_t BATCH_TILE_BYTES = 256 * 1024;
+
+// Queries processed together against each tile of references
+static const int BATCH_QUERY_BLOCK = 8;
+
+/*
+ * LB_Keogh of x against the envelope (lower, upper) as a p-th power. The sum is abandoned as
+ * soon as it exceeds 'bound', in which case the partial sum is returned.
+ */
+template<typename T>
+double lbKeoghBounded(const TimeSeriesView<T>& x, const T* lower, const T* upper, int p,
+                      double bound)
+{
+    double lb = 0;
+
+    for (int i = 0; i < x.length(); i++)
+    {
+        double value = x[i][0];
+
+        if (value > upper[i])
+            lb += lbTerm(value - upper[i], p);
+        else if (value < lower[i])
+            lb += lbTerm(lower[i] - value, p);
+        else
+            continue;
+
+        if (lb > bound) break;
+    }
+
+    return lb;
+}
+
+// Lower and upper envelopes of 'series' (all of length n) stored one after the other
+template<typename T>
+void batchEnvelops(const std::vector<TimeSeriesView<T>>& series, int n, int window_size,
+                   std::vector<T>& lower, std::vector<T>& upper, int num_threads)
+{
+    for (const TimeSeriesView<T>& x : series)
+    {
+        if (x.length() != n)
+            throw("Length mismatch between the query and the database.");
+
+        if (x.numVars() != 1)
+            throw("Only univariate series are supported.");
+    }
+
+    lower.resize(series.size() * (std::size_t) n);
+    upper.resize(series.size() * (std::size_t) n);
+
+    computeEnvelops(series, window_size, lower.data(), upper.data(), num_threads);
+}
+
+}
+
+/** Batch 1-Nearest-Neighbor in DTW space exploiting its lower bounds, contiguous version
+
+    Same result for each query as nearestNeighborDTW (ties go to the first series in 'tsdb'),
+    but the work is shared across the whole batch:
+
+    - the envelopes of every query and every reference are computed once,
+    - each candidate is filtered with LB_Keogh against the query envelope and then with the
+      reverse LB_Keogh (query against the reference envelope), both abandoned as soon as they
+      exceed the query's best-so-far, before the early abandoning DTW,
+    - queries are processed in small blocks against tiles of references that fit in L2, so the
+      database is streamed from memory once per block of queries instead of once per query.
+
+    All series must be univariate and have the same length.
+
+    Returns one (index, distance) per query; index is -1 and distance infinity if 'tsdb' is
+    empty.
+
+    Parameter num_threads is the number of threads to use (blocks of queries are distributed
+    among them), 0 means one per hardware thread
+    Parameter stats, if given, receives the statistics of all threads (see stats.h)
+ */
+template<typename T>
+std::vector<Neighbor> batchNearestNeighborDTW(const std::vector<TimeSeriesView<T>>& tsdb,
+                                              const std::vector<TimeSeriesView<T>>& queries,
+                                              int window_size, int p, int diag_weight,
+                                              int num_threads, SearchStats& stats)
+{
+    const double INF = std::numeric_limits<double>::infinity();
+
+    std::vector<Neighbor> result(queries.size(), Neighbor{ -1, INF });
+
+    if (queries.empty() || tsdb.empty())
+        return result;
+
+    int n = queries[0].length();
+    int num_refs = tsdb.size();
+    int num_queries = queries.size();
+    int num_blocks = (num_queries + detail::BATCH_QUERY_BLOCK - 1) / detail::BATCH_QUERY_BLOCK;
+
+    if (num_threads <= 0) num_threads = defaultNumThreads();
+    std::vector<DTWWorkspace> workspaces(std::max(1, num_threads));
+
+    // Envelopes of queries and references, lengths and window size checked here
+    std::vector<T> query_lower, query_upper, ref_lower, ref_upper;
+
+    detail::batchEnvelops(queries, n, window_size, query_lower, query_upper, num_threads);
+    detail::batchEnvelops(tsdb, n, window_size, ref_lower, ref_upper, num_threads);
+
+    // References per tile
+    int tile = std::max<std::size_t>(1, detail::BATCH_TILE_BYTES / (3 * n * sizeof(T)));
+
+    if (num_threads > num_blocks) workspaces.resize(num_blocks);
+    WorkCounter counter(num_blocks, 1);
+
+    std::vector<SearchStats> thread_stats(workspaces.size());
+
+    runThreads(workspaces.size(), [&](int thread) {
+        DTWWorkspace& workspace = workspaces[thread];
+        workspace.setStats(&thread_stats[thread]);
+
+        TSDIST_STATS_ONLY(SearchStats& counters = thread_stats[thread];)
+        int block, block_end;
+
+        while (counter.next(block, block_end))
+        {
+            int q_begin = block * detail::BATCH_QUERY_BLOCK;
+            int q_end = std::min(q_begin + detail::BATCH_QUERY_BLOCK, num_queries);
+
+            // p-th power of the best-so-far of each query, with slack for ties
+            double bounds[detail::BATCH_QUERY_BLOCK];
+            std::fill(bounds, bounds + detail::BATCH_QUERY_BLOCK, INF);
+
+            for (int r_begin = 0; r_begin < num_refs; r_begin += tile)
+            {
+                int r_end = std::min(r_begin + tile, num_refs);
+
+                for (int q = q_begin; q < q_end; q++)
+                {
+                    const TimeSeriesView<T>& query = queries[q];
+                    const T* q_lower = &query_lower[(std::size_t) q * n];
+                    const T* q_upper = &query_upper[(std::size_t) q * n];
+
+                    Neighbor& best = result[q];
+                    double& bound = bounds[q - q_begin];
+
+                    for (int r = r_begin; r < r_end; r++)
+                    {
+                        const TimeSeriesView<T>& ref = tsdb[r];
+                        double lb;
+
+                        TSDIST_STATS_ONLY(counters.candidates++;)
+
+                        // LB_Keogh
+                        {
+                            TSDIST_STATS_ONLY(StatsTimer timer(&counters.lb_seconds[
+                                (int) LowerBound::Keogh]);)
+
+                            lb = detail::lbKeoghBounded(ref, q_lower, q_upper, p, bound);
+                        }
+
+                        if (lb > bound) {
+                            TSDIST_STATS_ONLY(counters.pruned[(int) LowerBound::Keogh]++;)
+                            continue;
+                        }
+
+                        // reverse LB_Keogh
+                        {
+                            TSDIST_STATS_ONLY(StatsTimer timer(&counters.lb_seconds[
+                                (int) LowerBound::ReverseKeogh]);)
+
+                            lb = detail::lbKeoghBounded(query, &ref_lower[(std::size_t) r * n],
+                                                        &ref_upper[(std::size_t) r * n],
+                                                        p, bound);
+                        }
+
+                        if (lb > bound) {
+                            TSDIST_STATS_ONLY(counters.pruned[(int) LowerBound::ReverseKeogh]++;)
+                            continue;
+                        }
+
+                        TSDIST_STATS_ONLY(StatsTimer timer(&counters.dtw_seconds);)
+
+                        // DTW distance, abandoned as soon as it exceeds the best-so-far
+                        double dtw = computePrunedDTW(ref, query, window_size, p, diag_weight,
+                                                      best.distance, workspace);
+
+                        if (dtw < best.distance) {
+                            best.index = r;
+                            best.distance = dtw;
+
+                            bound = std::pow(dtw, p);
+                            bound += bound * detail::THRESHOLD_SLACK;
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    for (const SearchStats& counters : thread_stats)
+        stats.merge(counters);
+
+    return result;
+}
+
+template<typename T>
+std::vector<Neighbor> batchNearestNeighborDTW(const std::vector<TimeSeriesView<T>>& tsdb,
+                                              const std::vector<TimeSeriesView<T>>& queries,
+                                              int window_size, int p, int diag_weight,
+                                              int num_threads)
+{
+    SearchStats stats;
+    return batchNearestNeighborDTW(tsdb, queries, window_size, p, diag_weight, num_threads,
+                                   stats);
+}
+
+template<typename T>
+std::vector<Neighbor> batchNearestNeighborDTW(const std::vector<TimeSeriesView<T>>& tsdb,
+                                              const std::vector<TimeSeriesView<T>>& queries,
+                                              int window_size, int p, int diag_weight)
+{
+    return batchNearestNeighborDTW(tsdb, queries, window_size, p, diag_weight, 1);
+}
+
+}
+
+#endif // _BATCH_H
@@ -0,0 +1,77 @@
+#ifndef _DATASETS_H
+#define _DATASETS_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "ts.h"
+
+namespace TSdist {
+
+/** Series stored back to back in memory, each with a class label
+
+    Used to hold data generated or loaded from disk (see below). Series can have different
+    lengths, and their values are packed like TimeSeriesView expects, so views() can be given
+    directly to the searches of 1nn.h.
+ */
+class Dataset
+{
+public:
+
+    Dataset() = default;
+
+    // Appends a copy of 'series' with its label
+    void add(const TimeSeriesView<double>& series, double label);
+
+    int size() const { return _entries.size(); }
+
+    int length(int k) const { return _entries.at(k).length; }
+    int numVars(int k) const { return _entries.at(k).num_vars; }
+    double label(int k) const { return _entries.at(k).label; }
+
+    // View of the k-th series, valid until the next call to add
+    TimeSeriesView<double> view(int k) const {
+        const Entry& e = _entries.at(k);
+        return TimeSeriesView<double>(_values.data() + e.offset, e.length, e.num_vars);
+    }
+
+    // Views of all series, in order
+    std::vector<TimeSeriesView<double>> views() const;
+
+private:
+
+    struct Entry
+    {
+        std::size_t offset;
+        int length;
+        int num_vars;
+        double label;
+    };
+
+    std::vector<double> _values;
+    std::vector<Entry> _entries;
+};
+
+/** Random walks: cumulative sums of standard normal steps
+
+    The usual synthetic data of the DTW literature. The same seed gives the same series with
+    the same standard library. Labels are all 0.
+
+    Parameter size is the number of series
+    Parameter length is the number of observations of each series
+    Parameter num_vars is the number of variables, each one an independent walk
+ */
+Dataset randomWalkDataset(int size, int length, int num_vars, unsigned seed);
+
+/** Dataset in the format of the UCR time series archive
+
+    One series per line: the class label followed by the values, separated by commas, tabs or
+    spaces (both the 2015 comma-separated and the 2018 tab-separated releases). Trailing NaN
+    values, which the 2018 release uses to pad series of different lengths, are dropped. Series
+    are univariate.
+ */
+Dataset loadUCRDataset(const std::string& path);
+
+}
+
+#endif // _DATASETS_H
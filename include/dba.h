@@ -0,0 +1,38 @@
+#ifndef _DBA_H
+#define _DBA_H
+
+#include <vector>
+#include "ts.h"
+
+namespace TSdist {
+
+/** Average of a set of series in DTW space: DBA (Petitjean, Ketterlin and Gancarski, 2011)
+
+    Starting from 'init', each iteration aligns every series of the set to the current average
+    with the path of backtrackDTW, and replaces each observation of the average by the mean of
+    all the observations aligned to it. The average keeps the length of 'init'. With p = 2 and
+    diag_weight = 1, the sum of the squared DTW distances to it does not increase from one
+    iteration to the next; other parameters have no such guarantee, since the mean is not what
+    minimizes them. The iterations stop early when the average does not change anymore.
+
+    The series are split into one contiguous part per thread. Every thread aligns its series
+    with its own workspace (the paths are never stored, each cell is added as it is traced) and
+    the sums of the threads are added in order, so the result only depends on the number of
+    threads.
+
+    Parameter init is the first average, usually one of the series (a medoid)
+    Parameter iterations is the largest number of refinements, >= 0
+    Parameter window_size is the window of DTW, as in backtrackDTW
+    Parameter p is for the Lp norm
+    Parameter diag_weight is the weight of the diagonal in the step pattern
+    Parameter num_threads is the number of threads, 0 for one per hardware thread
+    The average is returned row-major, init.length() times init.numVars() values
+ */
+template<typename T>
+std::vector<T> dbaAverage(const std::vector<TimeSeriesView<T>>& series,
+                          const TimeSeriesView<T>& init, int iterations,
+                          int window_size, int p, int diag_weight, int num_threads);
+
+}
+
+#endif // _DBA_H
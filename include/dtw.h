@@ -3,9 +3,39 @@
 
 #include <vector>
 #include "ts.h"
+#include "simd.h"
+#include "workspace.h"
 
 namespace TSdist {
 
+/*
+ * All functions have an overload that takes a DTWWorkspace (see workspace.h) as last parameter.
+ * Reusing a workspace across calls avoids allocating the cost matrix every time.
+ */
+
+/** Step patterns of computeDTW
+
+    With cell (i, j) reached from:
+
+    - Symmetric1: (i-1, j-1), (i, j-1) or (i-1, j), adding the local cost (diag_weight = 1)
+    - Symmetric2: the same, with the diagonal step adding twice the local cost (diag_weight = 2)
+    - Asymmetric: (i-1, j), (i-1, j-1) or (i-1, j-2), adding the local cost, so every step
+      advances along x and parts of y can be skipped
+    - RabinerJuang: type III of Rabiner and Juang with smoothing 'c', i.e. (i-1, j-2) or
+      (i-1, j-1) adding the local cost, or (i-2, j-1) adding the local costs of (i-1, j) and
+      (i, j)
+ */
+enum class StepPattern { Symmetric1, Symmetric2, Asymmetric, RabinerJuang };
+
+/** Global constraints of computeDTW
+
+    - None: every cell can be used
+    - SakoeChiba: the slanted band of 'window_size' cells used by the other functions
+    - Itakura: the parallelogram with slopes 1/2 and 2 through the first and last cells,
+      scaled to the lengths of both series (window_size is ignored)
+ */
+enum class WindowType { None, SakoeChiba, Itakura };
+
 /** Simple DTW distance and optionally a slanted band constraint
 
     Parameter window_size is for the global constraint. <= 0 means no constraint
@@ -15,6 +45,50 @@ namespace TSdist {
 double computeDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
                   int window_size, int p, int diag_weight);
 
+double computeDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                  int window_size, int p, int diag_weight,
+                  DTWWorkspace& workspace);
+
+
+/** DTW distance with any step pattern and global constraint
+
+    Each combination of p (1, 2 or any other), step pattern and window has its own compiled
+    kernel, so the inner loop neither calls pow() for p = 1 and p = 2 nor branches on the
+    parameters. Symmetric1 and Symmetric2 with no window or a Sakoe-Chiba band give the same
+    result as the function above with diag_weight 1 and 2.
+
+    The distance is infinite if the window leaves no warping path (e.g. Itakura with one series
+    more than twice as long as the other, or Asymmetric with y more than twice as long as x).
+
+    Parameter window_size is for the Sakoe-Chiba band, <= 0 means no constraint
+    Parameter p is for the Lp norm
+ */
+double computeDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                  StepPattern pattern, WindowType window, int window_size, int p);
+
+double computeDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                  StepPattern pattern, WindowType window, int window_size, int p,
+                  DTWWorkspace& workspace);
+
+
+/** Independent DTW distance for multivariate series (DTW_I, Shokoohi-Yekta et al., 2017)
+
+    Every variable is warped on its own: the result is the Lp combination of the univariate DTW
+    distances of all variables, (sum_k computeDTW(x_k, y_k)^p)^(1/p). computeDTW is the
+    dependent version (DTW_D), where all variables share one warping path. Both are equal for
+    univariate series, and the lower bounds of lb.h hold for both.
+
+    Parameter window_size is for the global constraint. <= 0 means no constraint
+    Parameter p is for the Lp norm
+    Parameter diag_weight is the weight of the diagonal in the step pattern
+ */
+double computeIndependentDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                             int window_size, int p, int diag_weight);
+
+double computeIndependentDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                             int window_size, int p, int diag_weight,
+                             DTWWorkspace& workspace);
+
 
 /** Normalized DTW distance and optionally a slanted band constraint
 
@@ -24,9 +98,23 @@ double computeDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
 double computeNormalizedDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
                             int window_size, int p);
 
+double computeNormalizedDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                            int window_size, int p,
+                            DTWWorkspace& workspace);
+
 
 /** Simple DTW distance with backtracking and optionally a slanted band constraint
 
+    Steps are stored with 2 bits per cell inside the window. When they would take more than
+    16 MB, the path is recovered by divide and conquer over the rows, so memory stays
+    O(ny * log(nx)) at the cost of recomputing some rows. The path is the same either way.
+
+    The local cost is the sum of |x - y|^p over the variables, as in computeDTW, and not the
+    p-th power of the Lp norm computed first. For p other than 1 and 2, both round differently,
+    so when several paths have (nearly) the same cost, the one returned can differ from that of
+    an implementation that takes the norm first (the versions of this library before the SIMD
+    kernels, for about 1% of integer random walks with p = 3).
+
     Parameter window_size is for the global constraint. <= 0 means no constraint
     Parameter p is for the Lp norm
     Parameter diag_weight is the weight of the diagonal in the step pattern
@@ -36,6 +124,11 @@ double backtrackDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
                     int window_size, int p, int diag_weight,
                     std::vector<int>& idx, std::vector<int>& idy);
 
+double backtrackDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                    int window_size, int p, int diag_weight,
+                    std::vector<int>& idx, std::vector<int>& idy,
+                    DTWWorkspace& workspace);
+
 
 /** Normalized DTW distance with backtracking and optionally a slanted band constraint
 
@@ -47,6 +140,168 @@ double backtrackNormalizedDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
                               int window_size, int p,
                               std::vector<int>& idx, std::vector<int>& idy);
 
+double backtrackNormalizedDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                              int window_size, int p,
+                              std::vector<int>& idx, std::vector<int>& idy,
+                              DTWWorkspace& workspace);
+
+/** DTW distance with pruning and early abandoning
+
+    Same as computeDTW when the distance is not larger than upper_bound. Otherwise infinity is
+    returned, usually after computing only a small part of the cost matrix: cells whose cost is
+    already above the bound are skipped at both ends of each row, and the computation stops as
+    soon as all cells of a row are above it (PrunedDTW/EAPrunedDTW style).
+
+    Parameter upper_bound is in the same units as the returned distance, infinity disables
+    pruning
+ */
+double computePrunedDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                        int window_size, int p, int diag_weight, double upper_bound);
+
+double computePrunedDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                        int window_size, int p, int diag_weight, double upper_bound,
+                        DTWWorkspace& workspace);
+
+// ================================================================================================
+/* Versions for series in contiguous memory (see TimeSeriesView in ts.h) */
+// ================================================================================================
+
+/*
+ * These have the same semantics as the functions above, which dispatch to them when both series
+ * expose contiguous storage. Instantiated for T = double and T = float. Single precision only
+ * halves the memory (and bandwidth) of the series: values are converted to double before any
+ * arithmetic, so costs are accumulated in double precision.
+ */
+
+template<typename T>
+double computeDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                  int window_size, int p, int diag_weight);
+
+template<typename T>
+double computeDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                  int window_size, int p, int diag_weight,
+                  DTWWorkspace& workspace);
+
+template<typename T>
+double computeDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                  StepPattern pattern, WindowType window, int window_size, int p);
+
+template<typename T>
+double computeDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                  StepPattern pattern, WindowType window, int window_size, int p,
+                  DTWWorkspace& workspace);
+
+template<typename T>
+double computeIndependentDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                             int window_size, int p, int diag_weight);
+
+template<typename T>
+double computeIndependentDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                             int window_size, int p, int diag_weight,
+                             DTWWorkspace& workspace);
+
+template<typename T>
+double computeNormalizedDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                            int window_size, int p);
+
+template<typename T>
+double computeNormalizedDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                            int window_size, int p,
+                            DTWWorkspace& workspace);
+
+template<typename T>
+double backtrackDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                    int window_size, int p, int diag_weight,
+                    std::vector<int>& idx, std::vector<int>& idy);
+
+template<typename T>
+double backtrackDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                    int window_size, int p, int diag_weight,
+                    std::vector<int>& idx, std::vector<int>& idy,
+                    DTWWorkspace& workspace);
+
+template<typename T>
+double backtrackNormalizedDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                              int window_size, int p,
+                              std::vector<int>& idx, std::vector<int>& idy);
+
+template<typename T>
+double backtrackNormalizedDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                              int window_size, int p,
+                              std::vector<int>& idx, std::vector<int>& idy,
+                              DTWWorkspace& workspace);
+
+template<typename T>
+double computePrunedDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                        int window_size, int p, int diag_weight, double upper_bound);
+
+template<typename T>
+double computePrunedDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                        int window_size, int p, int diag_weight, double upper_bound,
+                        DTWWorkspace& workspace);
+
+/** DTW distance computed along anti-diagonals (wavefront)
+
+    Same semantics and results as computeDTW, but the cells of each anti-diagonal are independent,
+    so for univariate series with p = 1 or p = 2 they are computed with SIMD instructions (SSE2,
+    AVX2 or AVX-512, detected at runtime). Other cases use a scalar version of the same traversal.
+    computeDTW dispatches to this automatically for long univariate series.
+
+    Parameter level forces an instruction set, it must be supported by the CPU
+ */
+template<typename T>
+double computeWavefrontDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                           int window_size, int p, int diag_weight);
+
+template<typename T>
+double computeWavefrontDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                           int window_size, int p, int diag_weight,
+                           DTWWorkspace& workspace);
+
+template<typename T>
+double computeWavefrontDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                           int window_size, int p, int diag_weight, SimdLevel level);
+
+template<typename T>
+double computeWavefrontDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                           int window_size, int p, int diag_weight, SimdLevel level,
+                           DTWWorkspace& workspace);
+
+/** DTW distances between one query and a batch of candidates (inter-pair SIMD)
+
+    distances[k] is the result of computePrunedDTW(candidates[k], query, ...) with bound
+    upper_bounds[k] (infinity for all of them if upper_bounds is null), bit for bit. For
+    univariate series with p = 1 or p = 2, groups of batchedDTWLanes() candidates are computed
+    together, one candidate per SIMD lane, so every instruction is fully used whatever the
+    length of the series. This is faster than computeWavefrontDTW for short series and narrow
+    windows. Each lane is abandoned once its whole row is above its bound, and a group stops
+    when all of its lanes are.
+
+    Candidates must all have the same length (not necessarily the one of the query). Other
+    cases are computed one candidate at a time.
+
+    Parameter count is the number of candidates
+    Parameter upper_bounds has one bound per candidate, in the units of the distances
+    Parameter distances receives count values
+ */
+template<typename T>
+void computeBatchedDTW(const TimeSeriesView<T>* candidates, int count,
+                       const TimeSeriesView<T>& query,
+                       int window_size, int p, int diag_weight,
+                       const double* upper_bounds, double* distances);
+
+template<typename T>
+void computeBatchedDTW(const TimeSeriesView<T>* candidates, int count,
+                       const TimeSeriesView<T>& query,
+                       int window_size, int p, int diag_weight,
+                       const double* upper_bounds, double* distances,
+                       DTWWorkspace& workspace);
+
+/** Candidates computed together by computeBatchedDTW on this CPU: 2 (SSE2), 4 (AVX2) or
+    8 (AVX-512) doubles per vector, 1 without SIMD
+ */
+int batchedDTWLanes();
+
 }
 
 #endif // _DTW_H
@@ -0,0 +1,88 @@
+#ifndef _FASTDTW_H
+#define _FASTDTW_H
+
+#include <vector>
+#include "ts.h"
+#include "workspace.h"
+
+namespace TSdist {
+
+/*
+ * Functions that need temporary memory have an overload that takes a DTWWorkspace (see
+ * workspace.h) as last parameter, so that repeated calls do not allocate.
+ */
+
+/** Approximate DTW distance with backtracking: FastDTW (Salvador and Chan, 2007)
+
+    Both series are halved (averaging pairs of observations) until one of them has at most
+    radius + 2 observations, where DTW is solved exactly. The path found at each resolution is
+    projected to the next finer one and widened by 'radius' cells on every side, and DTW is
+    solved again only inside those cells, so time and memory grow linearly with the lengths
+    and the radius.
+
+    The step pattern is the one of backtrackDTW without window, and the path is returned the
+    same way, so the result is an upper bound of the exact distance. If one of the series has at
+    most radius + 2 observations, the result is exactly that of backtrackDTW.
+
+    Parameter radius is the number of extra cells around each projected path, >= 0
+    Parameter p is for the Lp norm
+    Parameter diag_weight is the weight of the diagonal in the step pattern
+    The indices of the correspondence between x and y are returned in idx and idy
+ */
+double fastDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+               int radius, int p, int diag_weight,
+               std::vector<int>& idx, std::vector<int>& idy);
+
+double fastDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+               int radius, int p, int diag_weight,
+               std::vector<int>& idx, std::vector<int>& idy,
+               DTWWorkspace& workspace);
+
+/** Same with a bound on the approximation error
+
+    The result is compared with a lower bound of the exact distance (LB_Kim for univariate
+    series, the first and last observations otherwise). While it is larger than
+    (1 + tolerance) times the bound, the radius is doubled and the search repeated, up to the
+    exact backtrackDTW. Since the lower bound can be loose, a small tolerance may end up costing
+    as much as the exact computation.
+
+    Parameter tolerance is the relative error allowed with respect to the lower bound, >= 0
+ */
+double fastDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+               int radius, int p, int diag_weight, double tolerance,
+               std::vector<int>& idx, std::vector<int>& idy);
+
+double fastDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+               int radius, int p, int diag_weight, double tolerance,
+               std::vector<int>& idx, std::vector<int>& idy,
+               DTWWorkspace& workspace);
+
+// ================================================================================================
+/* Versions for series in contiguous memory (see TimeSeriesView in ts.h) */
+// ================================================================================================
+
+template<typename T>
+double fastDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+               int radius, int p, int diag_weight,
+               std::vector<int>& idx, std::vector<int>& idy);
+
+template<typename T>
+double fastDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+               int radius, int p, int diag_weight,
+               std::vector<int>& idx, std::vector<int>& idy,
+               DTWWorkspace& workspace);
+
+template<typename T>
+double fastDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+               int radius, int p, int diag_weight, double tolerance,
+               std::vector<int>& idx, std::vector<int>& idy);
+
+template<typename T>
+double fastDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+               int radius, int p, int diag_weight, double tolerance,
+               std::vector<int>& idx, std::vector<int>& idy,
+               DTWWorkspace& workspace);
+
+}
+
+#endif // _FASTDTW_H
@@ -0,0 +1,127 @@
+#ifndef _INDEX_H
+#define _INDEX_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "ts.h"
+#include "lb.h"
+#include "mmap.h"
+#include "workspace.h"
+
+namespace TSdist {
+
+/** Envelopes and summaries of every series in a time-series database
+
+    For a given window size, the index stores for each reference series its lower and upper
+    envelopes (see computeEnvelop), its PAA (mean of each of 'num_segments' segments) and its
+    summary for LB_Kim (see summarizeSeries). Lower bounds can then be computed from the index
+    alone, without the raw series.
+
+    Everything is stored in a single contiguous block, one fixed-size record per series, which
+    is written as is by save() and mapped back by load() without any parsing, so loading takes
+    constant time and the pages are shared between processes. The binary format is that of the
+    machine that wrote the file.
+
+    All series must be univariate and have the same length. Only the memory of a loaded index
+    is backed by the file, which must not be modified while the index exists.
+ */
+class DTWIndex
+{
+public:
+
+    DTWIndex(const std::vector<TimeSeriesView<double>>& tsdb, int window_size, int num_segments);
+
+    /*
+     * Same for any TSDB that supports iterators that reference TimeSeriesBase derivatives, series
+     * without contiguous storage are copied one at a time.
+     */
+    template<typename TSDB>
+    DTWIndex(const TSDB& tsdb, int window_size, int num_segments) :
+        DTWIndex(window_size, num_segments)
+    {
+        DTWWorkspace workspace;
+        std::vector<double> buffer;
+
+        for (const TimeSeriesBase& REF : tsdb)
+        {
+            if (isContiguous(REF)) {
+                append(viewOf(REF), workspace);
+                continue;
+            }
+
+            buffer.resize(REF.length());
+            for (int i = 0; i < REF.length(); i++) buffer[i] = REF[i][0];
+
+            append(TimeSeriesView<double>(buffer.data(), REF.length(), REF.numVars()), workspace);
+        }
+    }
+
+    // Maps an index written by save()
+    static DTWIndex load(const std::string& path);
+
+    void save(const std::string& path) const;
+
+    int size() const { return _size; }
+    int length() const { return _length; }
+    int windowSize() const { return _window_size; }
+    int numSegments() const { return _num_segments; }
+
+    // Data of the k-th series, arrays of length() or numSegments() values
+    const double* lowerEnvelop(int k) const { return record(k); }
+    const double* upperEnvelop(int k) const { return record(k) + _length; }
+    const double* paa(int k) const { return record(k) + 2 * _length; }
+
+    SeriesSummary summary(int k) const;
+
+    /** LB_Keogh between 'query' and the k-th series, using the envelope of the latter
+
+        Parameter p is for the Lp norm
+     */
+    double lbKeogh(int k, const TimeSeriesView<double>& query, int p) const;
+
+    /** LB_Kim between the k-th series and a query summarized with summarizeSeries */
+    double lbKim(int k, const SeriesSummary& query, int p) const;
+
+    /** Segment bounds of a query envelope for lbPAA
+
+        The envelope must have been computed with the same window size as the index. The outputs
+        hold numSegments() values, the minimum of 'lower_envelop' and the maximum of
+        'upper_envelop' over each segment.
+     */
+    void segmentEnvelop(const double* lower_envelop, const double* upper_envelop,
+                        double* lower_segments, double* upper_segments) const;
+
+    /** LB_PAA between the k-th series and a query, given the segment bounds of its envelope
+
+        Lower bound of LB_Keogh between the series and the query envelope that only uses the PAA
+        of the series (each segment's deviation from the envelope is at least that of its mean).
+
+        Parameter p is for the Lp norm
+     */
+    double lbPAA(int k, const double* lower_segments, const double* upper_segments, int p) const;
+
+private:
+    DTWIndex(int window_size, int num_segments);
+
+    void append(const TimeSeriesView<double>& series, DTWWorkspace& workspace);
+
+    const double* record(int k) const { return _records + (std::size_t) k * _record_size; }
+
+    int _size;
+    int _length;
+    int _window_size;
+    int _num_segments;
+
+    // doubles per series: lower envelope, upper envelope, PAA, first, last, min, max, padding
+    std::size_t _record_size;
+
+    // either _storage (built index) or _file (loaded one)
+    const double* _records;
+    std::vector<double> _storage;
+    MappedFile _file;
+};
+
+}
+
+#endif // _INDEX_H
@@ -1,17 +1,25 @@
 #ifndef _LB_H
 #define _LB_H
 
+#include <vector>
 #include "ts.h"
+#include "workspace.h"
 
 namespace TSdist {
 
+/*
+ * Functions that need temporary memory have an overload that takes a DTWWorkspace (see
+ * workspace.h) as last parameter, so that repeated calls do not allocate.
+ */
+
 /** Compute warping envelop based on a Sakoe-Chiba window
 
-    (c) Daniel Lemire, 2008
-    Taken from https://github.com/lemire/lbimproved/blob/master/dtw.h
+    Running minima and maxima with the van Herk/Gil-Werman algorithm: a constant number of
+    comparisons per value whatever the window size, and no data-dependent branches (this used to
+    be Lemire's streaming algorithm from https://github.com/lemire/lbimproved).
 
-    All series must have the same length.
-    Only univariate series supported.
+    All series must have the same length and number of variables. Multivariate series get one
+    envelope per variable.
 
     Parameter 'window_size' must be greater than zero.
     The objects 'lower_envelop' and 'upper_envelop' are updated with the envelops corresponding to
@@ -20,10 +28,13 @@ namespace TSdist {
 void computeEnvelop(const TimeSeriesBase& x, int window_size,
                     TimeSeriesBase& lower_envelop, TimeSeriesBase& upper_envelop);
 
+void computeEnvelop(const TimeSeriesBase& x, int window_size,
+                    TimeSeriesBase& lower_envelop, TimeSeriesBase& upper_envelop,
+                    DTWWorkspace& workspace);
+
 /** DTW lower bound: LB_Keogh
 
-    All series must have the same length.
-    Only univariate series supported.
+    All series must have the same length and number of variables.
     This version assumes that envelops are already available. See function computeEnvelop above.
 
     Parameter x is the reference
@@ -36,8 +47,7 @@ double lbKeogh(const TimeSeriesBase& x, const TimeSeriesBase& y, int p,
 
 /** DTW lower bound: LB_Improved
 
-    All series must have the same length.
-    Only univariate series supported.
+    All series must have the same length and number of variables.
     This version computes both sets of required envelops and saves them in lower/uper_envelop.
 
     Parameter x is the reference
@@ -51,6 +61,198 @@ double lbImproved(const TimeSeriesBase& x, const TimeSeriesBase& y,
                   TimeSeriesBase& lower_envelop, TimeSeriesBase& upper_envelop,
                   TimeSeriesBase& H);
 
+double lbImproved(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                  int window_size, int p,
+                  TimeSeriesBase& lower_envelop, TimeSeriesBase& upper_envelop,
+                  TimeSeriesBase& H,
+                  DTWWorkspace& workspace);
+
+/** Multivariate series
+
+    LB_Keogh, LB_Improved and LB_Enhanced add the terms of every variable, each against its own
+    envelope. That bounds both the dependent DTW of computeDTW, where each cell costs the sum over
+    all variables, and the independent DTW of computeIndependentDTW, where every variable has its
+    own warping path (Shokoohi-Yekta et al., 2017). LB_Kim remains univariate.
+ */
+
+/** Cheap summary of a univariate series, see lbKim below */
+struct SeriesSummary
+{
+    double first;
+    double last;
+    double min;
+    double max;
+    int length;
+};
+
+SeriesSummary summarizeSeries(const TimeSeriesBase& x);
+
+/** DTW lower bound: LB_Kim
+
+    Uses only the summaries of both series (see summarizeSeries), so it takes constant time. The
+    first and last observations are always matched with each other, and the largest (smallest)
+    value of one series must be matched with a value not larger (smaller) than the largest
+    (smallest) value of the other.
+
+    Series can have different lengths.
+
+    Parameter p is for the Lp norm
+ */
+double lbKim(const SeriesSummary& x, const SeriesSummary& y, int p);
+
+/** DTW lower bound: LB_KimFL
+
+    Only the first and last observations, which are always matched with each other. Weaker than
+    LB_Kim, but it needs no pass over the series.
+
+    Parameter p is for the Lp norm
+ */
+double lbKimFL(const SeriesSummary& x, const SeriesSummary& y, int p);
+
+/** DTW lower bound: LB_Enhanced (Tan et al., 2019)
+
+    All series must have the same length and number of variables.
+    This version assumes that envelops are already available. See function computeEnvelop above.
+
+    The first and last 'num_bands' observations are bounded with the cheapest cell of each
+    L-shaped band of the window that every warping path must cross, the rest like in LB_Keogh.
+
+    Parameter x is the reference
+    Parameter y is the query
+    Parameter window_size is for the window constraint, must match the envelops
+    Parameter p is for the Lp norm
+    Parameter num_bands is the number of bands on each side, at most half the length is used
+    Envelops must correspond to 'y'
+ */
+double lbEnhanced(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                  int window_size, int p, int num_bands,
+                  const TimeSeriesBase& lower_envelop, const TimeSeriesBase& upper_envelop);
+
+// ================================================================================================
+/* Lower bound cascades */
+// ================================================================================================
+
+/** Lower bounds that can be used to filter candidates in the searches (see 1nn.h)
+
+    Kim and KimFL are computed from the summaries of both series (Kim needs one pass over the
+    candidate for its minimum and maximum), Keogh uses the envelope of the query and
+    ReverseKeogh the envelope of the candidate (computed on the fly, so it costs about as much as
+    Improved), Improved and Enhanced are the bounds above.
+ */
+enum class LowerBound { Kim, KimFL, Keogh, ReverseKeogh, Improved, Enhanced };
+
+static const int NUM_LOWER_BOUNDS = 6;
+
+/** Lower bounds applied in order to each candidate, see the searches in 1nn.h
+
+    Every stage is abandoned as soon as it exceeds the current threshold, and the candidate is
+    discarded. Keogh and ReverseKeogh in a row amount to the maximum of both directions.
+ */
+struct LBCascade
+{
+    // KimFL, Keogh, Improved
+    LBCascade();
+
+    LBCascade(std::vector<LowerBound> stages, int enhanced_bands = 5);
+
+    std::vector<LowerBound> stages;
+
+    // bands on each side for LowerBound::Enhanced
+    int enhanced_bands;
+};
+
+// ================================================================================================
+/* Versions for series in contiguous memory (see TimeSeriesView in ts.h) */
+// ================================================================================================
+
+/*
+ * These have the same semantics as the functions above, which dispatch to them when all series
+ * expose contiguous storage (outputs must also be packed). Output envelops and H are raw
+ * arrays of length() * numVars() values, packed like the input series. Instantiated for
+ * T = double and T = float, differences are taken in double precision like in the DTW
+ * functions.
+ */
+
+template<typename T>
+void computeEnvelop(const TimeSeriesView<T>& x, int window_size,
+                    T* lower_envelop, T* upper_envelop);
+
+template<typename T>
+void computeEnvelop(const TimeSeriesView<T>& x, int window_size,
+                    T* lower_envelop, T* upper_envelop,
+                    DTWWorkspace& workspace);
+
+/** Envelops of every series of a database, computed by several threads
+
+    Series may have different lengths and numbers of variables. Their envelops are packed one
+    after the other in the same order: those of tsdb[k] start at the sum of
+    length() * numVars() over the series before it. Both arrays must be preallocated with room
+    for all of them, nothing is allocated per series.
+
+    Parameter num_threads is the number of threads to use, 0 means one per hardware thread
+ */
+template<typename T>
+void computeEnvelops(const std::vector<TimeSeriesView<T>>& tsdb, int window_size,
+                     T* lower_envelops, T* upper_envelops, int num_threads);
+
+template<typename T>
+double lbKeogh(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y, int p,
+               const TimeSeriesView<T>& lower_envelop, const TimeSeriesView<T>& upper_envelop);
+
+template<typename T>
+double lbImproved(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                  int window_size, int p,
+                  T* lower_envelop, T* upper_envelop, T* H);
+
+template<typename T>
+double lbImproved(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                  int window_size, int p,
+                  T* lower_envelop, T* upper_envelop, T* H,
+                  DTWWorkspace& workspace);
+
+template<typename T>
+SeriesSummary summarizeSeries(const TimeSeriesView<T>& x);
+
+template<typename T>
+double lbEnhanced(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                  int window_size, int p, int num_bands,
+                  const TimeSeriesView<T>& lower_envelop, const TimeSeriesView<T>& upper_envelop);
+
+// ================================================================================================
+/* PAA, shared by DTWIndex (index.h) and PAATree (paatree.h) */
+// ================================================================================================
+namespace detail {
+
+// First observation of PAA segment 'segment' of a series of 'length' observations
+inline int segmentStart(int segment, int length, int num_segments)
+{
+    return (int) ((long long) segment * length / num_segments);
+}
+
+// Mean of each of the 'num_segments' segments of a univariate series
+void computePAA(const TimeSeriesView<double>& x, int num_segments, double* paa);
+
+/*
+ * Segments of an envelope of 'length' observations: minimum of the lower one and maximum of the
+ * upper one over each segment.
+ */
+void segmentEnvelop(const double* lower_envelop, const double* upper_envelop,
+                    int length, int num_segments,
+                    double* lower_segments, double* upper_segments);
+
+/*
+ * LB_PAA, as a p-th power, of every series whose segment means lie in [lower_means,
+ * upper_means] (a bounding box, or a single series when both are its PAA) against the segments
+ * of a query envelope. The distance of a segment's values to the envelope is at least that of
+ * their mean (convexity), and the envelope of a segment contains the query envelope, so this
+ * bounds LB_Keogh.
+ */
+double lbPAA(const double* lower_means, const double* upper_means,
+             const double* lower_segments, const double* upper_segments,
+             int length, int num_segments, int p);
+
+}
+
 }
 
 #endif // _LB_H
@@ -0,0 +1,47 @@
+#ifndef _MMAP_H
+#define _MMAP_H
+
+#include <cstddef>
+#include <string>
+
+namespace TSdist {
+
+/** Memory mapping of a whole file (POSIX mmap)
+
+    Existing files are mapped read-only. The mapping is released when the object is destroyed.
+    Objects can be moved but not copied.
+ */
+class MappedFile
+{
+public:
+
+    MappedFile();
+    explicit MappedFile(const std::string& path);
+
+    // Creates (or truncates) a file of 'size' bytes, zero filled, and maps it for writing
+    MappedFile(const std::string& path, std::size_t size);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other);
+    MappedFile& operator=(MappedFile&& other);
+
+    ~MappedFile();
+
+    const unsigned char* data() const { return _data; }
+
+    // Only writable for files created by the constructor above
+    unsigned char* data() { return _data; }
+    std::size_t size() const { return _size; }
+
+private:
+    void release();
+
+    unsigned char* _data;
+    std::size_t _size;
+};
+
+}
+
+#endif // _MMAP_H
@@ -0,0 +1,109 @@
+#ifndef _PAATREE_H
+#define _PAATREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ts.h"
+#include "mmap.h"
+#include "workspace.h"
+
+namespace TSdist {
+
+// Node of a PAATree as stored in its file, see paatree.cpp
+struct PAATreeNode;
+
+/** Tree of PAA bounding boxes over a time-series database, for exact 1-NN search on disk
+
+    Every series is reduced to its PAA (mean of each of 'num_segments' segments). The tree is
+    bulk loaded top-down: a node is split at the median of its segment with the widest range of
+    means until it holds at most 'leaf_size' series. Every node keeps the range of the means of
+    its series for each segment, and the series of a leaf are stored together (PAA and values),
+    so visiting a leaf reads one contiguous part of the file.
+
+    The search is best-first. Nodes are visited by increasing LB_PAA of their bounding box
+    against the segments of the query envelope, which lower-bounds LB_PAA of every series
+    below them, itself a lower bound of LB_Keogh and thus of DTW. The search stops when the
+    next node cannot hold anything closer than the best-so-far. In a leaf, each series goes
+    through LB_PAA, then the lower bounds of nearestNeighborDTW (LB_Keogh and LB_Improved), and
+    DTW is only computed for the survivors. The result is exact: the same series as
+    nearestNeighborDTW over the whole database.
+
+    The window size is given at search time, it is not part of the index. The index lives in a
+    single file that is written by bulkLoad() and mapped by load() without any parsing (like
+    DTWIndex in index.h), so the pages of the leaves are only read when visited. The binary
+    format is that of the machine that wrote the file, which must not be modified while the
+    index exists.
+
+    All series must be univariate and have the same length.
+ */
+class PAATree
+{
+public:
+
+    /** Builds the index of 'tsdb' into the file at 'path' and maps it
+
+        The series are copied into the file leaf after leaf, so the database can be released
+        afterwards. Only the PAA of all series is held in memory while building.
+
+        Parameter num_segments is the number of PAA segments, at most the series length
+        Parameter leaf_size is the largest number of series in a leaf
+     */
+    static PAATree bulkLoad(const std::vector<TimeSeriesView<double>>& tsdb, int num_segments,
+                            int leaf_size, const std::string& path);
+
+    // Maps an index written by bulkLoad()
+    static PAATree load(const std::string& path);
+
+    int size() const { return _size; }
+    int length() const { return _length; }
+    int numSegments() const { return _num_segments; }
+    int numNodes() const { return _num_nodes; }
+
+    /** Position in the original database of the nearest neighbor of 'query' in DTW space
+
+        Same result as nearestNeighborDTW on the series the index was built from (ties go to the
+        first one), -1 if the index is empty.
+     */
+    int nearestNeighborDTW(const TimeSeriesView<double>& query,
+                           int window_size, int p, int diag_weight) const;
+
+    int nearestNeighborDTW(const TimeSeriesView<double>& query,
+                           int window_size, int p, int diag_weight,
+                           DTWWorkspace& workspace) const;
+
+private:
+
+    // Maps a file after checking its header
+    explicit PAATree(MappedFile file);
+
+    // Stored series, PAA then values
+    const double* record(std::int64_t position) const {
+        return _records + (std::size_t) position * _record_size;
+    }
+
+    // Bounding box of a node: numSegments() minima then numSegments() maxima
+    const double* bounds(int node) const {
+        return _bounds + (std::size_t) node * 2 * _num_segments;
+    }
+
+    int _size = 0;
+    int _length = 0;
+    int _num_segments = 0;
+    int _num_nodes = 0;
+
+    // doubles per stored series: PAA, values, padding
+    std::size_t _record_size = 0;
+
+    const PAATreeNode* _nodes = nullptr;
+    const double* _bounds = nullptr;
+    const std::int64_t* _ids = nullptr;
+    const double* _records = nullptr;
+
+    MappedFile _file;
+};
+
+}
+
+#endif // _PAATREE_H
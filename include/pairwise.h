@@ -0,0 +1,241 @@
+#ifndef _PAIRWISE_H
+#define _PAIRWISE_H
+
+#include <algorithm> // std::min, std::max
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+#include "dtw.h"
+#include "lb.h"
+#include "1nn.h"
+#include "batch.h"
+#include "mmap.h"
+#include "parallel.h"
+#include "workspace.h"
+
+namespace TSdist {
+
+/*
+ * Matrices are written row-major: the distance between X[i] and Y[j] (or X[j]) goes to
+ * result[i * Y.size() + j]. The versions that take a path write the same values to a file of
+ * raw doubles (no header, native binary format), created or truncated and written through a
+ * memory mapping, so matrices larger than RAM can be computed. MappedFile (see mmap.h) maps it
+ * back.
+ *
+ * With a threshold, distances larger than it are not computed and are reported as infinity.
+ */
+
+namespace detail {
+
+/*
+ * Distances between the series of X (rows) and those of Y (columns). If 'symmetric' (X and Y
+ * are the same set), only pairs i < j are computed and mirrored when the distance is
+ * symmetric, and the diagonal is 0.
+ *
+ * The matrix is split into square tiles whose series fit together in L2 and the threads take
+ * tiles from a shared counter.
+ */
+template<typename T>
+void pairwiseKernel(const std::vector<TimeSeriesView<T>>& X,
+                    const std::vector<TimeSeriesView<T>>& Y, bool symmetric,
+                    int window_size, int p, int diag_weight, double threshold,
+                    const LBCascade& cascade, double* result, int num_threads)
+{
+    const double INF = std::numeric_limits<double>::infinity();
+
+    int rows = X.size();
+    int cols = Y.size();
+
+    if (rows == 0 || cols == 0) return;
+
+    // Lower bounds need envelopes, so equal lengths and a window
+    int length = X[0].length();
+    bool equal_lengths = true;
+
+    for (const TimeSeriesView<T>& series : X) equal_lengths &= series.length() == length;
+    for (const TimeSeriesView<T>& series : Y) equal_lengths &= series.length() == length;
+
+    bool filter = threshold < INF && equal_lengths && window_size >= 1;
+
+    // DTW between two different series of equal length is symmetric, with any window
+    auto mirrored = [&](int i, int j) {
+        return window_size < 1 || X[i].length() == X[j].length();
+    };
+
+    // Series per side of a tile
+    int max_length = 1;
+    for (const TimeSeriesView<T>& series : X) max_length = std::max(max_length, series.length());
+    for (const TimeSeriesView<T>& series : Y) max_length = std::max(max_length, series.length());
+
+    int tile = std::max<std::size_t>(1, BATCH_TILE_BYTES / (2 * max_length * sizeof(T)));
+
+    // Tiles to compute, only those on or above the diagonal if symmetric
+    std::vector<std::pair<int, int>> tiles;
+
+    for (int r = 0; r < rows; r += tile)
+        for (int c = symmetric ? r : 0; c < cols; c += tile)
+            tiles.push_back(std::make_pair(r, c));
+
+    if (num_threads <= 0) num_threads = defaultNumThreads();
+    num_threads = std::max(1, std::min<int>(num_threads, tiles.size()));
+
+    std::vector<DTWWorkspace> workspaces(num_threads);
+    WorkCounter counter(tiles.size(), 1);
+
+    runThreads(num_threads, [&](int thread) {
+        DTWWorkspace& workspace = workspaces[thread];
+        int begin, end;
+
+        while (counter.next(begin, end))
+        {
+            int r_begin = tiles[begin].first, r_end = std::min(r_begin + tile, rows);
+            int c_begin = tiles[begin].second, c_end = std::min(c_begin + tile, cols);
+
+            for (int i = r_begin; i < r_end; i++)
+            {
+                double* row = result + (std::size_t) i * cols;
+
+                if (filter) {
+                    QueryFilter<T> query(X[i], window_size, p, diag_weight, cascade, workspace);
+
+                    for (int j = symmetric ? std::max(c_begin, i + 1) : c_begin; j < c_end; j++)
+                        row[j] = query.evaluate(Y[j], threshold);
+
+                } else {
+                    for (int j = symmetric ? std::max(c_begin, i + 1) : c_begin; j < c_end; j++)
+                    {
+                        row[j] = computePrunedDTW(X[i], Y[j], window_size, p, diag_weight,
+                                                  threshold, workspace);
+                    }
+                }
+
+                if (!symmetric) continue;
+
+                // diagonal and lower triangle of this tile
+                if (i >= c_begin && i < c_end) row[i] = 0;
+
+                for (int j = std::max(c_begin, i + 1); j < c_end; j++)
+                {
+                    result[(std::size_t) j * cols + i] = mirrored(i, j) ? row[j] :
+                        computePrunedDTW(X[j], X[i], window_size, p, diag_weight, threshold,
+                                         workspace);
+                }
+            }
+        }
+    });
+}
+
+// Same writing to a new file of raw doubles
+template<typename T>
+void pairwiseKernel(const std::vector<TimeSeriesView<T>>& X,
+                    const std::vector<TimeSeriesView<T>>& Y, bool symmetric,
+                    int window_size, int p, int diag_weight, double threshold,
+                    const LBCascade& cascade, const std::string& path, int num_threads)
+{
+    MappedFile file(path, X.size() * Y.size() * sizeof(double));
+
+    pairwiseKernel(X, Y, symmetric, window_size, p, diag_weight, threshold, cascade,
+                   reinterpret_cast<double*>(file.data()), num_threads);
+}
+
+}
+
+/** DTW distance between every pair of series of X
+
+    Fills the X.size() x X.size() matrix 'result'. Only the upper triangle is computed when the
+    distance is symmetric (always for series of the same length), and the work is split into
+    tiles of series that fit in L2.
+
+    Parameter num_threads is the number of threads to use, 0 means one per hardware thread
+ */
+template<typename T>
+void pairwiseDTW(const std::vector<TimeSeriesView<T>>& X,
+                 int window_size, int p, int diag_weight,
+                 double* result, int num_threads)
+{
+    detail::pairwiseKernel(X, X, true, window_size, p, diag_weight,
+                           std::numeric_limits<double>::infinity(), LBCascade(), result,
+                           num_threads);
+}
+
+template<typename T>
+void pairwiseDTW(const std::vector<TimeSeriesView<T>>& X,
+                 int window_size, int p, int diag_weight,
+                 const std::string& path, int num_threads)
+{
+    detail::pairwiseKernel(X, X, true, window_size, p, diag_weight,
+                           std::numeric_limits<double>::infinity(), LBCascade(), path,
+                           num_threads);
+}
+
+/** Same reporting only the distances not larger than 'threshold'
+
+    The others are reported as infinity. When all series have the same length and there is a
+    window, pairs go through the lower bounds of 'cascade' (see LBCascade in lb.h) before an
+    early abandoning DTW; otherwise only DTW is abandoned.
+ */
+template<typename T>
+void pairwiseDTW(const std::vector<TimeSeriesView<T>>& X,
+                 int window_size, int p, int diag_weight, double threshold,
+                 const LBCascade& cascade, double* result, int num_threads)
+{
+    detail::pairwiseKernel(X, X, true, window_size, p, diag_weight, threshold, cascade, result,
+                           num_threads);
+}
+
+template<typename T>
+void pairwiseDTW(const std::vector<TimeSeriesView<T>>& X,
+                 int window_size, int p, int diag_weight, double threshold,
+                 const LBCascade& cascade, const std::string& path, int num_threads)
+{
+    detail::pairwiseKernel(X, X, true, window_size, p, diag_weight, threshold, cascade, path,
+                           num_threads);
+}
+
+/** DTW distance between every series of X and every series of Y
+
+    Fills the X.size() x Y.size() matrix 'result', see pairwiseDTW.
+ */
+template<typename T>
+void crossDTW(const std::vector<TimeSeriesView<T>>& X, const std::vector<TimeSeriesView<T>>& Y,
+              int window_size, int p, int diag_weight,
+              double* result, int num_threads)
+{
+    detail::pairwiseKernel(X, Y, false, window_size, p, diag_weight,
+                           std::numeric_limits<double>::infinity(), LBCascade(), result,
+                           num_threads);
+}
+
+template<typename T>
+void crossDTW(const std::vector<TimeSeriesView<T>>& X, const std::vector<TimeSeriesView<T>>& Y,
+              int window_size, int p, int diag_weight,
+              const std::string& path, int num_threads)
+{
+    detail::pairwiseKernel(X, Y, false, window_size, p, diag_weight,
+                           std::numeric_limits<double>::infinity(), LBCascade(), path,
+                           num_threads);
+}
+
+template<typename T>
+void crossDTW(const std::vector<TimeSeriesView<T>>& X, const std::vector<TimeSeriesView<T>>& Y,
+              int window_size, int p, int diag_weight, double threshold,
+              const LBCascade& cascade, double* result, int num_threads)
+{
+    detail::pairwiseKernel(X, Y, false, window_size, p, diag_weight, threshold, cascade, result,
+                           num_threads);
+}
+
+template<typename T>
+void crossDTW(const std::vector<TimeSeriesView<T>>& X, const std::vector<TimeSeriesView<T>>& Y,
+              int window_size, int p, int diag_weight, double threshold,
+              const LBCascade& cascade, const std::string& path, int num_threads)
+{
+    detail::pairwiseKernel(X, Y, false, window_size, p, diag_weight, threshold, cascade, path,
+                           num_threads);
+}
+
+}
+
+#endif // _PAIRWISE_H
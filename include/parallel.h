@@ -0,0 +1,113 @@
+#ifndef _PARALLEL_H
+#define _PARALLEL_H
+
+#include <algorithm> // std::min
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace TSdist {
+
+/** Number of threads used when 0 is requested, one per hardware thread */
+inline int defaultNumThreads()
+{
+    int num_threads = std::thread::hardware_concurrency();
+    return num_threads > 0 ? num_threads : 1;
+}
+
+/** Runs task(thread_index) on 'num_threads' threads, the calling thread included
+
+    Returns when all of them have finished. If any task throws, the first exception is rethrown
+    here.
+ */
+template<typename Task>
+void runThreads(int num_threads, Task task)
+{
+    if (num_threads <= 1) {
+        task(0);
+        return;
+    }
+
+    std::vector<std::exception_ptr> errors(num_threads);
+    std::vector<std::thread> threads;
+
+    auto guarded = [&](int index) {
+        try {
+            task(index);
+        } catch (...) {
+            errors[index] = std::current_exception();
+        }
+    };
+
+    for (int i = 1; i < num_threads; i++)
+        threads.emplace_back(guarded, i);
+
+    guarded(0);
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    for (std::exception_ptr& error : errors)
+        if (error) std::rethrow_exception(error);
+}
+
+/** Hands out consecutive chunks of [0, size) to threads that ask for work */
+class WorkCounter
+{
+public:
+
+    WorkCounter(int size, int chunk_size) :
+        _next(0) ,
+        _size(size) ,
+        _chunk_size(chunk_size)
+    { }
+
+    // Gets the next chunk [begin, end), returns false when there is no work left
+    bool next(int& begin, int& end) {
+        begin = _next.fetch_add(_chunk_size, std::memory_order_relaxed);
+        if (begin >= _size) return false;
+
+        end = std::min(begin + _chunk_size, _size);
+        return true;
+    }
+
+private:
+    std::atomic<int> _next;
+    int _size;
+    int _chunk_size;
+};
+
+/** Minimum shared by several threads, e.g. a best-so-far distance used for pruning
+
+    Reads are relaxed: a slightly stale value is always a valid (looser) bound.
+ */
+class SharedMinimum
+{
+public:
+
+    explicit SharedMinimum(double value) :
+        _value(value)
+    { }
+
+    double load() const {
+        return _value.load(std::memory_order_relaxed);
+    }
+
+    // Lowers the minimum to 'value' if it is smaller
+    void update(double value) {
+        double current = _value.load(std::memory_order_relaxed);
+
+        while (value < current &&
+               !_value.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        { }
+    }
+
+private:
+    // on its own cache line, it is written by every thread
+    alignas(64) std::atomic<double> _value;
+};
+
+}
+
+#endif // _PARALLEL_H
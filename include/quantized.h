@@ -0,0 +1,335 @@
+#ifndef _QUANTIZED_H
+#define _QUANTIZED_H
+
+#include <algorithm> // std::min, std::max
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "ts.h"
+#include "dtw.h"
+#include "lb.h"
+#include "1nn.h"
+#include "stats.h"
+#include "workspace.h"
+
+namespace TSdist {
+
+/** Affine map between values and integer codes: value = offset + scale * code
+
+    Series quantized to int16_t or int8_t take 4 or 8 times less memory than with double (2 or 4
+    times less than with float). Each value is rounded to the nearest code, so it is within
+    maxError() of its decoded value. The lower bounds below take this error into account, so
+    they never exceed the DTW distance to the original series, nor to the decoded one.
+ */
+struct Quantization
+{
+    double scale;
+    double offset;
+
+    // Largest difference between a value and its decoded code
+    double maxError() const { return scale / 2; }
+};
+
+/** Quantization of the values in [min, max] to the whole range of Q (int16_t or int8_t) */
+template<typename Q>
+Quantization fitQuantization(double min, double max);
+
+/** Same for the range of all values in 'tsdb' */
+template<typename Q, typename T>
+Quantization fitQuantization(const std::vector<TimeSeriesView<T>>& tsdb);
+
+/** Codes of all values of x
+
+    Codes are stored time index after time index, so 'codes' must have room for
+    x.length() * x.numVars() values. Values outside the range of the quantization (see
+    fitQuantization) cannot be encoded.
+ */
+template<typename Q, typename T>
+void quantize(const TimeSeriesView<T>& x, const Quantization& quantization, Q* codes);
+
+/** Decoded values of all codes, in the same layout as quantize */
+template<typename Q, typename T>
+void dequantize(const TimeSeriesView<Q>& codes, const Quantization& quantization, T* values);
+
+/** Envelope (see computeEnvelop in lb.h) in code units, for lbKeoghQuantized
+
+    Lower values are rounded down and upper values up, so the envelope in code units contains
+    the original one. Values far outside the range of the quantization are clamped, which keeps
+    the bound valid.
+ */
+template<typename T>
+void quantizeEnvelop(const T* lower_envelop, const T* upper_envelop, int length,
+                     const Quantization& quantization, int* lower_codes, int* upper_codes);
+
+/** DTW lower bound: LB_Keogh on quantized series
+
+    Same as lbKeogh with x given by its codes and the envelope of y in code units (see
+    quantizeEnvelop), using only integer arithmetic per observation. The distance of each code
+    to the envelope is reduced by half a step (maxError), so the result is a lower bound of the
+    DTW distance between y and both the original series x and its decoded values.
+
+    Only univariate series supported.
+
+    Parameter x is the reference, quantized
+    Parameter p is for the Lp norm
+    Envelops must correspond to the query and have the same length as x
+ */
+template<typename Q>
+double lbKeoghQuantized(const TimeSeriesView<Q>& x, int p,
+                        const int* lower_codes, const int* upper_codes,
+                        const Quantization& quantization);
+
+namespace detail {
+
+// Observations of the quantized LB_Keogh between checks of the bound
+static const int QUANTIZED_LB_BLOCK = 64;
+
+/*
+ * Sum of (2 d - 1)^p over the observations, d being the distance in codes between x and the
+ * envelope (observations at distance 0 add nothing), i.e. the p-th power of the bound in units
+ * of half a step. Abandoned once it exceeds 'bound' (same units), which is only checked every
+ * QUANTIZED_LB_BLOCK observations so that the blocks vectorize.
+ */
+template<typename Q>
+double quantizedKeogh(const TimeSeriesView<Q>& x, int p, const int* lower, const int* upper,
+                      double bound)
+{
+    int n = x.length();
+    double lb = 0;
+
+    for (int begin = 0; begin < n; begin += QUANTIZED_LB_BLOCK)
+    {
+        int end = std::min(n, begin + QUANTIZED_LB_BLOCK);
+
+        if (p == 1) {
+            int sum = 0;
+
+            for (int i = begin; i < end; i++)
+            {
+                int code = x[i][0];
+                int d = std::max(std::max(code - upper[i], lower[i] - code), 0);
+                sum += std::max(2 * d - 1, 0);
+            }
+
+            lb += sum;
+
+        } else if (p == 2) {
+            double sum = 0;
+
+            for (int i = begin; i < end; i++)
+            {
+                int code = x[i][0];
+                int d = std::max(std::max(code - upper[i], lower[i] - code), 0);
+                double half = std::max(2 * d - 1, 0);
+                sum += half * half;
+            }
+
+            lb += sum;
+
+        } else {
+            for (int i = begin; i < end; i++)
+            {
+                int code = x[i][0];
+                int d = std::max(std::max(code - upper[i], lower[i] - code), 0);
+
+                if (d > 0) lb += std::pow(2.0 * d - 1, p);
+            }
+        }
+
+        if (lb > bound) break;
+    }
+
+    return lb;
+}
+
+/*
+ * Quantized LB_Keogh followed by DTW for one query against quantized candidates of the same
+ * length. DTW is computed either on the exact values of the candidate or on its decoded values,
+ * in the precision of the query. All scratch memory comes from the workspace.
+ */
+template<typename Q, typename T>
+class QuantizedFilter
+{
+public:
+
+    QuantizedFilter(const TimeSeriesView<T>& query, const Quantization& quantization,
+                    int window_size, int p, int diag_weight, DTWWorkspace& workspace) :
+        _query(query) ,
+        _quantization(quantization) ,
+        _window_size(window_size) ,
+        _p(p) ,
+        _diag_weight(diag_weight) ,
+        _workspace(workspace)
+    {
+        int n = query.length();
+
+        T* envelops = workspace.envelopsOf<T>(2 * n);
+        _lower = workspace.codes(2 * n);
+        _upper = _lower + n;
+
+        // Window size checked here
+        computeEnvelop(query, window_size, envelops, envelops + n, workspace);
+        quantizeEnvelop(envelops, envelops + n, n, quantization, _lower, _upper);
+    }
+
+    /*
+     * Returns the DTW distance between 'exact' (the series encoded as 'codes') and the query,
+     * or infinity if it is larger than 'threshold'.
+     */
+    double evaluate(const TimeSeriesView<Q>& codes, const TimeSeriesView<T>& exact,
+                    double threshold)
+    {
+        if (codes.length() != _query.length() || exact.length() != _query.length())
+            throw("Length mismatch between the query and the database.");
+
+        if (codes.numVars() != 1)
+            throw("Only univariate series are supported.");
+
+        // the bound in half steps, with the slack of the other searches
+        double bound = std::pow(threshold / _quantization.maxError(), _p);
+        bound += bound * THRESHOLD_SLACK;
+
+        TSDIST_STATS_ONLY(SearchStats* stats = _workspace.stats();)
+        TSDIST_STATS_ONLY(if (stats) stats->candidates++;)
+
+        {
+            TSDIST_STATS_ONLY(int stage = (int) LowerBound::Keogh;)
+            TSDIST_STATS_ONLY(StatsTimer timer(stats ? &stats->lb_seconds[stage] : nullptr);)
+
+            if (quantizedKeogh(codes, _p, _lower, _upper, bound) > bound) {
+                TSDIST_STATS_ONLY(if (stats) stats->pruned[stage]++;)
+                return std::numeric_limits<double>::infinity();
+            }
+        }
+
+        TSDIST_STATS_ONLY(StatsTimer timer(stats ? &stats->dtw_seconds : nullptr);)
+
+        // DTW distance, abandoned as soon as it exceeds the threshold
+        return computePrunedDTW(exact, _query, _window_size, _p, _diag_weight, threshold,
+                                _workspace);
+    }
+
+    // Same with the decoded values of the candidate
+    double evaluate(const TimeSeriesView<Q>& codes, double threshold)
+    {
+        if (codes.length() != _query.length())
+            throw("Length mismatch between the query and the database.");
+
+        T* values = _workspace.candidatesOf<T>(codes.length());
+        dequantize(codes, _quantization, values);
+
+        return evaluate(codes, TimeSeriesView<T>(values, codes.length()), threshold);
+    }
+
+private:
+    TimeSeriesView<T> _query;
+    Quantization _quantization;
+    int _window_size;
+    int _p;
+    int _diag_weight;
+    DTWWorkspace& _workspace;
+
+    // query envelope in code units
+    int *_lower, *_upper;
+};
+
+}
+
+/** 1-Nearest-Neighbor in DTW space over quantized series
+
+    'codes' holds the database quantized with 'quantization' (see quantize). Every candidate is
+    filtered with lbKeoghQuantized on its codes, and DTW is computed on the decoded values of
+    the ones that are left, in the precision of the query (float or double).
+
+    All series must be univariate and have the same length as 'query'.
+
+    The index of the nearest neighbor in 'codes' is returned, or -1 if 'codes' is empty.
+ */
+template<typename Q, typename T>
+int nearestNeighborDTW(const std::vector<TimeSeriesView<Q>>& codes,
+                       const Quantization& quantization, const TimeSeriesView<T>& query,
+                       int window_size, int p, int diag_weight,
+                       DTWWorkspace& workspace)
+{
+    detail::QuantizedFilter<Q, T> filter(query, quantization, window_size, p, diag_weight,
+                                         workspace);
+
+    double d = std::numeric_limits<double>::infinity();
+    int NN = -1;
+
+    for (int k = 0; k < (int) codes.size(); k++)
+    {
+        double dtw = filter.evaluate(codes[k], d);
+
+        if (dtw < d) {
+            NN = k;
+            d = dtw;
+        }
+    }
+
+    return NN;
+}
+
+template<typename Q, typename T>
+int nearestNeighborDTW(const std::vector<TimeSeriesView<Q>>& codes,
+                       const Quantization& quantization, const TimeSeriesView<T>& query,
+                       int window_size, int p, int diag_weight)
+{
+    DTWWorkspace workspace;
+    return nearestNeighborDTW(codes, quantization, query, window_size, p, diag_weight,
+                              workspace);
+}
+
+/** Same, with DTW computed on the exact values
+
+    exact[k] must be the series that was quantized into codes[k], e.g. the codes are kept in
+    memory and the exact values in a float32 TimeSeriesDatabase (see tsdb.h) that is only read
+    for the candidates left by the lower bound. The result is then exactly the one of
+    nearestNeighborDTW on 'exact'.
+ */
+template<typename Q, typename T>
+int nearestNeighborDTW(const std::vector<TimeSeriesView<Q>>& codes,
+                       const Quantization& quantization,
+                       const std::vector<TimeSeriesView<T>>& exact,
+                       const TimeSeriesView<T>& query,
+                       int window_size, int p, int diag_weight,
+                       DTWWorkspace& workspace)
+{
+    if (codes.size() != exact.size())
+        throw("Size mismatch between the codes and the database.");
+
+    detail::QuantizedFilter<Q, T> filter(query, quantization, window_size, p, diag_weight,
+                                         workspace);
+
+    double d = std::numeric_limits<double>::infinity();
+    int NN = -1;
+
+    for (int k = 0; k < (int) codes.size(); k++)
+    {
+        double dtw = filter.evaluate(codes[k], exact[k], d);
+
+        if (dtw < d) {
+            NN = k;
+            d = dtw;
+        }
+    }
+
+    return NN;
+}
+
+template<typename Q, typename T>
+int nearestNeighborDTW(const std::vector<TimeSeriesView<Q>>& codes,
+                       const Quantization& quantization,
+                       const std::vector<TimeSeriesView<T>>& exact,
+                       const TimeSeriesView<T>& query,
+                       int window_size, int p, int diag_weight)
+{
+    DTWWorkspace workspace;
+    return nearestNeighborDTW(codes, quantization, exact, query, window_size, p, diag_weight,
+                              workspace);
+}
+
+}
+
+#endif // _QUANTIZED_H
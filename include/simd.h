@@ -0,0 +1,26 @@
+#ifndef _SIMD_H
+#define _SIMD_H
+
+namespace TSdist {
+
+/** Instruction sets used by the vectorized kernels
+
+    Levels are ordered, each one implies the ones before it.
+ */
+enum class SimdLevel
+{
+    Scalar = 0,
+    SSE2,
+    AVX2,
+    AVX512
+};
+
+/** Best level supported by the CPU (and the compiler) at runtime
+
+    The result is detected once and cached.
+ */
+SimdLevel detectSimdLevel();
+
+}
+
+#endif // _SIMD_H
@@ -0,0 +1,120 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <chrono>
+#include "lb.h"
+#include "workspace.h"
+
+/*
+ * Statistics are only collected when the library AND the code that includes its headers are
+ * compiled with TSDIST_STATS defined. Otherwise every hook below expands to nothing, so the
+ * kernels are exactly the same as without instrumentation.
+ */
+#ifdef TSDIST_STATS
+#define TSDIST_STATS_ONLY(...) __VA_ARGS__
+#else
+#define TSDIST_STATS_ONLY(...)
+#endif
+
+namespace TSdist {
+
+/** Counters of the searches and DTW computations
+
+    Attach an object to a DTWWorkspace (see DTWWorkspace::setStats) and every function that
+    uses that workspace adds to it. The multithreaded searches take it as a parameter and merge
+    the counters of all threads into it.
+
+    Nothing is collected unless TSDIST_STATS is defined, see above.
+ */
+struct SearchStats
+{
+    SearchStats() { reset(); }
+
+    void reset() {
+        candidates = 0;
+        dtw_computed = 0;
+        dtw_abandoned = 0;
+        cells_computed = 0;
+        cells_in_window = 0;
+        dtw_seconds = 0;
+
+        for (int i = 0; i < NUM_LOWER_BOUNDS; i++) {
+            pruned[i] = 0;
+            lb_seconds[i] = 0;
+        }
+    }
+
+    void merge(const SearchStats& other) {
+        candidates += other.candidates;
+        dtw_computed += other.dtw_computed;
+        dtw_abandoned += other.dtw_abandoned;
+        cells_computed += other.cells_computed;
+        cells_in_window += other.cells_in_window;
+        dtw_seconds += other.dtw_seconds;
+
+        for (int i = 0; i < NUM_LOWER_BOUNDS; i++) {
+            pruned[i] += other.pruned[i];
+            lb_seconds[i] += other.lb_seconds[i];
+        }
+    }
+
+    // Candidates evaluated by the searches
+    long long candidates;
+
+    // Candidates discarded by each lower bound, indexed by LowerBound
+    long long pruned[NUM_LOWER_BOUNDS];
+
+    // DTW computations, and how many of them were abandoned because of a bound
+    long long dtw_computed;
+    long long dtw_abandoned;
+
+    // Cells of the cost matrix actually computed, and cells inside the window
+    long long cells_computed;
+    long long cells_in_window;
+
+    // Wall time spent in each lower bound and in DTW by the searches
+    double lb_seconds[NUM_LOWER_BOUNDS];
+    double dtw_seconds;
+};
+
+// Adds one DTW computation to the statistics of 'workspace', if it has any
+inline void recordDTW(DTWWorkspace& workspace, long long cells_computed, long long cells_in_window,
+                      bool abandoned)
+{
+    if (SearchStats* stats = workspace.stats()) {
+        stats->dtw_computed++;
+        stats->dtw_abandoned += abandoned;
+        stats->cells_computed += cells_computed;
+        stats->cells_in_window += cells_in_window;
+    }
+}
+
+/** Measures the wall time of a scope and adds it to '*seconds', does nothing if it is null */
+class StatsTimer
+{
+public:
+
+    explicit StatsTimer(double* seconds) :
+        _seconds(seconds)
+    {
+        if (_seconds) _start = std::chrono::steady_clock::now();
+    }
+
+    StatsTimer(const StatsTimer&) = delete;
+    StatsTimer& operator=(const StatsTimer&) = delete;
+
+    ~StatsTimer() {
+        if (_seconds) {
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - _start;
+            *_seconds += elapsed.count();
+        }
+    }
+
+private:
+    double* _seconds;
+    std::chrono::steady_clock::time_point _start;
+};
+
+}
+
+#endif // _STATS_H
@@ -0,0 +1,125 @@
+#ifndef _STREAMING_H
+#define _STREAMING_H
+
+#include <vector>
+#include "ts.h"
+
+namespace TSdist {
+
+/** Match of the query reported by StreamingDTW
+
+    Positions are those of the first and last observations in the stream (counting from 0
+    since construction or the last reset()).
+ */
+struct StreamMatch
+{
+    long long start;
+    long long end;
+    double distance;
+};
+
+/** Subsequence matching over a stream, one observation at a time (SPRING)
+
+    Keeps a single column of the subsequence DTW matrix of Sakurai et al. (2007), in which a
+    match can start at any observation of the stream, together with the start of the best path
+    reaching each cell. Each new observation updates the column in O(m) time and memory, m being
+    the query length, and the stream itself is never stored.
+
+    A match is reported once no path still alive can lead to a better match overlapping it, so
+    the reported matches do not overlap and each one is the best among those overlapping it
+    (the optimal disjoint queries of SPRING). Therefore they are reported some observations
+    after their end, at the latest when the stream has advanced m observations past it, and
+    flush() reports the one pending at the end of the stream.
+
+    Steps are not weighted (diag_weight = 1 in computeDTW) and there is no window constraint.
+    The series are not normalized.
+ */
+class StreamingDTW
+{
+public:
+
+    /*
+     * Parameter threshold is the largest distance reported as a match
+     * Parameter p is for the Lp norm
+     */
+    StreamingDTW(const TimeSeriesBase& query, double threshold, int p);
+
+    // Same for a query in contiguous memory (see TimeSeriesView in ts.h)
+    template<typename T>
+    StreamingDTW(const TimeSeriesView<T>& query, double threshold, int p);
+
+    /** Processes the next observation of the stream
+
+        'sample' holds one value per variable of the query. Returns true and fills 'match' if a
+        match is reported.
+     */
+    bool update(const double* sample, StreamMatch& match);
+
+    // Same for univariate queries
+    bool update(double value, StreamMatch& match);
+
+    /** Processes the next samples.length() observations of the stream
+
+        The reported matches are appended to 'matches', returns how many.
+     */
+    int update(const TimeSeriesBase& samples, std::vector<StreamMatch>& matches);
+
+    template<typename T>
+    int update(const TimeSeriesView<T>& samples, std::vector<StreamMatch>& matches);
+
+    /** Reports the pending match, if any, as if the stream had ended
+
+        The stream can continue afterwards, later matches will not overlap it.
+     */
+    bool flush(StreamMatch& match);
+
+    // Starts a new stream, discarding any pending match
+    void reset();
+
+    // Observations processed so far
+    long long position() const { return _time; }
+
+    int length() const { return _length; }
+    int numVars() const { return _num_vars; }
+    double threshold() const { return _threshold; }
+
+private:
+    // Checks the parameters and sizes the columns, the query is copied by the callers
+    StreamingDTW(int length, int num_vars, double threshold, int p);
+
+    template<typename Series>
+    void copyQuery(const Series& query);
+
+    template<typename Series>
+    int updateKernel(const Series& samples, std::vector<StreamMatch>& matches);
+
+    void report(StreamMatch& match);
+
+    int _length;
+    int _num_vars;
+    int _p;
+    double _threshold;
+
+    // p-th power of the threshold
+    double _bound;
+
+    // query observations, one after the other
+    std::vector<double> _query;
+
+    // p-th power of the cost of the best path reaching each cell of the last column (index 0 is
+    // the virtual start row), and first observation of that path
+    std::vector<double> _costs;
+    std::vector<long long> _starts;
+
+    long long _time;
+
+    // best match found that has not been reported yet, if _pending
+    bool _pending;
+    double _best_cost;
+    long long _best_start;
+    long long _best_end;
+};
+
+}
+
+#endif // _STREAMING_H
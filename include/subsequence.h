@@ -0,0 +1,72 @@
+#ifndef _SUBSEQUENCE_H
+#define _SUBSEQUENCE_H
+
+#include "ts.h"
+#include "workspace.h"
+
+namespace TSdist {
+
+/*
+ * Functions that need temporary memory have an overload that takes a DTWWorkspace (see
+ * workspace.h) as last parameter, so that repeated calls do not allocate.
+ */
+
+/** Best match of a query inside a longer series */
+struct SubsequenceMatch
+{
+    // first observation of the match in the long series, -1 if there is none
+    int position;
+    double distance;
+};
+
+/** Subsequence search in DTW space with z-normalization (UCR suite)
+
+    Finds the subsequence of 'stream' with the same length as 'query' whose DTW distance to
+    'query' is smallest, after z-normalizing both of them. Following Rakthanmanon et al. (2012):
+
+    - the mean and standard deviation of each subsequence are kept up to date with running
+      sums, so that it is normalized in constant time (subsequences with no variance become all
+      zeros),
+    - the query is visited by decreasing absolute value, which makes the lower bounds grow
+      faster and early abandoning happen sooner,
+    - candidates go through LB_Kim (first and last three observations), LB_Keogh against the
+      query envelope and LB_Keogh of the query against the candidate envelope, all abandoned
+      against the best-so-far,
+    - the tighter LB_Keogh is accumulated from the end and added to each row minimum of an
+      early abandoning DTW.
+
+    The stream is processed in chunks, so the memory used does not depend on its length.
+
+    Only univariate series supported.
+    Steps are not weighted (diag_weight = 1 in computeDTW).
+    Ties are broken by position.
+
+    Parameter window_size is for the window constraint, values smaller than 1 mean no
+    constraint
+    Parameter p is for the Lp norm
+ */
+SubsequenceMatch subsequenceSearchDTW(const TimeSeriesBase& stream, const TimeSeriesBase& query,
+                                      int window_size, int p);
+
+SubsequenceMatch subsequenceSearchDTW(const TimeSeriesBase& stream, const TimeSeriesBase& query,
+                                      int window_size, int p,
+                                      DTWWorkspace& workspace);
+
+// ================================================================================================
+/* Versions for series in contiguous memory (see TimeSeriesView in ts.h) */
+// ================================================================================================
+
+template<typename T>
+SubsequenceMatch subsequenceSearchDTW(const TimeSeriesView<T>& stream,
+                                      const TimeSeriesView<T>& query,
+                                      int window_size, int p);
+
+template<typename T>
+SubsequenceMatch subsequenceSearchDTW(const TimeSeriesView<T>& stream,
+                                      const TimeSeriesView<T>& query,
+                                      int window_size, int p,
+                                      DTWWorkspace& workspace);
+
+}
+
+#endif // _SUBSEQUENCE_H
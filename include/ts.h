@@ -29,6 +29,22 @@ public:
     virtual const double& indexSeries(int time_index, int var_index) const = 0;
     virtual double& indexSeries(int time_index, int var_index) = 0;
 
+    // ============================================================================================
+    /* Optional virtual methods */
+    // ============================================================================================
+
+    /*
+     * If the values are stored contiguously, so that (time_index, var_index) is located at
+     * data()[time_index * stride() + var_index], derived classes can return the pointer here.
+     * Distance functions then use TimeSeriesView (see below) and avoid calling indexSeries.
+     * The default (nullptr) means no contiguous storage is available.
+     */
+    virtual const double* data() const { return nullptr; }
+    virtual double* data() { return nullptr; }
+
+    // Distance between consecutive time indices in data()
+    virtual int stride() const { return numVars(); }
+
 private: // More public methods below
 
     // Proxy class for double subscript
@@ -80,6 +96,62 @@ protected:
 
 };
 
+/** Non-owning, read-only view of a series stored in contiguous memory
+
+    The value for (time_index, var_index) is located at data[time_index * stride + var_index].
+    A stride of 0 means the values of each time index are packed, i.e. stride == num_vars.
+
+    Subscripting works like in TimeSeriesBase (view[time_index][var_index]), but everything is
+    inlined, so the overloads of the distance functions that take views have no indirect calls.
+ */
+template<typename T>
+class TimeSeriesView
+{
+public:
+
+    // Empty view, to be assigned
+    TimeSeriesView() : TimeSeriesView(nullptr, 0) { }
+
+    TimeSeriesView(const T* data, int length, int num_vars = 1, int stride = 0) :
+        _data(data) ,
+        _length(length) ,
+        _num_vars(num_vars) ,
+        _stride(stride > 0 ? stride : num_vars)
+    { }
+
+    int numVars() const { return _num_vars; }
+    int length() const { return _length; }
+    int stride() const { return _stride; }
+    const T* data() const { return _data; }
+
+    const T* operator[](int time_index) const {
+        return _data + time_index * _stride;
+    }
+
+private:
+    const T* _data;
+    int _length;
+    int _num_vars;
+    int _stride;
+};
+
+// ================================================================================================
+/* Helpers for the dispatch between TimeSeriesBase and TimeSeriesView */
+// ================================================================================================
+
+// Whether x exposes contiguous storage
+inline bool isContiguous(const TimeSeriesBase& x) {
+    return x.data() != nullptr;
+}
+
+// View of x, only valid if isContiguous(x)
+inline TimeSeriesView<double> viewOf(const TimeSeriesBase& x) {
+    if (!isContiguous(x))
+        throw("Series does not expose contiguous storage.");
+
+    return TimeSeriesView<double>(x.data(), x.length(), x.numVars(), x.stride());
+}
+
 }
 
 #endif // _TS_H
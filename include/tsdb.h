@@ -0,0 +1,236 @@
+#ifndef _TSDB_H
+#define _TSDB_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "ts.h"
+#include "mmap.h"
+#include "quantized.h"
+
+namespace TSdist {
+
+/** Type of the values stored in a TimeSeriesDatabase file
+
+    Int16 and Int8 are the codes of a quantization shared by the whole file (see quantized.h).
+ */
+enum class ValueType : std::uint32_t { Float64 = 0, Float32 = 1, Int16 = 2, Int8 = 3 };
+
+/** Series of a TimeSeriesDatabase seen as a TimeSeriesBase, without copying
+
+    Only for float64 databases. It exposes its storage through data(), so the distance
+    functions use the contiguous versions. The mapping is read-only, so values must never be
+    written through the non-const accessors (the process would crash).
+ */
+class MappedSeries : public TimeSeriesBase
+{
+public:
+
+    MappedSeries(const double* data, int length, int num_vars) :
+        _data(data) ,
+        _length(length) ,
+        _num_vars(num_vars)
+    { }
+
+    int numVars() const override { return _num_vars; }
+    int length() const override { return _length; }
+
+    const double& indexSeries(int time_index, int var_index) const override {
+        return _data[(std::size_t) time_index * _num_vars + var_index];
+    }
+
+    // Required by TimeSeriesBase, the non-const subscript reads through it
+    double& indexSeries(int time_index, int var_index) override {
+        return const_cast<double&>(_data[(std::size_t) time_index * _num_vars + var_index]);
+    }
+
+    const double* data() const override { return _data; }
+
+private:
+    const double* _data;
+    int _length;
+    int _num_vars;
+};
+
+/** Time-series database in a memory-mapped binary file
+
+    The file has a 64-byte header, a table with the offset, length and number of variables of
+    every series, and the values of each series (time index after time index) aligned to 64
+    bytes, either as float64, float32, or int16/int8 codes of a quantization fitted to the range
+    of all values (kept in the header). Series can have different lengths and numbers of
+    variables. The binary format is that of the machine that wrote the file.
+
+    Opening a database maps the file and checks the header, nothing is parsed or copied, so it
+    takes constant time and the pages are shared between processes. Series are accessed in place
+    as TimeSeriesView or MappedSeries; the contiguous versions of the searches take the vector
+    of all of them returned by views():
+
+        TimeSeriesDatabase db("train.tsdb");
+        int nn = nearestNeighborDTW(db.views<double>(), query, window_size, p, diag_weight);
+
+    Quantized databases are searched with their codes (see quantized.h):
+
+        TimeSeriesDatabase codes("train-int16.tsdb");
+        int nn = nearestNeighborDTW(codes.views<std::int16_t>(), codes.quantization(), query,
+                                    window_size, p, diag_weight);
+
+    The file must not be modified while the database exists.
+ */
+class TimeSeriesDatabase
+{
+public:
+
+    explicit TimeSeriesDatabase(const std::string& path);
+
+    /** Writes the series of 'tsdb' to a new file, converting the values to 'type'
+
+        This assumes the TSDB supports iterators that reference TimeSeriesBase derivatives (see
+        ts.h); series without contiguous storage are copied one at a time.
+     */
+    template<typename TSDB>
+    static void write(const std::string& path, const TSDB& tsdb, ValueType type)
+    {
+        std::vector<Shape> shapes;
+        Range range;
+
+        for (const TimeSeriesBase& REF : tsdb)
+        {
+            shapes.push_back(Shape{ REF.length(), REF.numVars() });
+
+            // only needed for the quantized types
+            if (type == ValueType::Int16 || type == ValueType::Int8) {
+                for (int i = 0; i < REF.length(); i++)
+                    for (int k = 0; k < REF.numVars(); k++)
+                        range.add(REF[i][k]);
+            }
+        }
+
+        std::ofstream file;
+        Quantization quantization = writeHeader(file, path, shapes, type, range);
+
+        std::vector<double> buffer;
+
+        for (const TimeSeriesBase& REF : tsdb)
+        {
+            if (isContiguous(REF)) {
+                writeSeries(file, viewOf(REF), type, quantization);
+                continue;
+            }
+
+            buffer.resize((std::size_t) REF.length() * REF.numVars());
+
+            for (int i = 0; i < REF.length(); i++)
+                for (int k = 0; k < REF.numVars(); k++)
+                    buffer[(std::size_t) i * REF.numVars() + k] = REF[i][k];
+
+            writeSeries(file, TimeSeriesView<double>(buffer.data(), REF.length(),
+                                                     REF.numVars()), type, quantization);
+        }
+
+        if (!file)
+            throw("Could not write file.");
+    }
+
+    static void write(const std::string& path, const std::vector<TimeSeriesView<double>>& tsdb,
+                      ValueType type);
+
+    int size() const { return _size; }
+    ValueType valueType() const { return _type; }
+
+    // Quantization of the codes, scale 1 and offset 0 for float64 and float32 databases
+    const Quantization& quantization() const { return _quantization; }
+
+    int length(int k) const { return entry(k).length; }
+    int numVars(int k) const { return entry(k).num_vars; }
+
+    /** View of the k-th series, T must match valueType() (codes for the quantized types) */
+    template<typename T>
+    TimeSeriesView<T> view(int k) const {
+        static_assert(std::is_same<T, double>::value || std::is_same<T, float>::value ||
+                      std::is_same<T, std::int16_t>::value || std::is_same<T, std::int8_t>::value,
+                      "Values are either double, float, int16_t or int8_t.");
+
+        checkType(std::is_same<T, double>::value ? ValueType::Float64 :
+                  std::is_same<T, float>::value ? ValueType::Float32 :
+                  std::is_same<T, std::int16_t>::value ? ValueType::Int16 : ValueType::Int8);
+
+        const Entry& e = entry(k);
+        return TimeSeriesView<T>(reinterpret_cast<const T*>(values(k, sizeof(T))), e.length,
+                                 e.num_vars);
+    }
+
+    // Views of all series, in order
+    template<typename T>
+    std::vector<TimeSeriesView<T>> views() const {
+        std::vector<TimeSeriesView<T>> result;
+        result.reserve(_size);
+
+        for (int k = 0; k < _size; k++) result.push_back(view<T>(k));
+        return result;
+    }
+
+    // The k-th series as a TimeSeriesBase, float64 databases only
+    MappedSeries operator[](int k) const {
+        TimeSeriesView<double> series = view<double>(k);
+        return MappedSeries(series.data(), series.length(), series.numVars());
+    }
+
+private:
+
+    struct Shape
+    {
+        int length;
+        int num_vars;
+    };
+
+    // Smallest and largest values written, for the quantization
+    struct Range
+    {
+        Range() : min(1), max(0) { }
+
+        void add(double value) {
+            if (min > max) min = max = value;
+            min = value < min ? value : min;
+            max = value > max ? value : max;
+        }
+
+        double min;
+        double max;
+    };
+
+    // One per series after the header
+    struct Entry
+    {
+        std::uint64_t offset;
+        std::int32_t length;
+        std::int32_t num_vars;
+    };
+
+    // Returns the quantization of the codes (see quantization())
+    static Quantization writeHeader(std::ofstream& file, const std::string& path,
+                                    const std::vector<Shape>& shapes, ValueType type,
+                                    const Range& range);
+
+    static void writeSeries(std::ofstream& file, const TimeSeriesView<double>& series,
+                            ValueType type, const Quantization& quantization);
+
+    const Entry& entry(int k) const { return _entries[k]; }
+
+    // Checked pointer to the values of the k-th series
+    const unsigned char* values(int k, std::size_t value_size) const;
+
+    void checkType(ValueType type) const;
+
+    int _size;
+    ValueType _type;
+    Quantization _quantization;
+    const Entry* _entries;
+    MappedFile _file;
+};
+
+}
+
+#endif // _TSDB_H
@@ -0,0 +1,176 @@
+#ifndef _WORKSPACE_H
+#define _WORKSPACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new> // std::bad_alloc
+
+namespace TSdist {
+
+struct SearchStats;
+
+/** Growable buffer with 64-byte alignment
+
+    Memory is only reallocated when a larger size is requested, and it is never shrunk.
+    Previous contents are NOT preserved when the buffer grows.
+ */
+template<typename T>
+class AlignedBuffer
+{
+public:
+
+    static const std::size_t ALIGNMENT = 64;
+
+    AlignedBuffer() :
+        _raw(nullptr) ,
+        _data(nullptr) ,
+        _capacity(0)
+    { }
+
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+    AlignedBuffer(AlignedBuffer&& other) :
+        _raw(other._raw) ,
+        _data(other._data) ,
+        _capacity(other._capacity)
+    {
+        other._raw = nullptr;
+        other._data = nullptr;
+        other._capacity = 0;
+    }
+
+    AlignedBuffer& operator=(AlignedBuffer&& other) {
+        if (this != &other) {
+            std::free(_raw);
+            _raw = other._raw;
+            _data = other._data;
+            _capacity = other._capacity;
+            other._raw = nullptr;
+            other._data = nullptr;
+            other._capacity = 0;
+        }
+
+        return *this;
+    }
+
+    ~AlignedBuffer() {
+        std::free(_raw);
+    }
+
+    // Pointer to at least 'size' elements
+    T* reserve(std::size_t size) {
+        if (size > _capacity) {
+            void* raw = std::malloc(size * sizeof(T) + ALIGNMENT);
+            if (raw == nullptr) throw std::bad_alloc();
+
+            std::free(_raw);
+            _raw = raw;
+            _data = reinterpret_cast<T*>(
+                (reinterpret_cast<std::uintptr_t>(raw) + ALIGNMENT - 1) & ~(ALIGNMENT - 1));
+            _capacity = size;
+        }
+
+        return _data;
+    }
+
+    std::size_t capacity() const { return _capacity; }
+
+private:
+    void* _raw;
+    T* _data;
+    std::size_t _capacity;
+};
+
+/** Reusable scratch memory for the DTW functions, lower bounds and searches
+
+    All functions that need temporary memory have an overload that takes a workspace. Passing
+    the same workspace to repeated calls means that, once its buffers have grown to the largest
+    sizes needed, no more allocations take place. The overloads without a workspace create a
+    temporary one, i.e. they use the heap and never the stack.
+
+    Each buffer is used by one kind of computation, so that nested calls sharing a workspace do
+    not overwrite each other's data. A workspace must not be used by several threads at once.
+ */
+class DTWWorkspace
+{
+public:
+
+    DTWWorkspace() = default;
+    DTWWorkspace(DTWWorkspace&&) = default;
+    DTWWorkspace& operator=(DTWWorkspace&&) = default;
+
+    // Rows or diagonals of the cost matrix
+    double* costs(std::size_t size) { return _costs.reserve(size); }
+
+    // Steps taken in the cost matrix, for backtracking
+    unsigned char* directions(std::size_t size) { return _directions.reserve(size); }
+
+    // Contiguous copies of the series used by the DTW kernels
+    double* series(std::size_t size) { return _series.reserve(size); }
+
+    // Window limits of the DTW kernels
+    int* limits(std::size_t size) { return _limits.reserve(size); }
+
+    // Running minima and maxima used by computeEnvelop
+    template<typename T>
+    T* extremaOf(std::size_t size) { return reserveAs<T>(_extrema, size); }
+
+    // Envelops and helper series of the lower bounds
+    double* envelops(std::size_t size) { return _envelops.reserve(size); }
+
+    // Same memory for envelops of series of another type (float)
+    template<typename T>
+    T* envelopsOf(std::size_t size) { return reserveAs<T>(_envelops, size); }
+
+    // Contiguous copies of the query and candidates in the searches
+    double* candidates(std::size_t size) { return _candidates.reserve(size); }
+
+    template<typename T>
+    T* candidatesOf(std::size_t size) { return reserveAs<T>(_candidates, size); }
+
+    // Envelops in code units of the searches over quantized series (see quantized.h)
+    int* codes(std::size_t size) { return _codes.reserve(size); }
+
+    // Statistics collected by the functions using this workspace, see stats.h (not owned)
+    SearchStats* stats() const { return _stats; }
+    void setStats(SearchStats* stats) { _stats = stats; }
+
+    // Memory currently held, in bytes
+    std::size_t bytes() const {
+        return _costs.capacity() * sizeof(double) +
+            _directions.capacity() * sizeof(unsigned char) +
+            _series.capacity() * sizeof(double) +
+            _limits.capacity() * sizeof(int) +
+            _extrema.capacity() * sizeof(double) +
+            _envelops.capacity() * sizeof(double) +
+            _candidates.capacity() * sizeof(double) +
+            _codes.capacity() * sizeof(int);
+    }
+
+private:
+
+    // 'size' values of type T in a buffer of doubles
+    template<typename T>
+    static T* reserveAs(AlignedBuffer<double>& buffer, std::size_t size) {
+        static_assert(sizeof(T) <= sizeof(double), "Values cannot be larger than double.");
+        return reinterpret_cast<T*>(buffer.reserve((size * sizeof(T) + sizeof(double) - 1) /
+                                                   sizeof(double)));
+    }
+
+    AlignedBuffer<double> _costs;
+    AlignedBuffer<unsigned char> _directions;
+    AlignedBuffer<double> _series;
+    AlignedBuffer<int> _limits;
+    AlignedBuffer<double> _extrema;
+    AlignedBuffer<double> _envelops;
+    AlignedBuffer<double> _candidates;
+    AlignedBuffer<int> _codes;
+
+    SearchStats* _stats = nullptr;
+};
+
+}
+
+#endif // _WORKSPACE_H
@@ -32,6 +32,10 @@ public:
         return series.at(time_index);
     }
 
+    // Enables the contiguous fast paths
+    const double* data() const override { return series.data(); }
+    double* data() override { return series.data(); }
+
     std::vector<double>::iterator begin() { return series.begin(); }
     std::vector<double>::iterator end() { return series.end(); }
     std::vector<double>::const_iterator begin() const { return series.begin(); }
@@ -129,5 +133,32 @@ int main()
     for (auto i : nn2) cout << i << ", ";
     cout << endl;
 
+    // same search with 2 threads
+    UnivariateTimeSeries nn3 = TSdist::nearestNeighborDTW(tsdb, query2, 1, 2, 2, 2);
+
+    cout << "Nearest neighbor 2 (multithreaded) is: ";
+    for (auto i : nn3) cout << i << ", ";
+    cout << endl;
+
+    std::vector<TSdist::Neighbor> knn = TSdist::kNearestNeighborsDTW(tsdb, query2, 2, 1, 2, 2);
+
+    cout << "2 nearest neighbors (index: distance) are: ";
+    for (auto& nn : knn) cout << nn.index << ": " << nn.distance << ", ";
+    cout << endl;
+
+    std::vector<TSdist::Neighbor> range = TSdist::rangeQueryDTW(tsdb, query2, 3.0, 1, 2, 2);
+
+    cout << "Neighbors within distance 3 (index: distance) are: ";
+    for (auto& nn : range) cout << nn.index << ": " << nn.distance << ", ";
+    cout << endl;
+
+    // a window of 1 leaves no warping path between 32 and 200 observations
+    std::vector<double> short_values(32, 1.0), long_values(200, 2.0);
+    TSdist::TimeSeriesView<double> short_view(short_values.data(), short_values.size());
+    TSdist::TimeSeriesView<double> long_view(long_values.data(), long_values.size());
+
+    cout << "DTW distance without warping path is: " <<
+        TSdist::computeDTW(short_view, long_view, 1, 2, 2) << endl;
+
     return 0;
 }
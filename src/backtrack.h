@@ -0,0 +1,270 @@
+#ifndef _BACKTRACK_H
+#define _BACKTRACK_H
+
+#include <algorithm> // std::min, std::max, std::fill
+#include <cstddef>
+#include "ts.h"
+#include "workspace.h"
+#include "kernels.h"
+#include "stats.h"
+
+namespace TSdist {
+
+// ================================================================================================
+/* Warping path of DTW in bounded memory (not part of the public interface) */
+// ================================================================================================
+
+// Cells of the window whose directions are kept at once, 2 bits each (16 MB)
+static const std::size_t BACKTRACK_BLOCK_CELLS = (std::size_t) 1 << 26;
+
+/*
+ * Directions are only stored for the cells inside the window, packed 2 bits per cell. If those
+ * of the whole matrix do not fit in BACKTRACK_BLOCK_CELLS, the rows are split in halves
+ * recursively, Hirschberg style: the upper half is computed only to get the costs of its last
+ * row, the path is traced through the lower half from them, and then through the upper half
+ * from the cell where it left the lower one. Each level keeps one row of costs, so memory is
+ * O(ny * log(nx)) plus the block of directions, and at most log2(nx) times the cells are
+ * recomputed. The costs are computed by exactly the same operations in every case, so the path
+ * does not depend on the splitting.
+ */
+template<typename Series, typename Visitor>
+class PathTracer
+{
+public:
+
+    PathTracer(const Series& x, const Series& y, int window_size, int p, int diag_weight,
+               Visitor& visit, DTWWorkspace& workspace) :
+        _x(x) ,
+        _y(y) ,
+        _nx(x.length()) ,
+        _ny(y.length()) ,
+        _window_size(window_size) ,
+        _p(p) ,
+        _diag_weight(diag_weight) ,
+        _visit(visit) ,
+        _workspace(workspace) ,
+        _cost(NOT_VISITED)
+    {
+        // rows per block, to know how deep the recursion can go
+        std::size_t widest = 1;
+
+        for (int i = 1; i <= _nx; i++)
+            widest = std::max<std::size_t>(widest, width(i));
+
+        std::size_t block_rows = std::max<std::size_t>(1, BACKTRACK_BLOCK_CELLS / widest);
+        int levels = 1;
+
+        while (block_rows < (std::size_t) _nx) {
+            block_rows *= 2;
+            levels++;
+        }
+
+        // two working rows and one per level, the first one being the virtual row 0
+        std::size_t row_size = _ny + 1;
+        _rows = workspace.costs((levels + 3) * row_size);
+        std::fill(_rows, _rows + (levels + 3) * row_size, NOT_VISITED);
+
+        std::size_t cells = std::min<std::size_t>(windowCells(_nx, _ny, _window_size),
+                                                   BACKTRACK_BLOCK_CELLS);
+        _directions = workspace.directions(cells / 4 + 1);
+
+        TSDIST_STATS_ONLY(_computed = 0;)
+    }
+
+    // Returns the p-th power of the DTW distance, the cells of the path are visited backwards
+    double trace() {
+        _visit(_nx - 1, _ny - 1);
+
+        trace(1, _nx, _rows, _ny, _rows + 3 * (std::size_t) (_ny + 1));
+
+        TSDIST_STATS_ONLY(recordDTW(_workspace, _computed, windowCells(_nx, _ny, _window_size),
+                                    false);)
+
+        return _cost;
+    }
+
+private:
+
+    std::size_t width(int i) const {
+        int j1, j2;
+        windowLimits(i, _nx, _ny, _window_size, j1, j2);
+        return j2 >= j1 ? j2 - j1 + 1 : 0;
+    }
+
+    /*
+     * Computes row i into 'cur' from row i - 1 in 'prev', setting also the cells that row i + 1
+     * reads outside the window. If 'packed' is not null, the directions of the row are stored
+     * from its (2-bit) position 'offset'.
+     */
+    void computeRow(int i, const double* prev, double* cur, unsigned char* packed,
+                    std::size_t offset)
+    {
+        double tuple_direction[3];
+        int j1, j2;
+
+        windowLimits(i, _nx, _ny, _window_size, j1, j2);
+
+        cur[j1 - 1] = NOT_VISITED;
+
+        if (i == 1) {
+            // first value, must set here to avoid multiplying by step (even outside the window)
+            cur[0] = NOT_VISITED;
+            cur[1] = localCost(_x, _y, _p, 0, 0);
+        }
+
+        for (int j = j1; j <= j2; j++)
+        {
+            int direction = STEP_DIAG;
+
+            // very first value already set above
+            if (i > 1 || j > 1) {
+                double local_cost = localCost(_x, _y, _p, i - 1, j - 1);
+
+                direction = which_direction(tuple_direction, prev[j - 1], cur[j - 1], prev[j],
+                                            _diag_weight, local_cost);
+
+                cur[j] = tuple_direction[direction];
+            }
+
+            if (packed) {
+                std::size_t k = offset + (j - j1);
+                int shift = 2 * (k % 4);
+                packed[k / 4] = (packed[k / 4] & ~(3 << shift)) | (direction << shift);
+            }
+        }
+
+        TSDIST_STATS_ONLY(if (j2 >= j1) _computed += j2 - j1 + 1;)
+
+        // cells of the next row's window beyond this one
+        if (i < _nx) {
+            int next1, next2;
+            windowLimits(i + 1, _nx, _ny, _window_size, next1, next2);
+
+            for (int j = std::max(j2 + 1, 1); j <= std::min(next2, _ny); j++)
+                cur[j] = NOT_VISITED;
+        }
+
+        if (i == _nx) _cost = cur[_ny];
+    }
+
+    /*
+     * Traces the path from cell (r1, j) through rows [r0, r1], given the costs of row r0 - 1.
+     * Returns the column where it enters row r0 - 1 (the cell is already visited). 'free'
+     * points to unused rows for the recursion.
+     */
+    int trace(int r0, int r1, const double* boundary, int j, double* free)
+    {
+        std::size_t row_size = _ny + 1;
+        std::size_t cells = 0;
+
+        for (int i = r0; i <= r1; i++) cells += width(i);
+
+        if (r0 < r1 && cells > BACKTRACK_BLOCK_CELLS) {
+            int mid = (r0 + r1) / 2;
+            double* middle = free;
+
+            computeRows(r0, mid, boundary, middle);
+
+            j = trace(mid + 1, r1, middle, j, free + row_size);
+            return trace(r0, mid, boundary, j, free + row_size);
+        }
+
+        // compute the block keeping the directions
+        const double* prev = boundary;
+        double* cur = _rows + row_size;
+        std::size_t offset = 0;
+
+        for (int i = r0; i <= r1; i++)
+        {
+            computeRow(i, prev, cur, _directions, offset);
+            offset += width(i);
+
+            prev = cur;
+            cur = (cur == _rows + row_size) ? _rows + 2 * row_size : _rows + row_size;
+        }
+
+        // backtracking loop inside the block
+        int i = r1;
+        offset -= width(r1);
+
+        while (i >= r0 && !(i == 1 && j == 1))
+        {
+            int j1, j2;
+            windowLimits(i, _nx, _ny, _window_size, j1, j2);
+
+            if (j < j1 || j > j2)
+                throw("Invalid direction matrix computed.");
+
+            std::size_t k = offset + (j - j1);
+            int direction = (_directions[k / 4] >> (2 * (k % 4))) & 3;
+
+            if (direction == STEP_DIAG) {
+                i--;
+                j--;
+
+            } else if (direction == STEP_LEFT) {
+                j--;
+
+            } else if (direction == STEP_UP) {
+                i--;
+
+            } else {
+                throw("Invalid direction matrix computed.");
+            }
+
+            // only when no path reaches the end inside the window
+            if (i < 1 || j < 1)
+                throw("Invalid direction matrix computed.");
+
+            _visit(i - 1, j - 1);
+
+            // directions of the previous row of the block
+            if (direction != STEP_LEFT && i >= r0) offset -= width(i);
+        }
+
+        return j;
+    }
+
+    // Costs of rows [r0, r1] from those of row r0 - 1, only row r1 is kept in 'last'
+    void computeRows(int r0, int r1, const double* boundary, double* last)
+    {
+        std::size_t row_size = _ny + 1;
+        const double* prev = boundary;
+        double* cur = _rows + row_size;
+
+        for (int i = r0; i <= r1; i++)
+        {
+            if (i == r1) cur = last;
+
+            computeRow(i, prev, cur, nullptr, 0);
+
+            prev = cur;
+            cur = (cur == _rows + row_size) ? _rows + 2 * row_size : _rows + row_size;
+        }
+    }
+
+    const Series& _x;
+    const Series& _y;
+    int _nx;
+    int _ny;
+    int _window_size;
+    int _p;
+    int _diag_weight;
+
+    // called with (x index, y index) of every cell of the path
+    Visitor& _visit;
+    DTWWorkspace& _workspace;
+
+    // virtual row 0, two working rows and one per level
+    double* _rows;
+
+    unsigned char* _directions;
+
+    double _cost;
+
+    TSDIST_STATS_ONLY(long long _computed;)
+};
+
+}
+
+#endif // _BACKTRACK_H
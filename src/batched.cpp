@@ -0,0 +1,387 @@
+#include <algorithm> // std::min, std::max, std::fill
+#include <cmath>
+#include <limits>
+#include "ts.h"
+#include "dtw.h"
+#include "simd.h"
+#include "workspace.h"
+#include "kernels.h"
+#include "stats.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TSDIST_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace TSdist {
+
+static const double INF = std::numeric_limits<double>::infinity();
+
+// Relative slack added to the bounds, like in pruned.cpp
+static const double BOUND_SLACK = 1e-10;
+
+/*
+ * Several candidates x (same length) against one query y, one candidate per SIMD lane. Costs
+ * are stored interleaved: the value of lane l for cell j of a row is at row[j * L + l], and so
+ * is the value of lane l for observation i of the candidates. Every lane follows exactly the
+ * recursion of computeDTW, so the results are the same bit for bit.
+ *
+ * Unlike the anti-diagonal kernel (wavefront.cpp), the vectors are always full, whatever the
+ * length of the series and the window, which suits short series.
+ */
+
+// ================================================================================================
+/* Row sweeps, one per instruction set */
+// ================================================================================================
+
+/*
+ * Cells [a, b] of row i, given the observation i - 1 of every candidate (xi) and the query (y).
+ * The minimum of the row (per lane) is stored in 'row_min', which must come in as infinity.
+ */
+typedef void (*RowSweep)(const double* xi, const double* y, const double* prev, double* cur,
+                         int a, int b, double diag_weight, double* row_min);
+
+#ifdef TSDIST_X86_SIMD
+
+template<int P>
+__attribute__((target("sse2")))
+static void sweepSSE2(const double* xi, const double* y, const double* prev, double* cur,
+                      int a, int b, double diag_weight, double* row_min)
+{
+    const __m128d weight = _mm_set1_pd(diag_weight);
+    const __m128d sign = _mm_set1_pd(-0.0);
+    const __m128d x = _mm_load_pd(xi);
+    __m128d minimum = _mm_load_pd(row_min);
+
+    for (int j = a; j <= b; j++) {
+        __m128d diff = _mm_sub_pd(x, _mm_set1_pd(y[j - 1]));
+        __m128d local_cost = P == 1 ? _mm_andnot_pd(sign, diff) : _mm_mul_pd(diff, diff);
+
+        __m128d cost = _mm_add_pd(_mm_load_pd(prev + (j - 1) * 2),
+                                  _mm_mul_pd(weight, local_cost));
+        cost = _mm_min_pd(cost, _mm_add_pd(_mm_load_pd(cur + (j - 1) * 2), local_cost));
+        cost = _mm_min_pd(cost, _mm_add_pd(_mm_load_pd(prev + j * 2), local_cost));
+
+        _mm_store_pd(cur + j * 2, cost);
+        minimum = _mm_min_pd(minimum, cost);
+    }
+
+    _mm_store_pd(row_min, minimum);
+}
+
+template<int P>
+__attribute__((target("avx2")))
+static void sweepAVX2(const double* xi, const double* y, const double* prev, double* cur,
+                      int a, int b, double diag_weight, double* row_min)
+{
+    const __m256d weight = _mm256_set1_pd(diag_weight);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    const __m256d x = _mm256_load_pd(xi);
+    __m256d minimum = _mm256_load_pd(row_min);
+
+    for (int j = a; j <= b; j++) {
+        __m256d diff = _mm256_sub_pd(x, _mm256_set1_pd(y[j - 1]));
+        __m256d local_cost = P == 1 ? _mm256_andnot_pd(sign, diff) : _mm256_mul_pd(diff, diff);
+
+        __m256d cost = _mm256_add_pd(_mm256_load_pd(prev + (j - 1) * 4),
+                                     _mm256_mul_pd(weight, local_cost));
+        cost = _mm256_min_pd(cost, _mm256_add_pd(_mm256_load_pd(cur + (j - 1) * 4), local_cost));
+        cost = _mm256_min_pd(cost, _mm256_add_pd(_mm256_load_pd(prev + j * 4), local_cost));
+
+        _mm256_store_pd(cur + j * 4, cost);
+        minimum = _mm256_min_pd(minimum, cost);
+    }
+
+    _mm256_store_pd(row_min, minimum);
+}
+
+template<int P>
+__attribute__((target("avx512f")))
+static void sweepAVX512(const double* xi, const double* y, const double* prev, double* cur,
+                        int a, int b, double diag_weight, double* row_min)
+{
+    // masked minimum, the unmasked one warns about its undefined source with some compilers
+    const __mmask8 all = 0xFF;
+    const __m512d weight = _mm512_set1_pd(diag_weight);
+    const __m512d x = _mm512_load_pd(xi);
+    __m512d minimum = _mm512_load_pd(row_min);
+
+    for (int j = a; j <= b; j++) {
+        __m512d diff = _mm512_sub_pd(x, _mm512_set1_pd(y[j - 1]));
+        __m512d local_cost = P == 1 ? _mm512_abs_pd(diff) : _mm512_mul_pd(diff, diff);
+
+        __m512d cost = _mm512_add_pd(_mm512_load_pd(prev + (j - 1) * 8),
+                                     _mm512_mul_pd(weight, local_cost));
+        cost = _mm512_maskz_min_pd(all, cost,
+                                   _mm512_add_pd(_mm512_load_pd(cur + (j - 1) * 8), local_cost));
+        cost = _mm512_maskz_min_pd(all, cost,
+                                   _mm512_add_pd(_mm512_load_pd(prev + j * 8), local_cost));
+
+        _mm512_store_pd(cur + j * 8, cost);
+        minimum = _mm512_maskz_min_pd(all, minimum, cost);
+    }
+
+    _mm512_store_pd(row_min, minimum);
+}
+
+#endif // TSDIST_X86_SIMD
+
+// Lanes of the sweep used for 'level', 1 means there is no batched kernel
+static int lanesOf(SimdLevel level)
+{
+#ifdef TSDIST_X86_SIMD
+    switch (level) {
+    case SimdLevel::AVX512:
+        return 8;
+    case SimdLevel::AVX2:
+        return 4;
+    case SimdLevel::SSE2:
+        return 2;
+    default:
+        return 1;
+    }
+#else
+    (void) level;
+    return 1;
+#endif
+}
+
+template<int P>
+static RowSweep selectSweep(SimdLevel level)
+{
+    switch (level) {
+#ifdef TSDIST_X86_SIMD
+    case SimdLevel::AVX512:
+        return sweepAVX512<P>;
+    case SimdLevel::AVX2:
+        return sweepAVX2<P>;
+    case SimdLevel::SSE2:
+        return sweepSSE2<P>;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+// ================================================================================================
+/* Row-wise traversal of the cost matrix, all lanes at once */
+// ================================================================================================
+
+/*
+ * 'x' holds the interleaved candidates and 'bounds' the p-th powers of their bounds (unused
+ * lanes get a negative bound). A lane is dead once a whole row is above its bound, since costs
+ * only grow along a warping path, and the computation stops when all lanes are dead. The
+ * p-th powers of the distances (infinity for dead lanes) are stored in 'costs'.
+ */
+template<int L>
+static void batchedKernel(const double* x, const double* y, int nx, int ny, int window_size,
+                          int p, int diag_weight, const double* bounds, RowSweep sweep,
+                          double* costs, DTWWorkspace& workspace)
+{
+    int width = (ny + 1) * L;
+
+    // two rows, column 0 is the boundary
+    double* prev = workspace.costs(2 * width);
+    double* cur = prev + width;
+    std::fill(prev, prev + 2 * width, INF);
+
+    // columns written in the row that 'cur' holds, they must be reset before it is reused
+    int written[2][2] = { { 1, 0 }, { 1, 0 } };
+
+    alignas(64) double row_min[L];
+
+    TSDIST_STATS_ONLY(long long cells = 0;)
+
+    for (int i = 1; i <= nx; i++)
+    {
+        int j1, j2;
+        windowLimits(i, nx, ny, window_size, j1, j2);
+
+        // cells that the window left out, but that the row held two rows ago
+        int* w = written[i % 2];
+        for (int j = w[0]; j <= std::min(w[1], j1 - 1); j++)
+            for (int l = 0; l < L; l++) cur[j * L + l] = INF;
+
+        const double* xi = x + (std::size_t) (i - 1) * L;
+        std::fill(row_min, row_min + L, INF);
+
+        int j = j1;
+
+        // very first value is always set, even if the window would exclude it
+        if (i == 1) {
+            for (int l = 0; l < L; l++) {
+                double diff = xi[l] - y[0];
+                cur[L + l] = p == 1 ? std::abs(diff) : diff * diff;
+                row_min[l] = cur[L + l];
+            }
+
+            j1 = 1;
+            j = std::max(j, 2);
+        }
+
+        if (j <= j2)
+            sweep(xi, y, prev, cur, j, j2, diag_weight, row_min);
+
+        w[0] = j1;
+        w[1] = j2;
+
+        TSDIST_STATS_ONLY(cells += std::max(0, j2 - j + 1) + (i == 1);)
+
+        // early abandoning, once every lane is dead
+        bool alive = false;
+        for (int l = 0; l < L; l++) alive = alive || row_min[l] <= bounds[l];
+
+        if (!alive) {
+            TSDIST_STATS_ONLY(for (int l = 0; l < L; l++) {
+                if (bounds[l] >= 0) recordDTW(workspace, cells, windowCells(nx, ny, window_size),
+                                              true);
+            })
+
+            std::fill(costs, costs + L, INF);
+            return;
+        }
+
+        std::swap(prev, cur);
+    }
+
+    for (int l = 0; l < L; l++) {
+        costs[l] = prev[ny * L + l];
+
+        TSDIST_STATS_ONLY(if (bounds[l] >= 0) {
+            recordDTW(workspace, cells, windowCells(nx, ny, window_size), costs[l] > bounds[l]);
+        })
+    }
+}
+
+// Groups of L candidates through the kernel
+template<int L, typename T>
+static void batchedGroups(const TimeSeriesView<T>& query, const TimeSeriesView<T>* candidates,
+                          int count, int window_size, int p, int diag_weight,
+                          const double* upper_bounds, double* distances, RowSweep sweep,
+                          DTWWorkspace& workspace)
+{
+    int nx = candidates[0].length();
+    int ny = query.length();
+
+    // interleaved candidates, then the query
+    double* x = workspace.series((std::size_t) nx * L + ny);
+    double* y = x + (std::size_t) nx * L;
+    for (int j = 0; j < ny; j++) y[j] = query[j][0];
+
+    alignas(64) double bounds[L];
+    alignas(64) double costs[L];
+
+    for (int begin = 0; begin < count; begin += L)
+    {
+        int size = std::min(L, count - begin);
+
+        for (int l = 0; l < L; l++)
+        {
+            // unused lanes repeat the first candidate, but they are dead from the start
+            const TimeSeriesView<T>& candidate = candidates[begin + (l < size ? l : 0)];
+
+            for (int i = 0; i < nx; i++)
+                x[(std::size_t) i * L + l] = candidate[i][0];
+
+            double bound = upper_bounds ? upper_bounds[begin + (l < size ? l : 0)] : INF;
+            bound = std::pow(bound, p);
+            bounds[l] = l < size ? bound + bound * BOUND_SLACK : -1;
+        }
+
+        batchedKernel<L>(x, y, nx, ny, window_size, p, diag_weight, bounds, sweep, costs,
+                         workspace);
+
+        for (int l = 0; l < size; l++)
+        {
+            double bound = upper_bounds ? upper_bounds[begin + l] : INF;
+            double distance = std::pow(costs[l], 1.0 / p);
+            distances[begin + l] = distance <= bound ? distance : INF;
+        }
+    }
+}
+
+// ================================================================================================
+/* DTW distances of a batch of candidates */
+// ================================================================================================
+int batchedDTWLanes()
+{
+    return lanesOf(detectSimdLevel());
+}
+
+template<typename T>
+void computeBatchedDTW(const TimeSeriesView<T>* candidates, int count,
+                       const TimeSeriesView<T>& query,
+                       int window_size, int p, int diag_weight,
+                       const double* upper_bounds, double* distances,
+                       DTWWorkspace& workspace)
+{
+    if (count <= 0) return;
+
+    for (int k = 0; k < count; k++)
+    {
+        checkDTWParameters(candidates[k], query, p, diag_weight);
+
+        if (candidates[k].length() != candidates[0].length())
+            throw("Length mismatch between the candidates.");
+    }
+
+    SimdLevel level = detectSimdLevel();
+    int lanes = lanesOf(level);
+
+    // the lanes only pay off if they are not mostly empty
+    if (query.numVars() != 1 || (p != 1 && p != 2) || lanes == 1 || count < lanes / 2)
+    {
+        for (int k = 0; k < count; k++)
+        {
+            double bound = upper_bounds ? upper_bounds[k] : INF;
+            distances[k] = computePrunedDTW(candidates[k], query, window_size, p, diag_weight,
+                                            bound, workspace);
+        }
+
+        return;
+    }
+
+    RowSweep sweep = (p == 1) ? selectSweep<1>(level) : selectSweep<2>(level);
+
+    if (lanes == 8)
+        batchedGroups<8>(query, candidates, count, window_size, p, diag_weight, upper_bounds,
+                         distances, sweep, workspace);
+    else if (lanes == 4)
+        batchedGroups<4>(query, candidates, count, window_size, p, diag_weight, upper_bounds,
+                         distances, sweep, workspace);
+    else
+        batchedGroups<2>(query, candidates, count, window_size, p, diag_weight, upper_bounds,
+                         distances, sweep, workspace);
+}
+
+template<typename T>
+void computeBatchedDTW(const TimeSeriesView<T>* candidates, int count,
+                       const TimeSeriesView<T>& query,
+                       int window_size, int p, int diag_weight,
+                       const double* upper_bounds, double* distances)
+{
+    DTWWorkspace workspace;
+    computeBatchedDTW(candidates, count, query, window_size, p, diag_weight, upper_bounds,
+                      distances, workspace);
+}
+
+// ================================================================================================
+/* Explicit instantiations */
+// ================================================================================================
+template void computeBatchedDTW(const TimeSeriesView<double>*, int, const TimeSeriesView<double>&,
+                                int, int, int,
+                                const double*, double*);
+template void computeBatchedDTW(const TimeSeriesView<double>*, int, const TimeSeriesView<double>&,
+                                int, int, int,
+                                const double*, double*,
+                                DTWWorkspace&);
+
+template void computeBatchedDTW(const TimeSeriesView<float>*, int, const TimeSeriesView<float>&,
+                                int, int, int,
+                                const double*, double*);
+template void computeBatchedDTW(const TimeSeriesView<float>*, int, const TimeSeriesView<float>&,
+                                int, int, int,
+                                const double*, double*,
+                                DTWWorkspace&);
+
+}
@@ -0,0 +1,132 @@
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include "ts.h"
+#include "datasets.h"
+
+namespace TSdist {
+
+// ================================================================================================
+/* Dataset */
+// ================================================================================================
+void Dataset::add(const TimeSeriesView<double>& series, double label)
+{
+    _entries.push_back(Entry{ _values.size(), series.length(), series.numVars(), label });
+
+    for (int i = 0; i < series.length(); i++)
+        for (int k = 0; k < series.numVars(); k++)
+            _values.push_back(series[i][k]);
+}
+
+std::vector<TimeSeriesView<double>> Dataset::views() const
+{
+    std::vector<TimeSeriesView<double>> result;
+    result.reserve(size());
+
+    for (int k = 0; k < size(); k++) result.push_back(view(k));
+    return result;
+}
+
+// ================================================================================================
+/* Random walks */
+// ================================================================================================
+Dataset randomWalkDataset(int size, int length, int num_vars, unsigned seed)
+{
+    if (size < 0)
+        throw("Number of series cannot be negative.");
+
+    if (length < 1 || num_vars < 1)
+        throw("Series cannot be empty.");
+
+    std::mt19937 generator(seed);
+    std::normal_distribution<double> step(0, 1);
+
+    Dataset dataset;
+    std::vector<double> series((std::size_t) length * num_vars);
+
+    for (int s = 0; s < size; s++)
+    {
+        for (int k = 0; k < num_vars; k++)
+        {
+            double value = 0;
+
+            for (int i = 0; i < length; i++)
+            {
+                value += step(generator);
+                series[(std::size_t) i * num_vars + k] = value;
+            }
+        }
+
+        dataset.add(TimeSeriesView<double>(series.data(), length, num_vars), 0);
+    }
+
+    return dataset;
+}
+
+// ================================================================================================
+/* UCR archive */
+// ================================================================================================
+
+// Whether c separates values in a line of the archive
+static bool isSeparator(char c)
+{
+    return c == ',' || c == ' ' || c == '\t' || c == '\r';
+}
+
+// All numbers in 'line', NaN included
+static std::vector<double> parseLine(const std::string& line)
+{
+    std::vector<double> values;
+    const char* c = line.c_str();
+
+    while (true)
+    {
+        while (isSeparator(*c)) c++;
+        if (*c == '\0') break;
+
+        char* end;
+        double value = std::strtod(c, &end);
+
+        if (end == c)
+            throw("Invalid value in the dataset.");
+
+        values.push_back(value);
+        c = end;
+    }
+
+    return values;
+}
+
+Dataset loadUCRDataset(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+        throw("Could not open file.");
+
+    Dataset dataset;
+    std::string line;
+
+    while (std::getline(file, line))
+    {
+        std::vector<double> values = parseLine(line);
+        if (values.empty()) continue;
+
+        // padding of the shorter series
+        while (values.size() > 1 && std::isnan(values.back())) values.pop_back();
+
+        if (values.size() < 2)
+            throw("Series cannot be empty.");
+
+        dataset.add(TimeSeriesView<double>(values.data() + 1, values.size() - 1), values[0]);
+    }
+
+    if (file.bad())
+        throw("Could not read file.");
+
+    return dataset;
+}
+
+}
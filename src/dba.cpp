@@ -0,0 +1,138 @@
+#include <algorithm> // std::min, std::max, std::fill
+#include <cstddef>
+#include <vector>
+#include "ts.h"
+#include "dba.h"
+#include "parallel.h"
+#include "workspace.h"
+#include "kernels.h"
+#include "backtrack.h"
+
+namespace TSdist {
+
+// ================================================================================================
+/* DTW Barycenter Averaging */
+// ================================================================================================
+
+// Sums of the observations aligned to each observation of the average, and how many they are
+struct DBAAccumulator
+{
+    std::vector<double> sums;
+    std::vector<int> counts;
+};
+
+template<typename T>
+std::vector<T> dbaAverage(const std::vector<TimeSeriesView<T>>& series,
+                          const TimeSeriesView<T>& init, int iterations,
+                          int window_size, int p, int diag_weight, int num_threads)
+{
+    if (series.empty())
+        throw("Cannot average an empty set of series.");
+
+    if (init.length() < 1)
+        throw("Series cannot be empty.");
+
+    if (iterations < 0)
+        throw("Number of iterations cannot be negative.");
+
+    for (const TimeSeriesView<T>& x : series) {
+        checkDTWParameters(x, init, p, diag_weight);
+
+        if (x.length() < 1)
+            throw("Series cannot be empty.");
+    }
+
+    int size = series.size();
+    int length = init.length();
+    int num_vars = init.numVars();
+    std::size_t values = (std::size_t) length * num_vars;
+
+    std::vector<T> average(values);
+    for (int j = 0; j < length; j++)
+        for (int k = 0; k < num_vars; k++)
+            average[(std::size_t) j * num_vars + k] = init[j][k];
+
+    if (num_threads <= 0) num_threads = defaultNumThreads();
+    num_threads = std::max(1, std::min(num_threads, size));
+
+    // allocated once for all iterations
+    std::vector<DTWWorkspace> workspaces(num_threads);
+    std::vector<DBAAccumulator> accumulators(num_threads);
+
+    for (DBAAccumulator& accumulator : accumulators) {
+        accumulator.sums.resize(values);
+        accumulator.counts.resize(length);
+    }
+
+    for (int iteration = 0; iteration < iterations; iteration++)
+    {
+        TimeSeriesView<T> y(average.data(), length, num_vars);
+
+        runThreads(num_threads, [&](int thread) {
+            DBAAccumulator& accumulator = accumulators[thread];
+            std::fill(accumulator.sums.begin(), accumulator.sums.end(), 0.0);
+            std::fill(accumulator.counts.begin(), accumulator.counts.end(), 0);
+
+            double* sums = accumulator.sums.data();
+            int* counts = accumulator.counts.data();
+
+            // contiguous part of the series, so that the order of the sums is fixed
+            int begin = (std::size_t) size * thread / num_threads;
+            int end = (std::size_t) size * (thread + 1) / num_threads;
+
+            for (int m = begin; m < end; m++)
+            {
+                const TimeSeriesView<T>& x = series[m];
+
+                auto accumulate = [&](int i, int j) {
+                    double* sum = sums + (std::size_t) j * num_vars;
+                    for (int k = 0; k < num_vars; k++) sum[k] += x[i][k];
+                    counts[j]++;
+                };
+
+                PathTracer<TimeSeriesView<T>, decltype(accumulate)> tracer(
+                    x, y, window_size, p, diag_weight, accumulate, workspaces[thread]);
+                tracer.trace();
+            }
+        });
+
+        // merge in thread order
+        DBAAccumulator& total = accumulators[0];
+
+        for (int t = 1; t < num_threads; t++) {
+            for (std::size_t v = 0; v < values; v++) total.sums[v] += accumulators[t].sums[v];
+            for (int j = 0; j < length; j++) total.counts[j] += accumulators[t].counts[j];
+        }
+
+        bool changed = false;
+
+        /*
+         * Every observation of the average is on every path, so counts are positive. A window
+         * that leaves some series without a path has already thrown from PathTracer.
+         */
+        for (int j = 0; j < length; j++)
+            for (int k = 0; k < num_vars; k++)
+            {
+                std::size_t v = (std::size_t) j * num_vars + k;
+                T value = total.sums[v] / total.counts[j];
+
+                changed |= value != average[v];
+                average[v] = value;
+            }
+
+        if (!changed) break;
+    }
+
+    return average;
+}
+
+// ================================================================================================
+/* Explicit instantiations */
+// ================================================================================================
+template std::vector<double> dbaAverage(const std::vector<TimeSeriesView<double>>&,
+                                        const TimeSeriesView<double>&, int, int, int, int, int);
+
+template std::vector<float> dbaAverage(const std::vector<TimeSeriesView<float>>&,
+                                       const TimeSeriesView<float>&, int, int, int, int, int);
+
+}
@@ -4,266 +4,335 @@
 #include <vector>
 #include "ts.h"
 #include "dtw.h"
+#include "simd.h"
+#include "workspace.h"
+#include "kernels.h"
+#include "patterns.h"
+#include "backtrack.h"
+#include "stats.h"
 
 namespace TSdist {
 
-static const double NOT_VISITED = -1;
-static const int STEP_DIAG = 0;
-static const int STEP_LEFT = 1;
-static const int STEP_UP = 2;
-static const double DBL_MAX = std::numeric_limits<double>::max();
-
 // ================================================================================================
-/* Lp Norm */
+/* DTW distance */
 // ================================================================================================
-double lnorm(const TimeSeriesBase& x, const TimeSeriesBase& y,
-             int p, int time_x, int time_y)
+template<typename Series>
+static double dtwKernel(const Series& x, const Series& y, int window_size, int p, int diag_weight,
+                        DTWWorkspace& workspace)
+{
+    // specialized for p and the step pattern, see patterns.h
+    StepPattern pattern = diag_weight == 1 ? StepPattern::Symmetric1 : StepPattern::Symmetric2;
+    return dispatchDTW(x, y, pattern, WindowType::SakoeChiba, window_size, p, workspace);
+}
+
+template<typename T>
+double computeDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                  int window_size, int p, int diag_weight,
+                  DTWWorkspace& workspace)
 {
-    double result = 0;
+    checkDTWParameters(x, y, p, diag_weight);
 
-    for (int k = 0; k < x.numVars(); k++) {
-        result += std::abs(std::pow(x[time_x][k] - y[time_y][k], p));
+    // the anti-diagonal kernel gives the same results, but it only pays off for long series
+    if (x.numVars() == 1 && (p == 1 || p == 2) &&
+        x.length() >= WAVEFRONT_MIN_LENGTH && y.length() >= WAVEFRONT_MIN_LENGTH &&
+        detectSimdLevel() != SimdLevel::Scalar)
+    {
+        return computeWavefrontDTW(x, y, window_size, p, diag_weight, workspace);
     }
 
-    return std::pow(result, 1.0 / p);
+    return dtwKernel(x, y, window_size, p, diag_weight, workspace);
 }
 
-// ================================================================================================
-/* Which direction to take when traversing CM */
-// ================================================================================================
-int which_direction(double (&tpl)[3], double diag, double left, double up,
-                    double diag_weight, double local_cost)
+template<typename T>
+double computeDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                  int window_size, int p, int diag_weight)
 {
-    tpl[STEP_DIAG] = (diag == NOT_VISITED) ? DBL_MAX : diag + diag_weight * local_cost;
-    tpl[STEP_LEFT] = (left == NOT_VISITED) ? DBL_MAX : left + local_cost;
-    tpl[STEP_UP] = (up == NOT_VISITED) ? DBL_MAX : up + local_cost;
+    DTWWorkspace workspace;
+    return computeDTW(x, y, window_size, p, diag_weight, workspace);
+}
 
-    // which direction has the least associated cost?
-    int direction = (tpl[STEP_LEFT] < tpl[STEP_DIAG]) ? STEP_LEFT : STEP_DIAG;
-    direction = (tpl[STEP_UP] < tpl[direction]) ? STEP_UP : direction;
+double computeDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                  int window_size, int p, int diag_weight,
+                  DTWWorkspace& workspace)
+{
+    if (isContiguous(x) && isContiguous(y))
+        return computeDTW(viewOf(x), viewOf(y), window_size, p, diag_weight, workspace);
 
-    return direction;
+    checkDTWParameters(x, y, p, diag_weight);
+    return dtwKernel(x, y, window_size, p, diag_weight, workspace);
 }
 
-// ================================================================================================
-/* DTW distance */
-// ================================================================================================
 double computeDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
                   int window_size, int p, int diag_weight)
 {
-    if (x.numVars() != y.numVars())
-        throw("Series must have the same number of variables.");
-
-    if (p < 1)
-        throw("Parameter p must be positive.");
-
-    if (diag_weight != 1 && diag_weight != 2)
-        throw("Diagonal weight can only be 1 or 2.");
-
-    int nx = x.length();
-    int ny = y.length();
+    DTWWorkspace workspace;
+    return computeDTW(x, y, window_size, p, diag_weight, workspace);
+}
 
-    // local/global cost matrix, only 2 rows to implement memory-saving version
-    double CM[2][ny + 1];
-    // possible directions to take when traversing CM
-    double tuple_direction[3];
+// ================================================================================================
+/* DTW distance with step patterns and windows */
+// ================================================================================================
+template<typename T>
+double computeDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                  StepPattern pattern, WindowType window, int window_size, int p,
+                  DTWWorkspace& workspace)
+{
+    // the patterns of the other overload can still use the anti-diagonal kernel
+    if (pattern == StepPattern::Symmetric1 &&
+        (window == WindowType::None || window == WindowType::SakoeChiba))
+    {
+        return computeDTW(x, y, window == WindowType::None ? 0 : window_size, p, 1, workspace);
+    }
 
-    int i, j, direction;
-    double local_cost;
+    if (pattern == StepPattern::Symmetric2 &&
+        (window == WindowType::None || window == WindowType::SakoeChiba))
+    {
+        return computeDTW(x, y, window == WindowType::None ? 0 : window_size, p, 2, workspace);
+    }
 
-    // initialization of first row and first column
-    for (j = 0; j <= ny; j++) CM[0][j] = NOT_VISITED;
-    CM[1][0] = NOT_VISITED;
+    checkDTWParameters(x, y, p, 1);
+    return dispatchDTW(x, y, pattern, window, window_size, p, workspace);
+}
 
-    // first value, must set here to avoid multiplying by step
-    CM[1][1] = std::pow(lnorm(x, y, p, 0, 0), p);
+template<typename T>
+double computeDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                  StepPattern pattern, WindowType window, int window_size, int p)
+{
+    DTWWorkspace workspace;
+    return computeDTW(x, y, pattern, window, window_size, p, workspace);
+}
 
-    // dynamic programming
-    for (i = 1; i <= nx; i++)
-    {
-        int j1, j2;
-
-        // adjust limits depending on window
-        if (window_size < 1) {
-            j1 = 1;
-            j2 = ny;
-
-        } else {
-            j1 = std::ceil((double) i * ny / nx - window_size);
-            j2 = std::floor((double) i * ny / nx + window_size);
-
-            j1 = j1 > 1 ? j1 : 1;
-            j2 = j2 < ny ? j2 : ny;
-        }
-
-        for (j = 1; j <= ny; j++)
-        {
-            // very first value already set above
-            if (i == 1 && j == 1) continue;
-
-            if (j < j1 || j > j2) {
-                // cell outside of window
-                CM[i % 2][j] = NOT_VISITED;
-                continue;
-            }
-
-            // l-norm for single time-point, p only affects multivariate series
-            local_cost = std::pow(lnorm(x, y, p, i-1, j-1), p);
-
-            // which direction has the least associated cost?
-            direction = which_direction(tuple_direction,
-                                        CM[(i - 1) % 2][j - 1],
-                                        CM[i % 2][j - 1],
-                                        CM[(i - 1) % 2][j],
-                                        diag_weight,
-                                        local_cost);
-
-            CM[i % 2][j] = tuple_direction[direction];
-        }
-    }
+double computeDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                  StepPattern pattern, WindowType window, int window_size, int p,
+                  DTWWorkspace& workspace)
+{
+    if (isContiguous(x) && isContiguous(y))
+        return computeDTW(viewOf(x), viewOf(y), pattern, window, window_size, p, workspace);
 
-    // calculate p-root on the very last value
-    return std::pow(CM[nx % 2][ny], 1.0 / p);
+    checkDTWParameters(x, y, p, 1);
+    return dispatchDTW(x, y, pattern, window, window_size, p, workspace);
 }
 
-// ================================================================================================
-/* Normalized DTW distance */
-// ================================================================================================
-double computeNormalizedDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
-                            int window_size, int p)
+double computeDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                  StepPattern pattern, WindowType window, int window_size, int p)
 {
-    return computeDTW(x, y, window_size, p, 2) / (x.length() + y.length());
+    DTWWorkspace workspace;
+    return computeDTW(x, y, pattern, window, window_size, p, workspace);
 }
 
 // ================================================================================================
-/* DTW distance with backtracking */
+/* Independent DTW distance */
 // ================================================================================================
-double backtrackDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
-                    int window_size, int p, int diag_weight,
-                    std::vector<int>& idx, std::vector<int>& idy)
+
+// One variable of a series, seen as a univariate series
+class VariableSeries : public TimeSeriesBase
 {
-    if (x.numVars() != y.numVars())
-        throw("Series must have the same number of variables.");
+public:
+    VariableSeries(const TimeSeriesBase& x, int var_index) : _x(x), _var_index(var_index) { }
 
-    if (p < 1)
-        throw("Parameter p must be positive.");
+    int numVars() const override { return 1; }
+    int length() const override { return _x.length(); }
 
-    if (diag_weight != 1 && diag_weight != 2)
-        throw("Diagonal weight can only be 1 or 2.");
+    const double& indexSeries(int time_index, int) const override {
+        return _x.indexSeries(time_index, _var_index);
+    }
 
-    // make sure indices are empty initially
-    idx.clear();
-    idy.clear();
+    double& indexSeries(int, int) override {
+        throw("Series is read-only.");
+    }
+
+private:
+    const TimeSeriesBase& _x;
+    int _var_index;
+};
+
+template<typename T>
+double computeIndependentDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                             int window_size, int p, int diag_weight,
+                             DTWWorkspace& workspace)
+{
+    checkDTWParameters(x, y, p, diag_weight);
+
+    double distance = 0;
+
+    // strided views of each variable, so long series still get the anti-diagonal kernel
+    for (int k = 0; k < x.numVars(); k++)
+    {
+        TimeSeriesView<T> xk(x.data() + k, x.length(), 1, x.stride());
+        TimeSeriesView<T> yk(y.data() + k, y.length(), 1, y.stride());
+        distance += std::pow(computeDTW(xk, yk, window_size, p, diag_weight, workspace), p);
+    }
 
-    int nx = x.length();
-    int ny = y.length();
+    return std::pow(distance, 1.0 / p);
+}
 
-    // local/global cost matrix
-    double CM[nx + 1][ny + 1];
-    // possible directions to take when traversing CM
-    double tuple_direction[3];
+template<typename T>
+double computeIndependentDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                             int window_size, int p, int diag_weight)
+{
+    DTWWorkspace workspace;
+    return computeIndependentDTW(x, y, window_size, p, diag_weight, workspace);
+}
 
-    int i, j, direction;
-    double local_cost;
+double computeIndependentDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                             int window_size, int p, int diag_weight,
+                             DTWWorkspace& workspace)
+{
+    if (isContiguous(x) && isContiguous(y))
+        return computeIndependentDTW(viewOf(x), viewOf(y), window_size, p, diag_weight, workspace);
 
-    // initialization of first row and first column
-    for (i = 0; i <= nx; i++) CM[i][0] = NOT_VISITED;
-    for (j = 1; j <= ny; j++) CM[0][j] = NOT_VISITED;
+    checkDTWParameters(x, y, p, diag_weight);
 
-    // first value, must set here to avoid multiplying by step
-    CM[1][1] = std::pow(lnorm(x, y, p, 0, 0), p);
+    double distance = 0;
 
-    // dynamic programming
-    for (i = 1; i <= nx; i++)
+    for (int k = 0; k < x.numVars(); k++)
     {
-        int j1, j2;
-
-        // adjust limits depending on window
-        if (window_size < 1) {
-            j1 = 1;
-            j2 = ny;
-
-        } else {
-            j1 = std::ceil((double) i * ny / nx - window_size);
-            j2 = std::floor((double) i * ny / nx + window_size);
-
-            j1 = j1 > 1 ? j1 : 1;
-            j2 = j2 < ny ? j2 : ny;
-        }
-
-        for (j = 1; j <= ny; j++)
-        {
-            // very first value already set above
-            if (i == 1 && j == 1) continue;
-
-            if (j < j1 || j > j2) {
-                // cell outside of window
-                CM[i][j] = NOT_VISITED;
-                continue;
-            }
-
-            // l-norm for single time-point, p only affects multivariate series
-            local_cost = std::pow(lnorm(x, y, p, i-1, j-1), p);
-
-            // which direction has the least associated cost?
-            direction = which_direction(tuple_direction,
-                                        CM[i - 1][j - 1],
-                                        CM[i][j - 1],
-                                        CM[i - 1][j],
-                                        diag_weight,
-                                        local_cost);
-
-            /*
-             * I can use the same matrix to save both cost values and steps taken by shifting
-             * the indices left and up for direction. Since the loop advances row-wise, the
-             * appropriate values for the cost will be available, and the unnecessary ones are
-             * replaced by steps along the way.
-             */
-
-            CM[i][j] = tuple_direction[direction];
-            CM[i - 1][j - 1] = (double) direction;
-        }
+        VariableSeries xk(x, k), yk(y, k);
+        distance += std::pow(dtwKernel(xk, yk, window_size, p, diag_weight, workspace), p);
     }
 
-    // backtracking loop, always start at end of series
-    i = nx - 1;
-    j = ny - 1;
-    idx.push_back(i);
-    idy.push_back(j);
+    return std::pow(distance, 1.0 / p);
+}
+
+double computeIndependentDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                             int window_size, int p, int diag_weight)
+{
+    DTWWorkspace workspace;
+    return computeIndependentDTW(x, y, window_size, p, diag_weight, workspace);
+}
+
+// ================================================================================================
+/* Normalized DTW distance */
+// ================================================================================================
+template<typename T>
+double computeNormalizedDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                            int window_size, int p,
+                            DTWWorkspace& workspace)
+{
+    return computeDTW(x, y, window_size, p, 2, workspace) / (x.length() + y.length());
+}
 
-    while(!(i == 0 && j == 0)) {
-        // re-use as temporary value
-        local_cost = CM[i][j];
+template<typename T>
+double computeNormalizedDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                            int window_size, int p)
+{
+    return computeDTW(x, y, window_size, p, 2) / (x.length() + y.length());
+}
 
-        if (local_cost == (double) STEP_DIAG) {
-            i--;
-            j--;
+double computeNormalizedDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                            int window_size, int p,
+                            DTWWorkspace& workspace)
+{
+    return computeDTW(x, y, window_size, p, 2, workspace) / (x.length() + y.length());
+}
 
-        } else if (local_cost == (double) STEP_LEFT) {
-            j--;
+double computeNormalizedDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                            int window_size, int p)
+{
+    return computeDTW(x, y, window_size, p, 2) / (x.length() + y.length());
+}
 
-        } else if (local_cost == (double) STEP_UP) {
-            i--;
+// ================================================================================================
+/* DTW distance with backtracking */
+// ================================================================================================
 
-        } else {
-            throw("Invalid direction matrix computed.");
-        }
+template<typename Series>
+static double backtrackKernel(const Series& x, const Series& y,
+                              int window_size, int p, int diag_weight,
+                              std::vector<int>& idx, std::vector<int>& idy,
+                              DTWWorkspace& workspace)
+{
+    // make sure indices are empty initially
+    idx.clear();
+    idy.clear();
 
+    auto append = [&](int i, int j) {
         idx.push_back(i);
         idy.push_back(j);
-    }
+    };
+
+    PathTracer<Series, decltype(append)> tracer(x, y, window_size, p, diag_weight, append,
+                                                workspace);
+    double cost = tracer.trace();
 
     // adjust order
     std::reverse(idx.begin(), idx.end());
     std::reverse(idy.begin(), idy.end());
 
     // calculate p-root on the very last value
-    return std::pow(CM[nx][ny], 1.0 / p);
+    return std::pow(cost, 1.0 / p);
+}
+
+template<typename T>
+double backtrackDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                    int window_size, int p, int diag_weight,
+                    std::vector<int>& idx, std::vector<int>& idy,
+                    DTWWorkspace& workspace)
+{
+    checkDTWParameters(x, y, p, diag_weight);
+    return backtrackKernel(x, y, window_size, p, diag_weight, idx, idy, workspace);
+}
+
+template<typename T>
+double backtrackDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                    int window_size, int p, int diag_weight,
+                    std::vector<int>& idx, std::vector<int>& idy)
+{
+    DTWWorkspace workspace;
+    return backtrackDTW(x, y, window_size, p, diag_weight, idx, idy, workspace);
+}
+
+double backtrackDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                    int window_size, int p, int diag_weight,
+                    std::vector<int>& idx, std::vector<int>& idy,
+                    DTWWorkspace& workspace)
+{
+    if (isContiguous(x) && isContiguous(y))
+        return backtrackDTW(viewOf(x), viewOf(y), window_size, p, diag_weight, idx, idy,
+                            workspace);
+
+    checkDTWParameters(x, y, p, diag_weight);
+    return backtrackKernel(x, y, window_size, p, diag_weight, idx, idy, workspace);
+}
+
+double backtrackDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                    int window_size, int p, int diag_weight,
+                    std::vector<int>& idx, std::vector<int>& idy)
+{
+    DTWWorkspace workspace;
+    return backtrackDTW(x, y, window_size, p, diag_weight, idx, idy, workspace);
 }
 
 // ================================================================================================
 /* Normalized DTW distance with backtracking */
 // ================================================================================================
+template<typename T>
+double backtrackNormalizedDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                              int window_size, int p,
+                              std::vector<int>& idx, std::vector<int>& idy,
+                              DTWWorkspace& workspace)
+{
+    return backtrackDTW(x, y, window_size, p, 2, idx, idy, workspace) /
+        (x.length() + y.length());
+}
+
+template<typename T>
+double backtrackNormalizedDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                              int window_size, int p,
+                              std::vector<int>& idx, std::vector<int>& idy)
+{
+    return backtrackDTW(x, y, window_size, p, 2, idx, idy) / (x.length() + y.length());
+}
+
+double backtrackNormalizedDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                              int window_size, int p,
+                              std::vector<int>& idx, std::vector<int>& idy,
+                              DTWWorkspace& workspace)
+{
+    return backtrackDTW(x, y, window_size, p, 2, idx, idy, workspace) /
+        (x.length() + y.length());
+}
+
 double backtrackNormalizedDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
                               int window_size, int p,
                               std::vector<int>& idx, std::vector<int>& idy)
@@ -271,4 +340,89 @@ double backtrackNormalizedDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
     return backtrackDTW(x, y, window_size, p, 2, idx, idy) / (x.length() + y.length());
 }
 
+// ================================================================================================
+/* Explicit instantiations */
+// ================================================================================================
+template double computeDTW(const TimeSeriesView<double>&, const TimeSeriesView<double>&,
+                           int, int, int);
+template double computeDTW(const TimeSeriesView<double>&, const TimeSeriesView<double>&,
+                           int, int, int,
+                           DTWWorkspace&);
+template double computeDTW(const TimeSeriesView<double>&, const TimeSeriesView<double>&,
+                           StepPattern, WindowType, int, int);
+template double computeDTW(const TimeSeriesView<double>&, const TimeSeriesView<double>&,
+                           StepPattern, WindowType, int, int,
+                           DTWWorkspace&);
+template double computeIndependentDTW(const TimeSeriesView<double>&,
+                                      const TimeSeriesView<double>&,
+                                      int, int, int);
+template double computeIndependentDTW(const TimeSeriesView<double>&,
+                                      const TimeSeriesView<double>&,
+                                      int, int, int,
+                                      DTWWorkspace&);
+template double computeNormalizedDTW(const TimeSeriesView<double>&,
+                                     const TimeSeriesView<double>&,
+                                     int, int);
+template double computeNormalizedDTW(const TimeSeriesView<double>&,
+                                     const TimeSeriesView<double>&,
+                                     int, int,
+                                     DTWWorkspace&);
+template double backtrackDTW(const TimeSeriesView<double>&, const TimeSeriesView<double>&,
+                             int, int, int,
+                             std::vector<int>&, std::vector<int>&);
+template double backtrackDTW(const TimeSeriesView<double>&, const TimeSeriesView<double>&,
+                             int, int, int,
+                             std::vector<int>&, std::vector<int>&,
+                             DTWWorkspace&);
+template double backtrackNormalizedDTW(const TimeSeriesView<double>&,
+                                       const TimeSeriesView<double>&,
+                                       int, int,
+                                       std::vector<int>&, std::vector<int>&);
+template double backtrackNormalizedDTW(const TimeSeriesView<double>&,
+                                       const TimeSeriesView<double>&,
+                                       int, int,
+                                       std::vector<int>&, std::vector<int>&,
+                                       DTWWorkspace&);
+
+template double computeDTW(const TimeSeriesView<float>&, const TimeSeriesView<float>&,
+                           int, int, int);
+template double computeDTW(const TimeSeriesView<float>&, const TimeSeriesView<float>&,
+                           int, int, int,
+                           DTWWorkspace&);
+template double computeDTW(const TimeSeriesView<float>&, const TimeSeriesView<float>&,
+                           StepPattern, WindowType, int, int);
+template double computeDTW(const TimeSeriesView<float>&, const TimeSeriesView<float>&,
+                           StepPattern, WindowType, int, int,
+                           DTWWorkspace&);
+template double computeIndependentDTW(const TimeSeriesView<float>&,
+                                      const TimeSeriesView<float>&,
+                                      int, int, int);
+template double computeIndependentDTW(const TimeSeriesView<float>&,
+                                      const TimeSeriesView<float>&,
+                                      int, int, int,
+                                      DTWWorkspace&);
+template double computeNormalizedDTW(const TimeSeriesView<float>&,
+                                     const TimeSeriesView<float>&,
+                                     int, int);
+template double computeNormalizedDTW(const TimeSeriesView<float>&,
+                                     const TimeSeriesView<float>&,
+                                     int, int,
+                                     DTWWorkspace&);
+template double backtrackDTW(const TimeSeriesView<float>&, const TimeSeriesView<float>&,
+                             int, int, int,
+                             std::vector<int>&, std::vector<int>&);
+template double backtrackDTW(const TimeSeriesView<float>&, const TimeSeriesView<float>&,
+                             int, int, int,
+                             std::vector<int>&, std::vector<int>&,
+                             DTWWorkspace&);
+template double backtrackNormalizedDTW(const TimeSeriesView<float>&,
+                                       const TimeSeriesView<float>&,
+                                       int, int,
+                                       std::vector<int>&, std::vector<int>&);
+template double backtrackNormalizedDTW(const TimeSeriesView<float>&,
+                                       const TimeSeriesView<float>&,
+                                       int, int,
+                                       std::vector<int>&, std::vector<int>&,
+                                       DTWWorkspace&);
+
 }
@@ -0,0 +1,424 @@
+#include <algorithm> // std::min, std::max, std::fill, std::reverse
+#include <cmath>
+#include <vector>
+#include "ts.h"
+#include "dtw.h"
+#include "lb.h"
+#include "fastdtw.h"
+#include "workspace.h"
+#include "kernels.h"
+#include "stats.h"
+
+namespace TSdist {
+
+// ================================================================================================
+/* Constrained DTW */
+// ================================================================================================
+
+/*
+ * DTW with backtracking restricted to cells [lo[i], hi[i]] of each row i (0-based), which must
+ * be non-decreasing in i. Same recurrence as backtrackDTW, one byte of direction per cell.
+ * Returns the p-th power of the distance.
+ */
+static double windowedDTW(const TimeSeriesView<double>& x, const TimeSeriesView<double>& y,
+                          const int* lo, const int* hi, int p, int diag_weight,
+                          std::vector<int>& idx, std::vector<int>& idy,
+                          DTWWorkspace& workspace)
+{
+    int nx = x.length();
+    int ny = y.length();
+
+    std::size_t cells = 0;
+    for (int i = 0; i < nx; i++) cells += hi[i] - lo[i] + 1;
+
+    double* CM[2];
+    CM[0] = workspace.costs(2 * (ny + 1));
+    CM[1] = CM[0] + ny + 1;
+    std::fill(CM[0], CM[0] + 2 * (ny + 1), NOT_VISITED);
+
+    // directions of row i start at the sum of the widths of the previous rows
+    unsigned char* DM = workspace.directions(cells);
+    double tuple_direction[3];
+    std::size_t offset = 0;
+
+    // dynamic programming, with 1-based columns like in dtw.cpp
+    for (int i = 1; i <= nx; i++)
+    {
+        const double* prev = CM[(i - 1) % 2];
+        double* cur = CM[i % 2];
+        int j1 = lo[i - 1] + 1, j2 = hi[i - 1] + 1;
+
+        cur[j1 - 1] = NOT_VISITED;
+
+        for (int j = j1; j <= j2; j++)
+        {
+            int direction = STEP_DIAG;
+
+            if (i == 1 && j == 1) {
+                // first value, must set here to avoid multiplying by step
+                cur[j] = localCost(x, y, p, 0, 0);
+
+            } else {
+                double local_cost = localCost(x, y, p, i - 1, j - 1);
+
+                direction = which_direction(tuple_direction, prev[j - 1], cur[j - 1], prev[j],
+                                            diag_weight, local_cost);
+
+                cur[j] = tuple_direction[direction];
+            }
+
+            DM[offset + j - j1] = (unsigned char) direction;
+        }
+
+        offset += j2 - j1 + 1;
+
+        // cells of the next row's window beyond this one
+        if (i < nx)
+            for (int j = j2 + 1; j <= hi[i] + 1; j++) cur[j] = NOT_VISITED;
+    }
+
+    TSDIST_STATS_ONLY(recordDTW(workspace, cells, cells, false);)
+
+    // backtracking loop, always start at end of series
+    idx.clear();
+    idy.clear();
+
+    int i = nx - 1;
+    int j = ny - 1;
+    idx.push_back(i);
+    idy.push_back(j);
+
+    offset -= hi[i] - lo[i] + 1;
+
+    while (!(i == 0 && j == 0))
+    {
+        if (j < lo[i] || j > hi[i])
+            throw("Invalid direction matrix computed.");
+
+        int direction = DM[offset + j - lo[i]];
+
+        if (direction == STEP_DIAG) {
+            i--;
+            j--;
+
+        } else if (direction == STEP_LEFT) {
+            j--;
+
+        } else {
+            i--;
+        }
+
+        if (i < 0 || j < 0)
+            throw("Invalid direction matrix computed.");
+
+        if (direction != STEP_LEFT) offset -= hi[i] - lo[i] + 1;
+
+        idx.push_back(i);
+        idy.push_back(j);
+    }
+
+    std::reverse(idx.begin(), idx.end());
+    std::reverse(idy.begin(), idy.end());
+
+    return CM[nx % 2][ny];
+}
+
+/*
+ * Cells of the finer resolution (lengths nx and ny) to search around the path (idx, idy) of
+ * the coarser one: the 2 x 2 block of each cell of the path, widened by 'radius' on every side.
+ */
+static void projectPath(const std::vector<int>& idx, const std::vector<int>& idy,
+                        int nx, int ny, int radius, int* lo, int* hi)
+{
+    for (int i = 0; i < nx; i++) {
+        lo[i] = ny;
+        hi[i] = -1;
+    }
+
+    for (std::size_t k = 0; k < idx.size(); k++)
+    {
+        for (int i = 2 * idx[k]; i <= std::min(2 * idx[k] + 1, nx - 1); i++)
+        {
+            lo[i] = std::min(lo[i], 2 * idy[k]);
+            hi[i] = std::max(hi[i], std::min(2 * idy[k] + 1, ny - 1));
+        }
+    }
+
+    // both limits are non-decreasing, so widening only looks 'radius' rows away
+    if (radius == 0) return;
+
+    for (int i = nx - 1; i >= 0; i--)
+        lo[i] = std::max(0, lo[std::max(0, i - radius)] - radius);
+
+    for (int i = 0; i < nx; i++)
+        hi[i] = std::min(ny - 1, hi[std::min(nx - 1, i + radius)] + radius);
+}
+
+// Averages pairs of observations, the last one is kept alone if the length is odd
+static int halve(const double* series, int length, int num_vars, double* result)
+{
+    int half = (length + 1) / 2;
+
+    for (int i = 0; i < half; i++)
+    {
+        const double* a = series + (std::size_t) 2 * i * num_vars;
+        const double* b = (2 * i + 1 < length) ? a + num_vars : a;
+
+        for (int k = 0; k < num_vars; k++)
+            result[(std::size_t) i * num_vars + k] = (a[k] + b[k]) / 2;
+    }
+
+    return half;
+}
+
+// ================================================================================================
+/* FastDTW */
+// ================================================================================================
+
+// Returns the distance (not a p-th power)
+template<typename Series>
+static double fastKernel(const Series& x, const Series& y, int radius, int p, int diag_weight,
+                         std::vector<int>& idx, std::vector<int>& idy,
+                         DTWWorkspace& workspace)
+{
+    int nx = x.length();
+    int ny = y.length();
+    int num_vars = x.numVars();
+
+    // small enough to be solved exactly
+    if (nx <= radius + 2 || ny <= radius + 2)
+        return backtrackDTW(x, y, 0, p, diag_weight, idx, idy, workspace);
+
+    // lengths of every resolution, the last one solved exactly
+    std::vector<int> lengths_x(1, nx), lengths_y(1, ny);
+    std::size_t total = 0;
+
+    while (true)
+    {
+        total += (std::size_t) (lengths_x.back() + lengths_y.back()) * num_vars;
+
+        if (lengths_x.back() <= radius + 2 || lengths_y.back() <= radius + 2) break;
+
+        lengths_x.push_back((lengths_x.back() + 1) / 2);
+        lengths_y.push_back((lengths_y.back() + 1) / 2);
+    }
+
+    // every resolution of x followed by the same one of y
+    double* series = workspace.series(total);
+    std::vector<double*> levels_x, levels_y;
+
+    double* next = series;
+
+    for (std::size_t level = 0; level < lengths_x.size(); level++)
+    {
+        levels_x.push_back(next);
+        next += (std::size_t) lengths_x[level] * num_vars;
+        levels_y.push_back(next);
+        next += (std::size_t) lengths_y[level] * num_vars;
+    }
+
+    for (int i = 0; i < nx; i++)
+        for (int k = 0; k < num_vars; k++)
+            levels_x[0][(std::size_t) i * num_vars + k] = x[i][k];
+
+    for (int i = 0; i < ny; i++)
+        for (int k = 0; k < num_vars; k++)
+            levels_y[0][(std::size_t) i * num_vars + k] = y[i][k];
+
+    for (std::size_t level = 1; level < lengths_x.size(); level++) {
+        halve(levels_x[level - 1], lengths_x[level - 1], num_vars, levels_x[level]);
+        halve(levels_y[level - 1], lengths_y[level - 1], num_vars, levels_y[level]);
+    }
+
+    auto view = [&](const std::vector<double*>& levels, const std::vector<int>& lengths,
+                    std::size_t level) {
+        return TimeSeriesView<double>(levels[level], lengths[level], num_vars);
+    };
+
+    // coarsest resolution
+    std::size_t level = lengths_x.size() - 1;
+    backtrackDTW(view(levels_x, lengths_x, level), view(levels_y, lengths_y, level),
+                 0, p, diag_weight, idx, idy, workspace);
+
+    // and back to the original one
+    int* lo = workspace.limits(2 * (std::size_t) nx);
+    int* hi = lo + nx;
+    double cost = 0;
+
+    while (level > 0)
+    {
+        level--;
+
+        projectPath(idx, idy, lengths_x[level], lengths_y[level], radius, lo, hi);
+
+        cost = windowedDTW(view(levels_x, lengths_x, level), view(levels_y, lengths_y, level),
+                           lo, hi, p, diag_weight, idx, idy, workspace);
+    }
+
+    return std::pow(cost, 1.0 / p);
+}
+
+// Lower bound of the exact distance for the tolerance
+template<typename Series>
+static double fastLowerBound(const Series& x, const Series& y, int p)
+{
+    if (x.numVars() == 1)
+        return lbKim(summarizeSeries(x), summarizeSeries(y), p);
+
+    // first and last cells, the same one for single observations
+    double lb = localCost(x, y, p, 0, 0);
+
+    if (x.length() > 1 || y.length() > 1)
+        lb += localCost(x, y, p, x.length() - 1, y.length() - 1);
+
+    return std::pow(lb, 1.0 / p);
+}
+
+template<typename Series>
+static double fastToleranceKernel(const Series& x, const Series& y,
+                                  int radius, int p, int diag_weight, double tolerance,
+                                  std::vector<int>& idx, std::vector<int>& idy,
+                                  DTWWorkspace& workspace)
+{
+    double bound = (1 + tolerance) * fastLowerBound(x, y, p);
+    double distance = fastKernel(x, y, radius, p, diag_weight, idx, idy, workspace);
+
+    // until the exact version, reached when a series is at most radius + 2 long
+    while (distance > bound && radius + 2 < std::min(x.length(), y.length()))
+    {
+        radius = 2 * radius + 1;
+        distance = fastKernel(x, y, radius, p, diag_weight, idx, idy, workspace);
+    }
+
+    return distance;
+}
+
+template<typename Series>
+static void checkFastParameters(const Series& x, const Series& y, int radius, int p,
+                                int diag_weight, double tolerance)
+{
+    checkDTWParameters(x, y, p, diag_weight);
+
+    if (radius < 0)
+        throw("Radius cannot be negative.");
+
+    if (tolerance < 0)
+        throw("Tolerance cannot be negative.");
+
+    if (x.length() < 1 || y.length() < 1)
+        throw("Series cannot be empty.");
+}
+
+template<typename T>
+double fastDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+               int radius, int p, int diag_weight,
+               std::vector<int>& idx, std::vector<int>& idy,
+               DTWWorkspace& workspace)
+{
+    checkFastParameters(x, y, radius, p, diag_weight, 0);
+    return fastKernel(x, y, radius, p, diag_weight, idx, idy, workspace);
+}
+
+template<typename T>
+double fastDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+               int radius, int p, int diag_weight,
+               std::vector<int>& idx, std::vector<int>& idy)
+{
+    DTWWorkspace workspace;
+    return fastDTW(x, y, radius, p, diag_weight, idx, idy, workspace);
+}
+
+template<typename T>
+double fastDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+               int radius, int p, int diag_weight, double tolerance,
+               std::vector<int>& idx, std::vector<int>& idy,
+               DTWWorkspace& workspace)
+{
+    checkFastParameters(x, y, radius, p, diag_weight, tolerance);
+    return fastToleranceKernel(x, y, radius, p, diag_weight, tolerance, idx, idy, workspace);
+}
+
+template<typename T>
+double fastDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+               int radius, int p, int diag_weight, double tolerance,
+               std::vector<int>& idx, std::vector<int>& idy)
+{
+    DTWWorkspace workspace;
+    return fastDTW(x, y, radius, p, diag_weight, tolerance, idx, idy, workspace);
+}
+
+double fastDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+               int radius, int p, int diag_weight,
+               std::vector<int>& idx, std::vector<int>& idy,
+               DTWWorkspace& workspace)
+{
+    if (isContiguous(x) && isContiguous(y))
+        return fastDTW(viewOf(x), viewOf(y), radius, p, diag_weight, idx, idy, workspace);
+
+    checkFastParameters(x, y, radius, p, diag_weight, 0);
+    return fastKernel(x, y, radius, p, diag_weight, idx, idy, workspace);
+}
+
+double fastDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+               int radius, int p, int diag_weight,
+               std::vector<int>& idx, std::vector<int>& idy)
+{
+    DTWWorkspace workspace;
+    return fastDTW(x, y, radius, p, diag_weight, idx, idy, workspace);
+}
+
+double fastDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+               int radius, int p, int diag_weight, double tolerance,
+               std::vector<int>& idx, std::vector<int>& idy,
+               DTWWorkspace& workspace)
+{
+    if (isContiguous(x) && isContiguous(y))
+        return fastDTW(viewOf(x), viewOf(y), radius, p, diag_weight, tolerance, idx, idy,
+                       workspace);
+
+    checkFastParameters(x, y, radius, p, diag_weight, tolerance);
+    return fastToleranceKernel(x, y, radius, p, diag_weight, tolerance, idx, idy, workspace);
+}
+
+double fastDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+               int radius, int p, int diag_weight, double tolerance,
+               std::vector<int>& idx, std::vector<int>& idy)
+{
+    DTWWorkspace workspace;
+    return fastDTW(x, y, radius, p, diag_weight, tolerance, idx, idy, workspace);
+}
+
+// ================================================================================================
+/* Explicit instantiations */
+// ================================================================================================
+template double fastDTW(const TimeSeriesView<double>&, const TimeSeriesView<double>&,
+                        int, int, int,
+                        std::vector<int>&, std::vector<int>&);
+template double fastDTW(const TimeSeriesView<double>&, const TimeSeriesView<double>&,
+                        int, int, int,
+                        std::vector<int>&, std::vector<int>&,
+                        DTWWorkspace&);
+template double fastDTW(const TimeSeriesView<double>&, const TimeSeriesView<double>&,
+                        int, int, int, double,
+                        std::vector<int>&, std::vector<int>&);
+template double fastDTW(const TimeSeriesView<double>&, const TimeSeriesView<double>&,
+                        int, int, int, double,
+                        std::vector<int>&, std::vector<int>&,
+                        DTWWorkspace&);
+
+template double fastDTW(const TimeSeriesView<float>&, const TimeSeriesView<float>&,
+                        int, int, int,
+                        std::vector<int>&, std::vector<int>&);
+template double fastDTW(const TimeSeriesView<float>&, const TimeSeriesView<float>&,
+                        int, int, int,
+                        std::vector<int>&, std::vector<int>&,
+                        DTWWorkspace&);
+template double fastDTW(const TimeSeriesView<float>&, const TimeSeriesView<float>&,
+                        int, int, int, double,
+                        std::vector<int>&, std::vector<int>&);
+template double fastDTW(const TimeSeriesView<float>&, const TimeSeriesView<float>&,
+                        int, int, int, double,
+                        std::vector<int>&, std::vector<int>&,
+                        DTWWorkspace&);
+
+}
@@ -0,0 +1,241 @@
+#include <algorithm> // std::min, std::max
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include "ts.h"
+#include "lb.h"
+#include "index.h"
+#include "mmap.h"
+#include "workspace.h"
+
+namespace TSdist {
+
+// ================================================================================================
+/* File format */
+// ================================================================================================
+
+/*
+ * A 64-byte header followed by the records, so that they keep the alignment of the mapping.
+ * Records are padded to a multiple of 8 doubles (64 bytes).
+ */
+struct IndexHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t record_size;
+    std::uint64_t size;
+    std::int32_t length;
+    std::int32_t window_size;
+    std::int32_t num_segments;
+    std::int32_t reserved;
+    char padding[24];
+};
+
+static_assert(sizeof(IndexHeader) == 64, "Unexpected padding in IndexHeader.");
+
+static const char INDEX_MAGIC[8] = { 'T', 'S', 'D', 'T', 'W', 'I', 'D', 'X' };
+static const std::uint32_t INDEX_VERSION = 1;
+
+// first, last, min and max after the PAA
+static const int SUMMARY_SIZE = 4;
+
+static std::size_t recordSize(int length, int num_segments)
+{
+    std::size_t size = 2 * (std::size_t) length + num_segments + SUMMARY_SIZE;
+    return (size + 7) / 8 * 8;
+}
+
+// ================================================================================================
+/* Construction */
+// ================================================================================================
+DTWIndex::DTWIndex(int window_size, int num_segments) :
+    _size(0) ,
+    _length(0) ,
+    _window_size(window_size) ,
+    _num_segments(num_segments) ,
+    _record_size(0) ,
+    _records(nullptr)
+{
+    if (window_size < 1)
+        throw("Window size must be positive.");
+
+    if (num_segments < 1)
+        throw("Number of segments must be positive.");
+}
+
+DTWIndex::DTWIndex(const std::vector<TimeSeriesView<double>>& tsdb, int window_size,
+                   int num_segments) :
+    DTWIndex(window_size, num_segments)
+{
+    DTWWorkspace workspace;
+
+    if (!tsdb.empty())
+        _storage.reserve(tsdb.size() * recordSize(tsdb[0].length(), num_segments));
+
+    for (const TimeSeriesView<double>& series : tsdb)
+        append(series, workspace);
+}
+
+void DTWIndex::append(const TimeSeriesView<double>& series, DTWWorkspace& workspace)
+{
+    if (series.numVars() != 1)
+        throw("Only univariate series are supported.");
+
+    if (_size == 0) {
+        if (series.length() < _num_segments)
+            throw("Number of segments cannot be larger than the series length.");
+
+        _length = series.length();
+        _record_size = recordSize(_length, _num_segments);
+
+    } else if (series.length() != _length) {
+        throw("Length mismatch between the series in the database.");
+    }
+
+    _storage.resize(_storage.size() + _record_size, 0);
+    _records = _storage.data();
+
+    double* record = _storage.data() + (std::size_t) _size * _record_size;
+    _size++;
+
+    // Envelopes
+    computeEnvelop(series, _window_size, record, record + _length, workspace);
+
+    // PAA
+    double* paa = record + 2 * _length;
+    detail::computePAA(series, _num_segments, paa);
+
+    // Summary
+    SeriesSummary summary = summarizeSeries(series);
+    double* values = paa + _num_segments;
+
+    values[0] = summary.first;
+    values[1] = summary.last;
+    values[2] = summary.min;
+    values[3] = summary.max;
+}
+
+// ================================================================================================
+/* Serialization */
+// ================================================================================================
+void DTWIndex::save(const std::string& path) const
+{
+    IndexHeader header;
+    std::memset(&header, 0, sizeof(header));
+
+    std::memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.version = INDEX_VERSION;
+    // also for an empty index, whose records have no size yet
+    header.record_size = recordSize(_length, _num_segments);
+    header.size = _size;
+    header.length = _length;
+    header.window_size = _window_size;
+    header.num_segments = _num_segments;
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+        throw("Could not open file.");
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(_records),
+               (std::size_t) _size * _record_size * sizeof(double));
+
+    if (!file)
+        throw("Could not write file.");
+}
+
+DTWIndex DTWIndex::load(const std::string& path)
+{
+    MappedFile file(path);
+    IndexHeader header;
+
+    if (file.size() < sizeof(header))
+        throw("Invalid index file.");
+
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+        header.version != INDEX_VERSION ||
+        header.length < 0 || header.num_segments < 1 || header.window_size < 1 ||
+        (header.size > 0 && header.length < header.num_segments) ||
+        header.record_size != recordSize(header.length, header.num_segments) ||
+        header.size > (std::uint64_t) std::numeric_limits<int>::max() ||
+        header.size > (file.size() - sizeof(header)) / (header.record_size * sizeof(double)))
+    {
+        throw("Invalid index file.");
+    }
+
+    DTWIndex index(header.window_size, header.num_segments);
+
+    index._size = header.size;
+    index._length = header.length;
+    index._record_size = header.record_size;
+    index._records = reinterpret_cast<const double*>(file.data() + sizeof(header));
+    index._file = std::move(file);
+
+    return index;
+}
+
+// ================================================================================================
+/* Lower bounds */
+// ================================================================================================
+SeriesSummary DTWIndex::summary(int k) const
+{
+    const double* values = paa(k) + _num_segments;
+    return { values[0], values[1], values[2], values[3], _length };
+}
+
+double DTWIndex::lbKeogh(int k, const TimeSeriesView<double>& query, int p) const
+{
+    if (p < 1)
+        throw("Parameter p must be positive.");
+
+    if (query.numVars() != 1)
+        throw("Only univariate series are supported.");
+
+    if (query.length() != _length)
+        throw("Length mismatch between the query and the index.");
+
+    const double* lower = lowerEnvelop(k);
+    const double* upper = upperEnvelop(k);
+    double lb = 0;
+
+    for (int i = 0; i < _length; i++)
+    {
+        if (query[i][0] > upper[i])
+            lb += std::pow(query[i][0] - upper[i], p);
+        else if (query[i][0] < lower[i])
+            lb += std::pow(lower[i] - query[i][0], p);
+    }
+
+    return std::pow(lb, 1.0 / p);
+}
+
+double DTWIndex::lbKim(int k, const SeriesSummary& query, int p) const
+{
+    return TSdist::lbKim(summary(k), query, p);
+}
+
+void DTWIndex::segmentEnvelop(const double* lower_envelop, const double* upper_envelop,
+                              double* lower_segments, double* upper_segments) const
+{
+    detail::segmentEnvelop(lower_envelop, upper_envelop, _length, _num_segments,
+                           lower_segments, upper_segments);
+}
+
+double DTWIndex::lbPAA(int k, const double* lower_segments, const double* upper_segments,
+                       int p) const
+{
+    if (p < 1)
+        throw("Parameter p must be positive.");
+
+    const double* means = paa(k);
+    double lb = detail::lbPAA(means, means, lower_segments, upper_segments, _length,
+                              _num_segments, p);
+
+    return std::pow(lb, 1.0 / p);
+}
+
+}
@@ -0,0 +1,122 @@
+#ifndef _KERNELS_H
+#define _KERNELS_H
+
+#include <cmath>
+#include <limits>
+#include "ts.h"
+#include "simd.h"
+#include "workspace.h"
+
+namespace TSdist {
+
+// ================================================================================================
+/* Helpers shared by the DTW kernels (not part of the public interface) */
+// ================================================================================================
+
+// Shortest length for which the vectorized anti-diagonal kernel is used by default
+static const int WAVEFRONT_MIN_LENGTH = 32;
+
+// Parameter checks shared by all DTW versions
+template<typename Series>
+inline void checkDTWParameters(const Series& x, const Series& y, int p, int diag_weight)
+{
+    if (x.numVars() != y.numVars())
+        throw("Series must have the same number of variables.");
+
+    if (p < 1)
+        throw("Parameter p must be positive.");
+
+    if (diag_weight != 1 && diag_weight != 2)
+        throw("Diagonal weight can only be 1 or 2.");
+}
+
+// Value of the cells outside the window in the row-based kernels
+static const double NOT_VISITED = -1;
+
+// Steps of a warping path, as stored by the backtracking kernels
+static const int STEP_DIAG = 0;
+static const int STEP_LEFT = 1;
+static const int STEP_UP = 2;
+static const int STEP_INVALID = 3;
+
+// Which direction to take when traversing the cost matrix, 'tpl' gets the cost of each
+inline int which_direction(double (&tpl)[3], double diag, double left, double up,
+                           double diag_weight, double local_cost)
+{
+    const double MAX = std::numeric_limits<double>::max();
+
+    tpl[STEP_DIAG] = (diag == NOT_VISITED) ? MAX : diag + diag_weight * local_cost;
+    tpl[STEP_LEFT] = (left == NOT_VISITED) ? MAX : left + local_cost;
+    tpl[STEP_UP] = (up == NOT_VISITED) ? MAX : up + local_cost;
+
+    // which direction has the least associated cost?
+    int direction = (tpl[STEP_LEFT] < tpl[STEP_DIAG]) ? STEP_LEFT : STEP_DIAG;
+    direction = (tpl[STEP_UP] < tpl[direction]) ? STEP_UP : direction;
+
+    return direction;
+}
+
+// p-th power of the absolute difference, without pow for the common cases
+inline double pointCost(double diff, int p)
+{
+    if (p == 1) return std::abs(diff);
+    if (p == 2) return diff * diff;
+    return std::abs(std::pow(diff, p));
+}
+
+// p-th power of the Lp norm between a single time-point of x and one of y
+template<typename Series>
+inline double localCost(const Series& x, const Series& y, int p, int time_x, int time_y)
+{
+    double result = 0;
+
+    for (int k = 0; k < x.numVars(); k++) {
+        result += pointCost((double) x[time_x][k] - y[time_y][k], p);
+    }
+
+    return result;
+}
+
+// Limits [j1, j2] of row i (both 1-based) given the window constraint
+inline void windowLimits(int i, int nx, int ny, int window_size, int& j1, int& j2)
+{
+    if (window_size < 1) {
+        j1 = 1;
+        j2 = ny;
+
+    } else {
+        j1 = std::ceil((double) i * ny / nx - window_size);
+        j2 = std::floor((double) i * ny / nx + window_size);
+
+        j1 = j1 > 1 ? j1 : 1;
+        j2 = j2 < ny ? j2 : ny;
+    }
+}
+
+// Number of cells of the cost matrix inside the window (for statistics)
+inline long long windowCells(int nx, int ny, int window_size)
+{
+    long long cells = 0;
+
+    for (int i = 1; i <= nx; i++)
+    {
+        int j1, j2;
+        windowLimits(i, nx, ny, window_size, j1, j2);
+        if (j2 >= j1) cells += j2 - j1 + 1;
+    }
+
+    return cells;
+}
+
+/*
+ * Anti-diagonal kernel (wavefront.cpp). Returns the p-th power of the DTW distance, or infinity
+ * if it is larger than 'bound' (also a p-th power, infinity disables pruning).
+ */
+template<typename T>
+double wavefrontCost(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                     int window_size, int p, int diag_weight, double bound, SimdLevel level,
+                     DTWWorkspace& workspace);
+
+}
+
+#endif // _KERNELS_H
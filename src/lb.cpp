@@ -1,154 +1,739 @@
+#include <algorithm> // std::min, std::max, std::min_element, std::max_element
 #include <cmath>
-#include <deque>
+#include <utility> // std::move
+#include <vector>
 #include "ts.h"
 #include "lb.h"
+#include "parallel.h"
+#include "workspace.h"
 
 namespace TSdist {
 
+// ================================================================================================
+/* Output adaptors, so that the kernels can write one variable to raw memory or TimeSeriesBase */
+// ================================================================================================
+template<typename T>
+class StridedOutput
+{
+public:
+    StridedOutput(T* data, int stride) : _data(data), _stride(stride) { }
+    T& operator[](int time_index) { return _data[(std::size_t) time_index * _stride]; }
+
+private:
+    T* _data;
+    int _stride;
+};
+
+class VariableOutput
+{
+public:
+    VariableOutput(TimeSeriesBase& x, int var_index) : _x(x), _var_index(var_index) { }
+    double& operator[](int time_index) { return _x[time_index][_var_index]; }
+
+private:
+    TimeSeriesBase& _x;
+    int _var_index;
+};
+
+// Whether x exposes writable storage with the values of each time index packed
+static bool isWritableContiguous(TimeSeriesBase& x) {
+    return x.data() != nullptr && x.stride() == x.numVars();
+}
+
 // ================================================================================================
 /* Warping envelop */
 // ================================================================================================
-void computeEnvelop(const TimeSeriesBase& x, int window_size,
-                    TimeSeriesBase& lower_envelop, TimeSeriesBase& upper_envelop)
+
+/*
+ * Van Herk/Gil-Werman running extrema: the series is cut into blocks as wide as the window, and
+ * every window covers the end of one block and the start of the next one. Prefix extrema (g) and
+ * suffix extrema (h) of each block are one pass each, and the extrema of a window are those of
+ * h at its first element and g at its last. Three comparisons per element and per envelope,
+ * whatever the window size, and no data-dependent branches.
+ *
+ * Blocks are placed as if the series started r elements earlier, so that windows clipped at the
+ * start still span at most two blocks. The first block is then [0, r].
+ */
+
+// Envelop of variable k of x, with window half-width r (0 < r < length)
+template<typename T, typename Series, typename Output>
+static void envelopKernel(const Series& x, int k, int r,
+                          Output& lower_envelop, Output& upper_envelop,
+                          DTWWorkspace& workspace)
+{
+    int n = x.length();
+    int width = 2 * r + 1;
+
+    T* g_max = workspace.extremaOf<T>(4 * (std::size_t) n);
+    T* h_max = g_max + n;
+    T* g_min = h_max + n;
+    T* h_min = g_min + n;
+
+    int last_block = 0;
+
+    for (int begin = 0; begin < n; begin = begin == 0 ? r + 1 : begin + width)
+    {
+        int last = std::min(begin == 0 ? r : begin + width - 1, n - 1);
+        last_block = begin;
+
+        // both directions in the same loop, four independent chains kept in registers
+        T forward_max = x[begin][k], forward_min = forward_max;
+        T backward_max = x[last][k], backward_min = backward_max;
+
+        for (int j = 0; j <= last - begin; j++)
+        {
+            int f = begin + j, b = last - j;
+            T forward = x[f][k], backward = x[b][k];
+
+            g_max[f] = forward_max = std::max(forward_max, forward);
+            g_min[f] = forward_min = std::min(forward_min, forward);
+            h_max[b] = backward_max = std::max(backward_max, backward);
+            h_min[b] = backward_min = std::min(backward_min, backward);
+        }
+    }
+
+    // windows clipped at the start, then whole windows [i - r, i + r], then clipped at the end
+    int left = std::min(r, n);
+    int right = std::max(left, n - r);
+
+    for (int i = 0; i < left; i++)
+    {
+        int j = std::min(i + r, n - 1);
+        upper_envelop[i] = std::max(h_max[0], g_max[j]);
+        lower_envelop[i] = std::min(h_min[0], g_min[j]);
+    }
+
+    for (int i = left; i < right; i++)
+    {
+        upper_envelop[i] = std::max(h_max[i - r], g_max[i + r]);
+        lower_envelop[i] = std::min(h_min[i - r], g_min[i + r]);
+    }
+
+    for (int i = right; i < n; i++)
+    {
+        int j = std::max(i - r, 0);
+
+        // the suffix of the last block is the whole window
+        upper_envelop[i] = j >= last_block ? h_max[j] : std::max(h_max[j], g_max[n - 1]);
+        lower_envelop[i] = j >= last_block ? h_min[j] : std::min(h_min[j], g_min[n - 1]);
+    }
+}
+
+// Trivial windows of the envelop, i.e. a window of 0 or a series of one value
+template<typename Series, typename Output>
+static void copyKernel(const Series& x, int k, Output& lower_envelop, Output& upper_envelop)
+{
+    for (int i = 0; i < x.length(); i++)
+        lower_envelop[i] = upper_envelop[i] = x[i][k];
+}
+
+// Dispatch on the window, larger windows give the same result as the whole series
+template<typename T, typename Series, typename Output>
+static void envelopOf(const Series& x, int k, int window_size,
+                      Output& lower_envelop, Output& upper_envelop,
+                      DTWWorkspace& workspace)
+{
+    int r = std::min(window_size, x.length() - 1);
+
+    if (r < 1)
+        copyKernel(x, k, lower_envelop, upper_envelop);
+    else
+        envelopKernel<T>(x, k, r, lower_envelop, upper_envelop, workspace);
+}
+
+template<typename T>
+void computeEnvelop(const TimeSeriesView<T>& x, int window_size,
+                    T* lower_envelop, T* upper_envelop,
+                    DTWWorkspace& workspace)
 {
     if (window_size < 1)
         throw("Window size must be positive.");
 
-    if (x.numVars() != 1)
-        throw("Only univariate series are supported.");
+    // univariate envelops are written directly, so that the last pass vectorizes
+    if (x.numVars() == 1) {
+        envelopOf<T>(x, 0, window_size, lower_envelop, upper_envelop, workspace);
+        return;
+    }
 
-    if (x.length() != lower_envelop.length() || x.length() != upper_envelop.length())
-        throw("Length mismatch between x and the envelops.");
+    // one envelop per variable, in the same layout as packed series
+    for (int k = 0; k < x.numVars(); k++)
+    {
+        StridedOutput<T> lower(lower_envelop + k, x.numVars()), upper(upper_envelop + k,
+                                                                    x.numVars());
+        envelopOf<T>(x, k, window_size, lower, upper, workspace);
+    }
+}
 
-    int constraint = window_size;
-    window_size = window_size * 2 + 1;
-    int array_size = x.length();
-    std::deque<int> maxfifo, minfifo;
+template<typename T>
+void computeEnvelop(const TimeSeriesView<T>& x, int window_size,
+                    T* lower_envelop, T* upper_envelop)
+{
+    DTWWorkspace workspace;
+    computeEnvelop(x, window_size, lower_envelop, upper_envelop, workspace);
+}
 
-    maxfifo.push_back(0);
-    minfifo.push_back(0);
+// Series handed to a thread at a time by computeEnvelops
+static const int ENVELOP_CHUNK_SIZE = 64;
 
-    for(int i = 1; i < array_size; ++i) {
-        if(i >= constraint + 1) {
-            upper_envelop[i - constraint - 1][0] = x[maxfifo.front()][0];
-            lower_envelop[i - constraint - 1][0] = x[minfifo.front()][0];
-        }
+template<typename T>
+void computeEnvelops(const std::vector<TimeSeriesView<T>>& tsdb, int window_size,
+                     T* lower_envelops, T* upper_envelops, int num_threads)
+{
+    if (window_size < 1)
+        throw("Window size must be positive.");
 
-        if(x[i][0] > x[i - 1][0]) { //overshoot
-            maxfifo.pop_back();
+    int size = tsdb.size();
 
-            while(maxfifo.size() > 0) {
-                if(x[i][0] <= x[maxfifo.back()][0]) break;
-                maxfifo.pop_back();
-            }
+    // where the envelops of each series start
+    std::vector<std::size_t> offsets(size + 1, 0);
+    for (int k = 0; k < size; k++)
+        offsets[k + 1] = offsets[k] + (std::size_t) tsdb[k].length() * tsdb[k].numVars();
 
-        } else {
-            minfifo.pop_back();
+    if (num_threads <= 0) num_threads = defaultNumThreads();
+    num_threads = std::max(1, std::min(num_threads, (size + ENVELOP_CHUNK_SIZE - 1) /
+                                                    ENVELOP_CHUNK_SIZE));
 
-            while(minfifo.size() > 0) {
-                if(x[i][0] >= x[minfifo.back()][0]) break;
-                minfifo.pop_back();
-            }
+    WorkCounter counter(size, ENVELOP_CHUNK_SIZE);
+
+    runThreads(num_threads, [&](int) {
+        DTWWorkspace workspace;
+        int begin, end;
+
+        while (counter.next(begin, end)) {
+            for (int k = begin; k < end; k++)
+                computeEnvelop(tsdb[k], window_size, lower_envelops + offsets[k],
+                               upper_envelops + offsets[k], workspace);
         }
+    });
+}
 
-        maxfifo.push_back(i);
-        minfifo.push_back(i);
+void computeEnvelop(const TimeSeriesBase& x, int window_size,
+                    TimeSeriesBase& lower_envelop, TimeSeriesBase& upper_envelop,
+                    DTWWorkspace& workspace)
+{
+    if (x.length() != lower_envelop.length() || x.length() != upper_envelop.length())
+        throw("Length mismatch between x and the envelops.");
 
-        if(i == window_size + maxfifo.front())
-            maxfifo.pop_front();
-        else if(i == window_size + minfifo.front())
-            minfifo.pop_front();
+    if (x.numVars() != lower_envelop.numVars() || x.numVars() != upper_envelop.numVars())
+        throw("Series must have the same number of variables.");
+
+    if (isContiguous(x) &&
+        isWritableContiguous(lower_envelop) &&
+        isWritableContiguous(upper_envelop))
+    {
+        computeEnvelop(viewOf(x), window_size, lower_envelop.data(), upper_envelop.data(),
+                       workspace);
+        return;
     }
 
-    for(int i = x.length(); i <= array_size + constraint; ++i) {
-        upper_envelop[i - constraint - 1][0] = x[maxfifo.front()][0];
-        lower_envelop[i - constraint - 1][0] = x[minfifo.front()][0];
+    if (window_size < 1)
+        throw("Window size must be positive.");
 
-        if(i - maxfifo.front() >= window_size) maxfifo.pop_front();
-        if(i - minfifo.front() >= window_size) minfifo.pop_front();
+    for (int k = 0; k < x.numVars(); k++)
+    {
+        VariableOutput lower(lower_envelop, k), upper(upper_envelop, k);
+        envelopOf<double>(x, k, window_size, lower, upper, workspace);
     }
 }
 
+void computeEnvelop(const TimeSeriesBase& x, int window_size,
+                    TimeSeriesBase& lower_envelop, TimeSeriesBase& upper_envelop)
+{
+    DTWWorkspace workspace;
+    computeEnvelop(x, window_size, lower_envelop, upper_envelop, workspace);
+}
+
 // ================================================================================================
 /* LB_Keogh */
 // ================================================================================================
-double lbKeogh(const TimeSeriesBase& x, const TimeSeriesBase& y, int p,
-               const TimeSeriesBase& lower_envelop, const TimeSeriesBase& upper_envelop)
+template<typename Series>
+static double lbKeoghKernel(const Series& x, int p,
+                            const Series& lower_envelop, const Series& upper_envelop)
+{
+    double lb = 0;
+
+    for (int i = 0; i < x.length(); i++)
+    {
+        for (int k = 0; k < x.numVars(); k++)
+        {
+            if (x[i][k] > upper_envelop[i][k])
+                lb += std::pow((double) x[i][k] - upper_envelop[i][k], p);
+            else if (x[i][k] < lower_envelop[i][k])
+                lb += std::pow((double) lower_envelop[i][k] - x[i][k], p);
+        }
+    }
+
+    return std::pow(lb, 1.0 / p);
+}
+
+template<typename Series>
+static void checkLbKeogh(const Series& x, const Series& y, int p,
+                         const Series& lower_envelop, const Series& upper_envelop)
 {
     if (p < 1)
         throw("Parameter p must be positive.");
 
-    if (x.numVars() != 1 || y.numVars() != 1)
-        throw("Only univariate series are supported.");
+    if (x.numVars() != y.numVars() ||
+        y.numVars() != lower_envelop.numVars() ||
+        y.numVars() != upper_envelop.numVars())
+    {
+        throw("Series must have the same number of variables.");
+    }
 
     if (x.length() != y.length())
         throw("Length mismatch between x and y.");
 
     if (y.length() != lower_envelop.length() || y.length() != upper_envelop.length())
         throw("Length mismatch between y and the envelops.");
+}
 
-    double lb = 0;
+template<typename T>
+double lbKeogh(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y, int p,
+               const TimeSeriesView<T>& lower_envelop, const TimeSeriesView<T>& upper_envelop)
+{
+    checkLbKeogh(x, y, p, lower_envelop, upper_envelop);
+    return lbKeoghKernel(x, p, lower_envelop, upper_envelop);
+}
 
-    for (int i = 0; i < x.length(); i++)
+double lbKeogh(const TimeSeriesBase& x, const TimeSeriesBase& y, int p,
+               const TimeSeriesBase& lower_envelop, const TimeSeriesBase& upper_envelop)
+{
+    if (isContiguous(x) && isContiguous(y) &&
+        isContiguous(lower_envelop) && isContiguous(upper_envelop))
     {
-        if (x[i][0] > upper_envelop[i][0])
-            lb += std::pow(x[i][0] - upper_envelop[i][0], p);
-        else if (x[i][0] < lower_envelop[i][0])
-            lb += std::pow(lower_envelop[i][0] - x[i][0], p);
+        return lbKeogh(viewOf(x), viewOf(y), p, viewOf(lower_envelop), viewOf(upper_envelop));
     }
 
-    return std::pow(lb, 1.0 / p);
+    checkLbKeogh(x, y, p, lower_envelop, upper_envelop);
+    return lbKeoghKernel(x, p, lower_envelop, upper_envelop);
 }
 
 // ================================================================================================
 /* LB_Improved */
 // ================================================================================================
-double lbImproved(const TimeSeriesBase& x, const TimeSeriesBase& y,
-                  int window_size, int p,
-                  TimeSeriesBase& lower_envelop, TimeSeriesBase& upper_envelop,
-                  TimeSeriesBase& H)
+// First pass for variable k of x, its projection on the envelop goes to H
+template<typename Series, typename Output>
+static double lbImprovedKernel(const Series& x, int k, int p,
+                               const Series& lower_envelop, const Series& upper_envelop,
+                               Output& H)
+{
+    double lb = 0;
+
+    // envelops of y must be available here
+    for (int i = 0; i < x.length(); i++)
+    {
+        if (x[i][k] > upper_envelop[i][k]) {
+            H[i] = upper_envelop[i][k];
+            lb += std::pow((double) x[i][k] - upper_envelop[i][k], p);
+
+        } else if (x[i][k] < lower_envelop[i][k]) {
+            H[i] = lower_envelop[i][k];
+            lb += std::pow((double) lower_envelop[i][k] - x[i][k], p);
+
+        } else {
+            H[i] = x[i][k];
+        }
+    }
+
+    return lb;
+}
+
+template<typename Series>
+static double lbImprovedSecondPass(const Series& y, int p,
+                                   const Series& lower_envelop, const Series& upper_envelop)
+{
+    double lb = 0;
+
+    // envelops of H must be available here
+    for (int i = 0; i < y.length(); i++)
+    {
+        for (int k = 0; k < y.numVars(); k++)
+        {
+            if (y[i][k] > upper_envelop[i][k])
+                lb += std::pow((double) y[i][k] - upper_envelop[i][k], p);
+            else if (y[i][k] < lower_envelop[i][k])
+                lb += std::pow((double) lower_envelop[i][k] - y[i][k], p);
+        }
+    }
+
+    return lb;
+}
+
+template<typename Series>
+static void checkLbImproved(const Series& x, const Series& y, int p)
 {
     if (p < 1)
         throw("Parameter p must be positive.");
 
-    if (x.numVars() != 1 || y.numVars() != 1)
-        throw("Only univariate series are supported.");
+    if (x.numVars() != y.numVars())
+        throw("Series must have the same number of variables.");
 
     if (x.length() != y.length())
         throw("Length mismatch between x and y.");
+}
 
-    double lb = 0;
+template<typename T>
+double lbImproved(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                  int window_size, int p,
+                  T* lower_envelop, T* upper_envelop, T* H,
+                  DTWWorkspace& workspace)
+{
+    checkLbImproved(x, y, p);
 
-    // window size and length checked here
-    computeEnvelop(y, window_size, lower_envelop, upper_envelop);
+    int n = x.length();
+    int num_vars = x.numVars();
+    TimeSeriesView<T> lower(lower_envelop, n, num_vars), upper(upper_envelop, n, num_vars);
 
-    for (int i = 0; i < x.length(); i++)
+    // window size checked here
+    computeEnvelop(y, window_size, lower_envelop, upper_envelop, workspace);
+    double lb = 0;
+
+    for (int k = 0; k < num_vars; k++)
     {
-        if (x[i][0] > upper_envelop[i][0]) {
-            H[i][0] = upper_envelop[i][0];
-            lb += std::pow(x[i][0] - upper_envelop[i][0], p);
+        StridedOutput<T> h(H + k, num_vars);
+        lb += lbImprovedKernel(x, k, p, lower, upper, h);
+    }
 
-        } else if (x[i][0] < lower_envelop[i][0]) {
-            H[i][0] = lower_envelop[i][0];
-            lb += std::pow(lower_envelop[i][0] - x[i][0], p);
+    computeEnvelop(TimeSeriesView<T>(H, n, num_vars), window_size, lower_envelop, upper_envelop,
+                   workspace);
+    lb += lbImprovedSecondPass(y, p, lower, upper);
 
-        } else {
-            H[i][0] = x[i][0];
+    return std::pow(lb, 1.0 / p);
+}
+
+template<typename T>
+double lbImproved(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                  int window_size, int p,
+                  T* lower_envelop, T* upper_envelop, T* H)
+{
+    DTWWorkspace workspace;
+    return lbImproved(x, y, window_size, p, lower_envelop, upper_envelop, H, workspace);
+}
+
+double lbImproved(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                  int window_size, int p,
+                  TimeSeriesBase& lower_envelop, TimeSeriesBase& upper_envelop,
+                  TimeSeriesBase& H,
+                  DTWWorkspace& workspace)
+{
+    if (isContiguous(x) && isContiguous(y) &&
+        isWritableContiguous(lower_envelop) &&
+        isWritableContiguous(upper_envelop) &&
+        isWritableContiguous(H))
+    {
+        if (x.length() != lower_envelop.length() ||
+            x.length() != upper_envelop.length() ||
+            x.length() != H.length())
+        {
+            throw("Length mismatch between x and the envelops.");
         }
+
+        return lbImproved(viewOf(x), viewOf(y), window_size, p,
+                          lower_envelop.data(), upper_envelop.data(), H.data(),
+                          workspace);
     }
 
+    checkLbImproved(x, y, p);
+
     // window size and length checked here
-    computeEnvelop(H, window_size, lower_envelop, upper_envelop);
+    computeEnvelop(y, window_size, lower_envelop, upper_envelop, workspace);
 
-    for (int i = 0; i < y.length(); i++)
+    if (x.numVars() != H.numVars())
+        throw("Series must have the same number of variables.");
+
+    double lb = 0;
+
+    for (int k = 0; k < x.numVars(); k++)
+    {
+        VariableOutput h(H, k);
+        lb += lbImprovedKernel(x, k, p, lower_envelop, upper_envelop, h);
+    }
+
+    // window size and length checked here
+    computeEnvelop(H, window_size, lower_envelop, upper_envelop, workspace);
+    lb += lbImprovedSecondPass(y, p, lower_envelop, upper_envelop);
+
+    return std::pow(lb, 1.0 / p);
+}
+
+double lbImproved(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                  int window_size, int p,
+                  TimeSeriesBase& lower_envelop, TimeSeriesBase& upper_envelop,
+                  TimeSeriesBase& H)
+{
+    DTWWorkspace workspace;
+    return lbImproved(x, y, window_size, p, lower_envelop, upper_envelop, H, workspace);
+}
+
+// ================================================================================================
+/* LB_Kim */
+// ================================================================================================
+template<typename Series>
+static SeriesSummary summarizeKernel(const Series& x)
+{
+    if (x.numVars() != 1)
+        throw("Only univariate series are supported.");
+
+    if (x.length() < 1)
+        throw("Series cannot be empty.");
+
+    int n = x.length();
+    SeriesSummary summary = { x[0][0], x[n - 1][0], x[0][0], x[0][0], n };
+
+    for (int i = 1; i < n; i++)
+    {
+        summary.min = std::min(summary.min, (double) x[i][0]);
+        summary.max = std::max(summary.max, (double) x[i][0]);
+    }
+
+    return summary;
+}
+
+template<typename T>
+SeriesSummary summarizeSeries(const TimeSeriesView<T>& x)
+{
+    return summarizeKernel(x);
+}
+
+SeriesSummary summarizeSeries(const TimeSeriesBase& x)
+{
+    if (isContiguous(x))
+        return summarizeSeries(viewOf(x));
+
+    return summarizeKernel(x);
+}
+
+double lbKim(const SeriesSummary& x, const SeriesSummary& y, int p)
+{
+    if (p < 1)
+        throw("Parameter p must be positive.");
+
+    // first and last cells are different unless both series have a single observation
+    double lb = std::pow(std::abs(x.first - y.first), p);
+
+    if (x.length > 1 || y.length > 1)
+        lb += std::pow(std::abs(x.last - y.last), p);
+
+    lb = std::max(lb, std::pow(std::abs(x.max - y.max), p));
+    lb = std::max(lb, std::pow(std::abs(x.min - y.min), p));
+
+    return std::pow(lb, 1.0 / p);
+}
+
+double lbKimFL(const SeriesSummary& x, const SeriesSummary& y, int p)
+{
+    if (p < 1)
+        throw("Parameter p must be positive.");
+
+    double lb = std::pow(std::abs(x.first - y.first), p);
+
+    if (x.length > 1 || y.length > 1)
+        lb += std::pow(std::abs(x.last - y.last), p);
+
+    return std::pow(lb, 1.0 / p);
+}
+
+// ================================================================================================
+/* LB_Enhanced */
+// ================================================================================================
+template<typename Series>
+static double lbEnhancedKernel(const Series& x, const Series& y, int window_size, int p,
+                               int num_bands,
+                               const Series& lower_envelop, const Series& upper_envelop)
+{
+    int n = x.length();
+    int bands = std::min(num_bands, n / 2);
+    int w = window_size < 1 ? n : window_size;
+
+    double lb = 0;
+
+    /*
+     * L-shaped bands at the beginning and the end, cells (i, j) and (j, i) with i - w <= j <= i.
+     * The minimum is taken per variable, so the bound also holds for independent DTW.
+     */
+    for (int i = 0; i < bands; i++)
+    {
+        int r = n - 1 - i;
+
+        for (int k = 0; k < x.numVars(); k++)
+        {
+            double front = std::abs((double) x[i][k] - y[i][k]);
+            double back = std::abs((double) x[r][k] - y[r][k]);
+
+            for (int j = std::max(0, i - w); j < i; j++)
+            {
+                front = std::min(front, std::abs((double) x[i][k] - y[j][k]));
+                front = std::min(front, std::abs((double) x[j][k] - y[i][k]));
+
+                int s = n - 1 - j;
+                back = std::min(back, std::abs((double) x[r][k] - y[s][k]));
+                back = std::min(back, std::abs((double) x[s][k] - y[r][k]));
+            }
+
+            lb += std::pow(front, p) + std::pow(back, p);
+        }
+    }
+
+    // LB_Keogh in between
+    for (int i = bands; i < n - bands; i++)
     {
-        if (y[i][0] > upper_envelop[i][0])
-            lb += std::pow(y[i][0] - upper_envelop[i][0], p);
-        else if (y[i][0] < lower_envelop[i][0])
-            lb += std::pow(lower_envelop[i][0] - y[i][0], p);
+        for (int k = 0; k < x.numVars(); k++)
+        {
+            if (x[i][k] > upper_envelop[i][k])
+                lb += std::pow((double) x[i][k] - upper_envelop[i][k], p);
+            else if (x[i][k] < lower_envelop[i][k])
+                lb += std::pow((double) lower_envelop[i][k] - x[i][k], p);
+        }
     }
 
     return std::pow(lb, 1.0 / p);
 }
 
+template<typename Series>
+static void checkLbEnhanced(const Series& x, const Series& y, int p, int num_bands,
+                            const Series& lower_envelop, const Series& upper_envelop)
+{
+    checkLbKeogh(x, y, p, lower_envelop, upper_envelop);
+
+    if (num_bands < 0)
+        throw("Number of bands cannot be negative.");
+}
+
+template<typename T>
+double lbEnhanced(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                  int window_size, int p, int num_bands,
+                  const TimeSeriesView<T>& lower_envelop, const TimeSeriesView<T>& upper_envelop)
+{
+    checkLbEnhanced(x, y, p, num_bands, lower_envelop, upper_envelop);
+    return lbEnhancedKernel(x, y, window_size, p, num_bands, lower_envelop, upper_envelop);
+}
+
+double lbEnhanced(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                  int window_size, int p, int num_bands,
+                  const TimeSeriesBase& lower_envelop, const TimeSeriesBase& upper_envelop)
+{
+    if (isContiguous(x) && isContiguous(y) &&
+        isContiguous(lower_envelop) && isContiguous(upper_envelop))
+    {
+        return lbEnhanced(viewOf(x), viewOf(y), window_size, p, num_bands,
+                          viewOf(lower_envelop), viewOf(upper_envelop));
+    }
+
+    checkLbEnhanced(x, y, p, num_bands, lower_envelop, upper_envelop);
+    return lbEnhancedKernel(x, y, window_size, p, num_bands, lower_envelop, upper_envelop);
+}
+
+// ================================================================================================
+/* Lower bound cascades */
+// ================================================================================================
+LBCascade::LBCascade() :
+    stages({ LowerBound::KimFL, LowerBound::Keogh, LowerBound::Improved }) ,
+    enhanced_bands(5)
+{ }
+
+LBCascade::LBCascade(std::vector<LowerBound> stages, int enhanced_bands) :
+    stages(std::move(stages)) ,
+    enhanced_bands(enhanced_bands)
+{
+    if (enhanced_bands < 0)
+        throw("Number of bands cannot be negative.");
+}
+
+// ================================================================================================
+/* PAA */
+// ================================================================================================
+namespace detail {
+
+void computePAA(const TimeSeriesView<double>& x, int num_segments, double* paa)
+{
+    for (int s = 0; s < num_segments; s++)
+    {
+        int begin = segmentStart(s, x.length(), num_segments);
+        int end = segmentStart(s + 1, x.length(), num_segments);
+        double sum = 0;
+
+        for (int i = begin; i < end; i++) sum += x[i][0];
+        paa[s] = sum / (end - begin);
+    }
+}
+
+void segmentEnvelop(const double* lower_envelop, const double* upper_envelop,
+                    int length, int num_segments,
+                    double* lower_segments, double* upper_segments)
+{
+    for (int s = 0; s < num_segments; s++)
+    {
+        int begin = segmentStart(s, length, num_segments);
+        int end = segmentStart(s + 1, length, num_segments);
+
+        lower_segments[s] = *std::min_element(lower_envelop + begin, lower_envelop + end);
+        upper_segments[s] = *std::max_element(upper_envelop + begin, upper_envelop + end);
+    }
+}
+
+double lbPAA(const double* lower_means, const double* upper_means,
+             const double* lower_segments, const double* upper_segments,
+             int length, int num_segments, int p)
+{
+    double lb = 0;
+
+    for (int s = 0; s < num_segments; s++)
+    {
+        double gap = std::max(std::max(lower_means[s] - upper_segments[s],
+                                       lower_segments[s] - upper_means[s]), 0.0);
+
+        if (gap > 0) {
+            int width = segmentStart(s + 1, length, num_segments) -
+                        segmentStart(s, length, num_segments);
+
+            lb += width * std::pow(gap, p);
+        }
+    }
+
+    return lb;
+}
+
+}
+
+// ================================================================================================
+/* Explicit instantiations */
+// ================================================================================================
+template void computeEnvelop(const TimeSeriesView<double>&, int, double*, double*);
+template void computeEnvelop(const TimeSeriesView<double>&, int, double*, double*,
+                             DTWWorkspace&);
+template void computeEnvelops(const std::vector<TimeSeriesView<double>>&, int, double*, double*,
+                              int);
+template double lbKeogh(const TimeSeriesView<double>&, const TimeSeriesView<double>&, int,
+                        const TimeSeriesView<double>&, const TimeSeriesView<double>&);
+template double lbImproved(const TimeSeriesView<double>&, const TimeSeriesView<double>&,
+                           int, int,
+                           double*, double*, double*);
+template double lbImproved(const TimeSeriesView<double>&, const TimeSeriesView<double>&,
+                           int, int,
+                           double*, double*, double*,
+                           DTWWorkspace&);
+template SeriesSummary summarizeSeries(const TimeSeriesView<double>&);
+template double lbEnhanced(const TimeSeriesView<double>&, const TimeSeriesView<double>&,
+                           int, int, int,
+                           const TimeSeriesView<double>&, const TimeSeriesView<double>&);
+
+template void computeEnvelop(const TimeSeriesView<float>&, int, float*, float*);
+template void computeEnvelop(const TimeSeriesView<float>&, int, float*, float*,
+                             DTWWorkspace&);
+template void computeEnvelops(const std::vector<TimeSeriesView<float>>&, int, float*, float*,
+                              int);
+template double lbKeogh(const TimeSeriesView<float>&, const TimeSeriesView<float>&, int,
+                        const TimeSeriesView<float>&, const TimeSeriesView<float>&);
+template double lbImproved(const TimeSeriesView<float>&, const TimeSeriesView<float>&,
+                           int, int,
+                           float*, float*, float*);
+template double lbImproved(const TimeSeriesView<float>&, const TimeSeriesView<float>&,
+                           int, int,
+                           float*, float*, float*,
+                           DTWWorkspace&);
+template SeriesSummary summarizeSeries(const TimeSeriesView<float>&);
+template double lbEnhanced(const TimeSeriesView<float>&, const TimeSeriesView<float>&,
+                           int, int, int,
+                           const TimeSeriesView<float>&, const TimeSeriesView<float>&);
+
 }
@@ -0,0 +1,108 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mmap.h"
+
+namespace TSdist {
+
+MappedFile::MappedFile() :
+    _data(nullptr) ,
+    _size(0)
+{ }
+
+MappedFile::MappedFile(const std::string& path) :
+    _data(nullptr) ,
+    _size(0)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw("Could not open file.");
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        throw("Could not read file size.");
+    }
+
+    _size = info.st_size;
+
+    // empty files cannot be mapped, they simply have no data
+    if (_size > 0) {
+        void* data = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+
+        if (data == MAP_FAILED) {
+            close(fd);
+            throw("Could not map file.");
+        }
+
+        _data = static_cast<unsigned char*>(data);
+    }
+
+    // the mapping stays valid after closing
+    close(fd);
+}
+
+MappedFile::MappedFile(const std::string& path, std::size_t size) :
+    _data(nullptr) ,
+    _size(size)
+{
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw("Could not open file.");
+
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        throw("Could not write file.");
+    }
+
+    if (_size > 0) {
+        void* data = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        if (data == MAP_FAILED) {
+            close(fd);
+            throw("Could not map file.");
+        }
+
+        _data = static_cast<unsigned char*>(data);
+    }
+
+    close(fd);
+}
+
+MappedFile::MappedFile(MappedFile&& other) :
+    _data(other._data) ,
+    _size(other._size)
+{
+    other._data = nullptr;
+    other._size = 0;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other)
+{
+    if (this != &other) {
+        release();
+        _data = other._data;
+        _size = other._size;
+        other._data = nullptr;
+        other._size = 0;
+    }
+
+    return *this;
+}
+
+MappedFile::~MappedFile()
+{
+    release();
+}
+
+void MappedFile::release()
+{
+    if (_data != nullptr)
+        munmap(_data, _size);
+
+    _data = nullptr;
+    _size = 0;
+}
+
+}
@@ -0,0 +1,388 @@
+#include <algorithm> // std::min, std::max, std::nth_element
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional> // std::greater
+#include <limits>
+#include <queue>
+#include <utility> // std::pair, std::move
+#include <vector>
+#include "ts.h"
+#include "lb.h"
+#include "1nn.h"
+#include "paatree.h"
+#include "mmap.h"
+#include "workspace.h"
+
+namespace TSdist {
+
+static const double INF = std::numeric_limits<double>::infinity();
+
+// ================================================================================================
+/* File format */
+// ================================================================================================
+
+/*
+ * A 64-byte header, then the nodes, the bounding boxes, the original position of every stored
+ * series and the series themselves. Every section starts at a multiple of 64 bytes, and records
+ * are padded to a multiple of 8 doubles (64 bytes), like in index.cpp.
+ */
+struct PAATreeHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t record_size;
+    std::uint64_t size;
+    std::int32_t length;
+    std::int32_t num_segments;
+    std::int32_t num_nodes;
+    std::int32_t reserved;
+    char padding[24];
+};
+
+static_assert(sizeof(PAATreeHeader) == 64, "Unexpected padding in PAATreeHeader.");
+
+struct PAATreeNode
+{
+    // series stored in the subtree, positions in the file
+    std::int64_t begin;
+    std::int64_t end;
+
+    // children, -1 for leaves
+    std::int32_t left;
+    std::int32_t right;
+};
+
+static_assert(sizeof(PAATreeNode) == 24, "Unexpected padding in PAATreeNode.");
+
+static const char PAATREE_MAGIC[8] = { 'T', 'S', 'P', 'A', 'A', 'T', 'R', 'E' };
+static const std::uint32_t PAATREE_VERSION = 1;
+
+static std::size_t recordSize(int length, int num_segments)
+{
+    std::size_t size = (std::size_t) length + num_segments;
+    return (size + 7) / 8 * 8;
+}
+
+// Bytes rounded up to the next section boundary
+static std::size_t sectionSize(std::size_t bytes)
+{
+    return (bytes + 63) / 64 * 64;
+}
+
+// Offsets of the sections of a file, and its total size
+struct PAATreeLayout
+{
+    PAATreeLayout(std::uint64_t size, int num_segments, int num_nodes, std::size_t record_size)
+    {
+        nodes = sizeof(PAATreeHeader);
+        bounds = nodes + sectionSize(num_nodes * sizeof(PAATreeNode));
+        ids = bounds + sectionSize((std::size_t) num_nodes * 2 * num_segments * sizeof(double));
+        records = ids + sectionSize(size * sizeof(std::int64_t));
+        total = records + size * record_size * sizeof(double);
+    }
+
+    std::size_t nodes, bounds, ids, records, total;
+};
+
+// ================================================================================================
+/* Bulk loading */
+// ================================================================================================
+
+/*
+ * Subtree over ids[begin, end), nodes are appended in preorder. Returns the index of its root.
+ * Bounding boxes are appended to 'bounds' in the same order.
+ */
+static int buildNode(std::vector<int>& ids, int begin, int end, const std::vector<double>& paa,
+                     int num_segments, int leaf_size,
+                     std::vector<PAATreeNode>& nodes, std::vector<double>& bounds)
+{
+    int node = nodes.size();
+    nodes.push_back({ begin, end, -1, -1 });
+
+    bounds.resize(bounds.size() + 2 * num_segments);
+    double* lower = &bounds[(std::size_t) node * 2 * num_segments];
+    double* upper = lower + num_segments;
+
+    std::fill(lower, upper, INF);
+    std::fill(upper, upper + num_segments, -INF);
+
+    for (int k = begin; k < end; k++)
+    {
+        const double* means = &paa[(std::size_t) ids[k] * num_segments];
+
+        for (int s = 0; s < num_segments; s++)
+        {
+            lower[s] = std::min(lower[s], means[s]);
+            upper[s] = std::max(upper[s], means[s]);
+        }
+    }
+
+    if (end - begin <= leaf_size)
+        return node;
+
+    // split at the median of the widest segment
+    int split = 0;
+    for (int s = 1; s < num_segments; s++)
+        if (upper[s] - lower[s] > upper[split] - lower[split]) split = s;
+
+    int middle = begin + (end - begin) / 2;
+
+    std::nth_element(ids.begin() + begin, ids.begin() + middle, ids.begin() + end,
+                     [&](int a, int b) {
+                         double x = paa[(std::size_t) a * num_segments + split];
+                         double y = paa[(std::size_t) b * num_segments + split];
+                         return x < y || (x == y && a < b);
+                     });
+
+    // 'lower' and 'upper' are invalidated by the children
+    int left = buildNode(ids, begin, middle, paa, num_segments, leaf_size, nodes, bounds);
+    int right = buildNode(ids, middle, end, paa, num_segments, leaf_size, nodes, bounds);
+
+    nodes[node].left = left;
+    nodes[node].right = right;
+
+    return node;
+}
+
+PAATree PAATree::bulkLoad(const std::vector<TimeSeriesView<double>>& tsdb, int num_segments,
+                          int leaf_size, const std::string& path)
+{
+    if (num_segments < 1)
+        throw("Number of segments must be positive.");
+
+    if (leaf_size < 1)
+        throw("Leaf size must be positive.");
+
+    int size = tsdb.size();
+    int length = size > 0 ? tsdb[0].length() : 0;
+
+    for (const TimeSeriesView<double>& series : tsdb)
+    {
+        if (series.numVars() != 1)
+            throw("Only univariate series are supported.");
+
+        if (series.length() != length)
+            throw("Length mismatch between the series in the database.");
+    }
+
+    if (size > 0 && length < num_segments)
+        throw("Number of segments cannot be larger than the series length.");
+
+    // PAA of every series, then the tree over them
+    std::vector<double> paa((std::size_t) size * num_segments);
+    for (int k = 0; k < size; k++)
+        detail::computePAA(tsdb[k], num_segments, &paa[(std::size_t) k * num_segments]);
+
+    std::vector<int> ids(size);
+    for (int k = 0; k < size; k++) ids[k] = k;
+
+    std::vector<PAATreeNode> nodes;
+    std::vector<double> bounds;
+
+    if (size > 0)
+        buildNode(ids, 0, size, paa, num_segments, leaf_size, nodes, bounds);
+
+    // file written through a mapping, series in the order of the leaves
+    std::size_t record_size = recordSize(length, num_segments);
+    PAATreeLayout layout(size, num_segments, nodes.size(), record_size);
+
+    {
+        MappedFile file(path, layout.total);
+        unsigned char* data = file.data();
+
+        PAATreeHeader header;
+        std::memset(&header, 0, sizeof(header));
+
+        std::memcpy(header.magic, PAATREE_MAGIC, sizeof(PAATREE_MAGIC));
+        header.version = PAATREE_VERSION;
+        header.record_size = record_size;
+        header.size = size;
+        header.length = length;
+        header.num_segments = num_segments;
+        header.num_nodes = nodes.size();
+
+        std::memcpy(data, &header, sizeof(header));
+
+        // no nodes for an empty database
+        if (!nodes.empty()) {
+            std::memcpy(data + layout.nodes, nodes.data(), nodes.size() * sizeof(PAATreeNode));
+            std::memcpy(data + layout.bounds, bounds.data(), bounds.size() * sizeof(double));
+        }
+
+        std::int64_t* positions = reinterpret_cast<std::int64_t*>(data + layout.ids);
+        double* records = reinterpret_cast<double*>(data + layout.records);
+
+        for (int k = 0; k < size; k++)
+        {
+            double* record = records + (std::size_t) k * record_size;
+            const TimeSeriesView<double>& series = tsdb[ids[k]];
+
+            positions[k] = ids[k];
+            std::memcpy(record, &paa[(std::size_t) ids[k] * num_segments],
+                        num_segments * sizeof(double));
+
+            for (int i = 0; i < length; i++) record[num_segments + i] = series[i][0];
+        }
+    }
+
+    return load(path);
+}
+
+// ================================================================================================
+/* Loading */
+// ================================================================================================
+PAATree PAATree::load(const std::string& path)
+{
+    return PAATree(MappedFile(path));
+}
+
+PAATree::PAATree(MappedFile file)
+{
+    PAATreeHeader header;
+
+    if (file.size() < sizeof(header))
+        throw("Invalid index file.");
+
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, PAATREE_MAGIC, sizeof(PAATREE_MAGIC)) != 0 ||
+        header.version != PAATREE_VERSION ||
+        header.length < 0 || header.num_segments < 1 || header.num_nodes < 0 ||
+        (header.size > 0 && (header.length < header.num_segments || header.num_nodes < 1)) ||
+        header.record_size != recordSize(header.length, header.num_segments) ||
+        header.size > (std::uint64_t) std::numeric_limits<int>::max() ||
+        header.size > file.size() / (header.record_size * sizeof(double)) ||
+        (std::size_t) header.num_nodes > file.size() / (2 * header.num_segments * sizeof(double)))
+    {
+        throw("Invalid index file.");
+    }
+
+    PAATreeLayout layout(header.size, header.num_segments, header.num_nodes, header.record_size);
+
+    if (file.size() < layout.total)
+        throw("Invalid index file.");
+
+    _size = header.size;
+    _length = header.length;
+    _num_segments = header.num_segments;
+    _num_nodes = header.num_nodes;
+    _record_size = header.record_size;
+
+    _nodes = reinterpret_cast<const PAATreeNode*>(file.data() + layout.nodes);
+
+    // nodes are in preorder, so children come after their parent and the search terminates
+    for (int k = 0; k < _num_nodes; k++)
+    {
+        const PAATreeNode& node = _nodes[k];
+        bool leaf = node.left == -1 && node.right == -1;
+        bool inner = node.left > k && node.left < _num_nodes &&
+                     node.right > k && node.right < _num_nodes;
+
+        if (node.begin < 0 || node.begin > node.end || node.end > _size || !(leaf || inner))
+            throw("Invalid index file.");
+    }
+
+    _bounds = reinterpret_cast<const double*>(file.data() + layout.bounds);
+    _ids = reinterpret_cast<const std::int64_t*>(file.data() + layout.ids);
+    _records = reinterpret_cast<const double*>(file.data() + layout.records);
+
+    _file = std::move(file);
+}
+
+// ================================================================================================
+/* Search */
+// ================================================================================================
+int PAATree::nearestNeighborDTW(const TimeSeriesView<double>& query,
+                                int window_size, int p, int diag_weight,
+                                DTWWorkspace& workspace) const
+{
+    if (query.numVars() != 1)
+        throw("Only univariate series are supported.");
+
+    if (_size > 0 && query.length() != _length)
+        throw("Length mismatch between the query and the index.");
+
+    // Window size checked here
+    detail::QueryFilter<double> filter(query, window_size, p, diag_weight, LBCascade(),
+                                       workspace);
+
+    if (_size == 0) return -1;
+
+    // segments of the query envelope: minimum of the lower one, maximum of the upper one
+    std::vector<double> segments(2 * _num_segments);
+    double* query_lower = segments.data();
+    double* query_upper = query_lower + _num_segments;
+
+    detail::segmentEnvelop(filter.lowerEnvelop(), filter.upperEnvelop(), _length, _num_segments,
+                           query_lower, query_upper);
+
+    auto nodeBound = [&](int node) {
+        const double* box = bounds(node);
+        return detail::lbPAA(box, box + _num_segments, query_lower, query_upper, _length,
+                             _num_segments, p);
+    };
+
+    // (LB_PAA as a p-th power, node), lowest bound first
+    typedef std::pair<double, int> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+    queue.push({ nodeBound(0), 0 });
+
+    double d = INF;
+    int NN = -1;
+
+    // p-th power of the best-so-far, with the slack of the searches so that ties are visited
+    double bound = INF;
+
+    while (!queue.empty() && queue.top().first <= bound)
+    {
+        const PAATreeNode& node = _nodes[queue.top().second];
+        queue.pop();
+
+        if (node.left >= 0) {
+            for (int child : { node.left, node.right })
+            {
+                double lb = nodeBound(child);
+                if (lb <= bound) queue.push({ lb, child });
+            }
+
+            continue;
+        }
+
+        for (std::int64_t position = node.begin; position < node.end; position++)
+        {
+            const double* paa = record(position);
+
+            if (detail::lbPAA(paa, paa, query_lower, query_upper, _length, _num_segments, p) >
+                bound)
+                continue;
+
+            double dtw = filter.evaluate(TimeSeriesView<double>(paa + _num_segments, _length), d);
+            std::int64_t id = _ids[position];
+
+            // checked when used, so that loading does not read the whole table
+            if (id < 0 || id >= _size)
+                throw("Invalid index file.");
+
+            // leaves are not in database order, ties go to the first series
+            if (dtw < d || (dtw == d && id < NN)) {
+                NN = (int) id;
+                d = dtw;
+
+                bound = std::pow(d, p);
+                bound += bound * detail::THRESHOLD_SLACK;
+            }
+        }
+    }
+
+    return NN;
+}
+
+int PAATree::nearestNeighborDTW(const TimeSeriesView<double>& query,
+                                int window_size, int p, int diag_weight) const
+{
+    DTWWorkspace workspace;
+    return nearestNeighborDTW(query, window_size, p, diag_weight, workspace);
+}
+
+}
@@ -0,0 +1,285 @@
+#ifndef _PATTERNS_H
+#define _PATTERNS_H
+
+#include <algorithm> // std::min, std::max, std::fill
+#include <cmath>
+#include <limits>
+#include "ts.h"
+#include "dtw.h"
+#include "workspace.h"
+#include "kernels.h"
+#include "stats.h"
+
+namespace TSdist {
+
+// ================================================================================================
+/* DTW kernels specialized at compile time (not part of the public interface) */
+// ================================================================================================
+
+/*
+ * The kernel below is instantiated for every combination of norm, step pattern and window, so
+ * that the inner loop has no pow() for p = 1 and p = 2 and no branches on the parameters.
+ * dispatchDTW picks the instantiation from the runtime parameters.
+ */
+
+namespace patterns {
+
+// p-th power of |diff|, P = 0 means any p (given at runtime)
+template<int P>
+inline double power(double diff, int p) { return pointCost(diff, p); }
+
+template<>
+inline double power<1>(double diff, int) { return std::abs(diff); }
+
+template<>
+inline double power<2>(double diff, int) { return diff * diff; }
+
+// p-th root of the accumulated cost, pow() for p = 2 too so that results match the other kernels
+template<int P>
+inline double root(double cost, int p) { return std::pow(cost, 1.0 / p); }
+
+template<>
+inline double root<1>(double cost, int) { return cost; }
+
+template<int P, typename Series>
+inline double cost(const Series& x, const Series& y, int p, int time_x, int time_y)
+{
+    if (x.numVars() == 1)
+        return power<P>((double) x[time_x][0] - y[time_y][0], p);
+
+    double result = 0;
+
+    for (int k = 0; k < x.numVars(); k++)
+        result += power<P>((double) x[time_x][k] - y[time_y][k], p);
+
+    return result;
+}
+
+/*
+ * Step patterns. Cell (i, j) of the accumulated cost is computed from rows i - 1 ('prev') and
+ * i - 2 ('prev2'), and from the cells of row i already computed ('cur'), given its local cost
+ * 'c' and a function that returns the local cost of cell (i - 1, j). Cells that cannot be
+ * reached are infinite.
+ */
+
+// Symmetric1: (i-1, j-1), (i, j-1), (i-1, j) all weighted 1
+struct Symmetric1
+{
+    template<typename LocalCost>
+    static double step(const double* prev2, const double* prev, const double* cur, int j,
+                       double c, LocalCost&) {
+        (void) prev2;
+        return c + std::min(std::min(prev[j - 1], cur[j - 1]), prev[j]);
+    }
+};
+
+// Symmetric2: same steps, the diagonal weighted 2
+struct Symmetric2
+{
+    template<typename LocalCost>
+    static double step(const double* prev2, const double* prev, const double* cur, int j,
+                       double c, LocalCost&) {
+        (void) prev2;
+        return std::min(std::min(prev[j - 1] + 2 * c, cur[j - 1] + c), prev[j] + c);
+    }
+};
+
+// Asymmetric: (i-1, j), (i-1, j-1), (i-1, j-2), every step advances along x
+struct Asymmetric
+{
+    template<typename LocalCost>
+    static double step(const double* prev2, const double* prev, const double* cur, int j,
+                       double c, LocalCost&) {
+        (void) prev2;
+        (void) cur;
+        return c + std::min(std::min(prev[j], prev[j - 1]), prev[j - 2]);
+    }
+};
+
+// Rabiner-Juang type III, smoothing 'c': (i-1, j-2), (i-1, j-1), (i-2, j-1) through (i-1, j)
+struct RabinerJuang
+{
+    template<typename LocalCost>
+    static double step(const double* prev2, const double* prev, const double* cur, int j,
+                       double c, LocalCost& above_cost) {
+        (void) cur;
+        double best = std::min(prev[j - 2], prev[j - 1]) + c;
+
+        // the intermediate cell is only needed if it can lead to something better
+        if (prev2[j - 1] < best)
+            best = std::min(best, prev2[j - 1] + above_cost() + c);
+
+        return best;
+    }
+};
+
+/*
+ * Windows. Limits [j1, j2] of row i (both 1-based), which must be non-decreasing in i.
+ */
+
+struct NoWindow
+{
+    static void limits(int, int, int ny, int, int& j1, int& j2) {
+        j1 = 1;
+        j2 = ny;
+    }
+};
+
+// Slanted band of computeDTW
+struct SakoeChiba
+{
+    static void limits(int i, int nx, int ny, int window_size, int& j1, int& j2) {
+        windowLimits(i, nx, ny, window_size, j1, j2);
+    }
+};
+
+// Parallelogram with slopes 1/2 and 2 through both corners, scaled to the lengths
+struct Itakura
+{
+    static void limits(int i, int nx, int ny, int, int& j1, int& j2) {
+        if (nx == 1 || ny == 1) {
+            j1 = 1;
+            j2 = ny;
+            return;
+        }
+
+        // relative position along x, and the same bounds for y
+        double u = (double) (i - 1) / (nx - 1);
+        double low = std::max(u / 2, 2 * u - 1);
+        double high = std::min(2 * u, (u + 1) / 2);
+
+        // slack for the rounding of the products
+        j1 = 1 + (int) std::ceil(low * (ny - 1) - 1e-9);
+        j2 = 1 + (int) std::floor(high * (ny - 1) + 1e-9);
+    }
+};
+
+/*
+ * Row-based kernel. Three rows of the accumulated cost are kept, with two extra columns on the
+ * left so that steps to j - 2 need no checks. Each row remembers which cells it wrote, and they
+ * are reset to infinity before the row is reused, so cells outside the window are always
+ * infinite. Returns the distance (not a p-th power).
+ */
+template<int P, typename Pattern, typename Window, typename Series>
+double kernel(const Series& x, const Series& y, int window_size, int p,
+              DTWWorkspace& workspace)
+{
+    const double INF = std::numeric_limits<double>::infinity();
+
+    int nx = x.length();
+    int ny = y.length();
+    int width = ny + 3;
+
+    double* rows[3];
+    rows[0] = workspace.costs(3 * width);
+    rows[1] = rows[0] + width;
+    rows[2] = rows[1] + width;
+    std::fill(rows[0], rows[0] + 3 * width, INF);
+
+    // columns written in each row
+    int written[3][2] = { { 1, 0 }, { 1, 0 }, { 1, 0 } };
+
+    TSDIST_STATS_ONLY(long long cells = 0;)
+
+    for (int i = 1; i <= nx; i++)
+    {
+        int r = i % 3;
+
+        // column j of a row is stored at position j + 1
+        double* cur = rows[r] + 1;
+        const double* prev = rows[(i + 2) % 3] + 1;
+        const double* prev2 = rows[(i + 1) % 3] + 1;
+
+        std::fill(cur + written[r][0], cur + written[r][1] + 1, INF);
+
+        int j1, j2;
+        Window::limits(i, nx, ny, window_size, j1, j2);
+
+        int j = j1;
+
+        // first value, every path starts here even if the window leaves it out
+        if (i == 1) {
+            cur[1] = cost<P>(x, y, p, 0, 0);
+            j1 = 1;
+            j = std::max(j, 2);
+        }
+
+        // cost of cell (i - 1, j), infinite outside the window of the previous row
+        const int* above = written[(i + 2) % 3];
+        auto above_cost = [&]() {
+            return (j < above[0] || j > above[1]) ? INF : cost<P>(x, y, p, i - 2, j - 1);
+        };
+
+        for (; j <= j2; j++)
+            cur[j] = Pattern::step(prev2, prev, cur, j, cost<P>(x, y, p, i - 1, j - 1),
+                                   above_cost);
+
+        written[r][0] = j1;
+        written[r][1] = j2;
+
+        TSDIST_STATS_ONLY(if (j2 >= j1) cells += j2 - j1 + 1;)
+    }
+
+    TSDIST_STATS_ONLY(recordDTW(workspace, cells, cells, false);)
+
+    return root<P>(rows[nx % 3][ny + 1], p);
+}
+
+template<int P, typename Pattern, typename Series>
+double dispatchWindow(const Series& x, const Series& y, WindowType window, int window_size,
+                      int p, DTWWorkspace& workspace)
+{
+    // like in computeDTW, a band smaller than 1 means no constraint
+    if (window == WindowType::None || (window == WindowType::SakoeChiba && window_size < 1))
+        return kernel<P, Pattern, NoWindow>(x, y, window_size, p, workspace);
+
+    if (window == WindowType::SakoeChiba)
+        return kernel<P, Pattern, SakoeChiba>(x, y, window_size, p, workspace);
+
+    if (window == WindowType::Itakura)
+        return kernel<P, Pattern, Itakura>(x, y, window_size, p, workspace);
+
+    throw("Unknown window type.");
+}
+
+template<int P, typename Series>
+double dispatchPattern(const Series& x, const Series& y, StepPattern pattern, WindowType window,
+                       int window_size, int p, DTWWorkspace& workspace)
+{
+    switch (pattern)
+    {
+        case StepPattern::Symmetric1:
+            return dispatchWindow<P, Symmetric1>(x, y, window, window_size, p, workspace);
+
+        case StepPattern::Symmetric2:
+            return dispatchWindow<P, Symmetric2>(x, y, window, window_size, p, workspace);
+
+        case StepPattern::Asymmetric:
+            return dispatchWindow<P, Asymmetric>(x, y, window, window_size, p, workspace);
+
+        case StepPattern::RabinerJuang:
+            return dispatchWindow<P, RabinerJuang>(x, y, window, window_size, p, workspace);
+    }
+
+    throw("Unknown step pattern.");
+}
+
+}
+
+// DTW distance with the kernel specialized for the given parameters
+template<typename Series>
+double dispatchDTW(const Series& x, const Series& y, StepPattern pattern, WindowType window,
+                   int window_size, int p, DTWWorkspace& workspace)
+{
+    if (p == 1)
+        return patterns::dispatchPattern<1>(x, y, pattern, window, window_size, p, workspace);
+
+    if (p == 2)
+        return patterns::dispatchPattern<2>(x, y, pattern, window, window_size, p, workspace);
+
+    return patterns::dispatchPattern<0>(x, y, pattern, window, window_size, p, workspace);
+}
+
+}
+
+#endif // _PATTERNS_H
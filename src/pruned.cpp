@@ -0,0 +1,241 @@
+#include <algorithm> // std::min, std::max, std::fill, std::swap
+#include <cmath>
+#include <limits>
+#include "ts.h"
+#include "dtw.h"
+#include "simd.h"
+#include "workspace.h"
+#include "kernels.h"
+#include "stats.h"
+
+namespace TSdist {
+
+// Marks cells outside the window or already known to be above the bound
+static const double PRUNED = std::numeric_limits<double>::max();
+static const double INF = std::numeric_limits<double>::infinity();
+
+// Relative slack added to the bound, covers the rounding of pow(..., p) and pow(..., 1/p)
+static const double BOUND_SLACK = 1e-10;
+
+// ================================================================================================
+/* Pruned DTW distance with early abandoning */
+// ================================================================================================
+
+/*
+ * Same recursion as computeDTW, but cells whose cost is above the bound are "dead": since costs
+ * only grow along a warping path, nothing computed from them can be below the bound. Hence, for
+ * each row (see PrunedDTW and EAPrunedDTW by Silva, Herrmann et al.):
+ *
+ *   - it starts at the first live column of the previous row (everything to its left is dead),
+ *   - beyond the last live column of the previous row only left steps are possible, so the row
+ *     ends as soon as a dead cell is found there,
+ *   - if no cell is alive, the computation is abandoned.
+ *
+ * Live cells are exact, dead ones only need to be larger than the bound.
+ */
+template<typename LocalCost>
+static double prunedKernel(int nx, int ny, int window_size, int p, int diag_weight,
+                           double upper_bound, LocalCost localCost, DTWWorkspace& workspace)
+{
+    double weight = diag_weight;
+
+    double ub = std::pow(upper_bound, p);
+    ub += ub * BOUND_SLACK;
+
+    // two rows with an extra column on each side for the boundaries
+    double* prev = workspace.costs(2 * (ny + 2));
+    double* cur = prev + ny + 2;
+    std::fill(prev, prev + 2 * (ny + 2), PRUNED);
+
+    // first and last live columns of the previous row, row 0 has none
+    int sc = 1, ec = 0;
+
+    TSDIST_STATS_ONLY(long long cells = 0;)
+
+    for (int i = 1; i <= nx; i++)
+    {
+        int j1, j2;
+        windowLimits(i, nx, ny, window_size, j1, j2);
+
+        int next_sc = 0, next_ec = 0;
+        int j;
+
+        if (i == 1) {
+            // very first value is always set, even if the window would exclude it
+            cur[1] = localCost(0, 0);
+            if (cur[1] <= ub) next_sc = next_ec = 1;
+
+            j = std::max(j1, 2);
+            if (j > 2) cur[j - 1] = PRUNED;
+
+        } else {
+            j = std::max(j1, sc);
+            cur[j - 1] = PRUNED;
+        }
+
+        // cells computed in this row are [j, end of the loops), plus the first one in row 1
+        TSDIST_STATS_ONLY(cells -= j - (i == 1 ? 1 : 0);)
+
+        // cells that can be reached from the previous row
+        for (; j <= j2 && j <= ec + 1; j++)
+        {
+            double local_cost = localCost(i - 1, j - 1);
+            double cost = std::min(std::min(prev[j - 1] + weight * local_cost,
+                                            cur[j - 1] + local_cost),
+                                   prev[j] + local_cost);
+
+            cur[j] = cost;
+
+            if (cost <= ub) {
+                if (next_sc == 0) next_sc = j;
+                next_ec = j;
+            }
+        }
+
+        // the rest can only be reached from the left
+        for (; j <= j2 && cur[j - 1] <= ub; j++)
+        {
+            double cost = cur[j - 1] + localCost(i - 1, j - 1);
+
+            cur[j] = cost;
+
+            if (cost <= ub) {
+                if (next_sc == 0) next_sc = j;
+                next_ec = j;
+            }
+        }
+
+        // boundary for the next row
+        if (j <= ny) cur[j] = PRUNED;
+
+        TSDIST_STATS_ONLY(cells += j;)
+
+        // early abandoning
+        if (next_sc == 0) {
+            TSDIST_STATS_ONLY(recordDTW(workspace, cells, windowCells(nx, ny, window_size), true);)
+            return INF;
+        }
+
+        sc = next_sc;
+        ec = next_ec;
+        std::swap(prev, cur);
+    }
+
+    double distance = (ec == ny) ? std::pow(prev[ny], 1.0 / p) : INF;
+
+    TSDIST_STATS_ONLY(recordDTW(workspace, cells, windowCells(nx, ny, window_size),
+                                !(distance <= upper_bound));)
+
+    // last cell must be alive
+    return distance <= upper_bound ? distance : INF;
+}
+
+template<typename Series>
+static double prunedDTW(const Series& x, const Series& y, int window_size, int p,
+                        int diag_weight, double upper_bound, DTWWorkspace& workspace)
+{
+    return prunedKernel(x.length(), y.length(), window_size, p, diag_weight, upper_bound,
+                        [&](int time_x, int time_y) { return localCost(x, y, p, time_x, time_y); },
+                        workspace);
+}
+
+// specialized local cost for the common univariate cases
+template<int P, typename T>
+static double prunedUnivariateDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                                  int window_size, int diag_weight, double upper_bound,
+                                  DTWWorkspace& workspace)
+{
+    const T* xp = x.data();
+    const T* yp = y.data();
+    int sx = x.stride(), sy = y.stride();
+
+    return prunedKernel(x.length(), y.length(), window_size, P, diag_weight, upper_bound,
+                        [=](int time_x, int time_y) {
+                            double diff = (double) xp[time_x * sx] - yp[time_y * sy];
+                            return P == 1 ? std::abs(diff) : diff * diff;
+                        },
+                        workspace);
+}
+
+template<typename T>
+double computePrunedDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                        int window_size, int p, int diag_weight, double upper_bound,
+                        DTWWorkspace& workspace)
+{
+    checkDTWParameters(x, y, p, diag_weight);
+
+    // nothing to prune
+    if (upper_bound == INF)
+        return computeDTW(x, y, window_size, p, diag_weight, workspace);
+
+    // the anti-diagonal kernel prunes in the same way
+    if (x.numVars() == 1 && (p == 1 || p == 2) &&
+        x.length() >= WAVEFRONT_MIN_LENGTH && y.length() >= WAVEFRONT_MIN_LENGTH &&
+        detectSimdLevel() != SimdLevel::Scalar)
+    {
+        double ub = std::pow(upper_bound, p);
+        ub += ub * BOUND_SLACK;
+
+        double cost = wavefrontCost(x, y, window_size, p, diag_weight, ub, detectSimdLevel(),
+                                    workspace);
+
+        double distance = std::pow(cost, 1.0 / p);
+        return distance <= upper_bound ? distance : INF;
+    }
+
+    if (x.numVars() == 1 && p == 1)
+        return prunedUnivariateDTW<1>(x, y, window_size, diag_weight, upper_bound, workspace);
+
+    if (x.numVars() == 1 && p == 2)
+        return prunedUnivariateDTW<2>(x, y, window_size, diag_weight, upper_bound, workspace);
+
+    return prunedDTW(x, y, window_size, p, diag_weight, upper_bound, workspace);
+}
+
+template<typename T>
+double computePrunedDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                        int window_size, int p, int diag_weight, double upper_bound)
+{
+    DTWWorkspace workspace;
+    return computePrunedDTW(x, y, window_size, p, diag_weight, upper_bound, workspace);
+}
+
+double computePrunedDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                        int window_size, int p, int diag_weight, double upper_bound,
+                        DTWWorkspace& workspace)
+{
+    if (isContiguous(x) && isContiguous(y))
+        return computePrunedDTW(viewOf(x), viewOf(y), window_size, p, diag_weight, upper_bound,
+                                workspace);
+
+    checkDTWParameters(x, y, p, diag_weight);
+
+    if (upper_bound == INF)
+        return computeDTW(x, y, window_size, p, diag_weight, workspace);
+
+    return prunedDTW(x, y, window_size, p, diag_weight, upper_bound, workspace);
+}
+
+double computePrunedDTW(const TimeSeriesBase& x, const TimeSeriesBase& y,
+                        int window_size, int p, int diag_weight, double upper_bound)
+{
+    DTWWorkspace workspace;
+    return computePrunedDTW(x, y, window_size, p, diag_weight, upper_bound, workspace);
+}
+
+// ================================================================================================
+/* Explicit instantiations */
+// ================================================================================================
+template double computePrunedDTW(const TimeSeriesView<double>&, const TimeSeriesView<double>&,
+                                 int, int, int, double);
+template double computePrunedDTW(const TimeSeriesView<double>&, const TimeSeriesView<double>&,
+                                 int, int, int, double,
+                                 DTWWorkspace&);
+
+template double computePrunedDTW(const TimeSeriesView<float>&, const TimeSeriesView<float>&,
+                                 int, int, int, double);
+template double computePrunedDTW(const TimeSeriesView<float>&, const TimeSeriesView<float>&,
+                                 int, int, int, double,
+                                 DTWWorkspace&);
+
+}
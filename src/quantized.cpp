@@ -0,0 +1,165 @@
+#include <algorithm> // std::min, std::max
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "ts.h"
+#include "quantized.h"
+
+namespace TSdist {
+
+// ================================================================================================
+/* Quantization */
+// ================================================================================================
+template<typename Q>
+Quantization fitQuantization(double min, double max)
+{
+    if (!(min <= max) || !std::isfinite(min) || !std::isfinite(max))
+        throw("Invalid range for the quantization.");
+
+    double lowest = std::numeric_limits<Q>::min();
+    double highest = std::numeric_limits<Q>::max();
+
+    // constant values still need a positive step
+    double scale = (max - min) / (highest - lowest);
+    if (scale <= 0) scale = 1;
+
+    return Quantization{ scale, min - lowest * scale };
+}
+
+template<typename Q, typename T>
+Quantization fitQuantization(const std::vector<TimeSeriesView<T>>& tsdb)
+{
+    double min = std::numeric_limits<double>::infinity();
+    double max = -min;
+
+    for (const TimeSeriesView<T>& series : tsdb)
+    {
+        for (int i = 0; i < series.length(); i++)
+        {
+            for (int k = 0; k < series.numVars(); k++)
+            {
+                min = std::min(min, (double) series[i][k]);
+                max = std::max(max, (double) series[i][k]);
+            }
+        }
+    }
+
+    if (min > max)
+        throw("Series cannot be empty.");
+
+    return fitQuantization<Q>(min, max);
+}
+
+template<typename Q, typename T>
+void quantize(const TimeSeriesView<T>& x, const Quantization& quantization, Q* codes)
+{
+    double lowest = std::numeric_limits<Q>::min();
+    double highest = std::numeric_limits<Q>::max();
+
+    for (int i = 0; i < x.length(); i++)
+    {
+        for (int k = 0; k < x.numVars(); k++)
+        {
+            double code = ((double) x[i][k] - quantization.offset) / quantization.scale;
+
+            // beyond half a step the error would not be bounded (NaN also ends here)
+            if (!(code >= lowest - 0.5 && code <= highest + 0.5))
+                throw("Value out of the range of the quantization.");
+
+            code = std::min(std::max(std::round(code), lowest), highest);
+            codes[(std::size_t) i * x.numVars() + k] = (Q) code;
+        }
+    }
+}
+
+template<typename Q, typename T>
+void dequantize(const TimeSeriesView<Q>& codes, const Quantization& quantization, T* values)
+{
+    for (int i = 0; i < codes.length(); i++)
+    {
+        for (int k = 0; k < codes.numVars(); k++)
+        {
+            values[(std::size_t) i * codes.numVars() + k] =
+                quantization.offset + quantization.scale * codes[i][k];
+        }
+    }
+}
+
+// ================================================================================================
+/* Quantized LB_Keogh */
+// ================================================================================================
+
+// Envelope codes are clamped to this magnitude, far beyond any code, so that sums cannot overflow
+static const double ENVELOP_CODE_LIMIT = 1 << 20;
+
+// Absolute slack for the rounding of the conversion to code units
+static const double ENVELOP_CODE_SLACK = 1e-6;
+
+template<typename T>
+void quantizeEnvelop(const T* lower_envelop, const T* upper_envelop, int length,
+                     const Quantization& quantization, int* lower_codes, int* upper_codes)
+{
+    for (int i = 0; i < length; i++)
+    {
+        double lower = ((double) lower_envelop[i] - quantization.offset) / quantization.scale;
+        double upper = ((double) upper_envelop[i] - quantization.offset) / quantization.scale;
+
+        lower = std::floor(lower - ENVELOP_CODE_SLACK);
+        upper = std::ceil(upper + ENVELOP_CODE_SLACK);
+
+        lower_codes[i] = std::min(std::max(lower, -ENVELOP_CODE_LIMIT), ENVELOP_CODE_LIMIT);
+        upper_codes[i] = std::min(std::max(upper, -ENVELOP_CODE_LIMIT), ENVELOP_CODE_LIMIT);
+    }
+}
+
+template<typename Q>
+double lbKeoghQuantized(const TimeSeriesView<Q>& x, int p,
+                        const int* lower_codes, const int* upper_codes,
+                        const Quantization& quantization)
+{
+    if (p < 1)
+        throw("Parameter p must be positive.");
+
+    if (x.numVars() != 1)
+        throw("Only univariate series are supported.");
+
+    double lb = detail::quantizedKeogh(x, p, lower_codes, upper_codes,
+                                       std::numeric_limits<double>::infinity());
+
+    // from half steps to values
+    return quantization.maxError() * std::pow(lb, 1.0 / p);
+}
+
+// ================================================================================================
+/* Explicit instantiations */
+// ================================================================================================
+template Quantization fitQuantization<std::int16_t>(double, double);
+template Quantization fitQuantization<std::int8_t>(double, double);
+
+template Quantization fitQuantization<std::int16_t>(const std::vector<TimeSeriesView<double>>&);
+template Quantization fitQuantization<std::int16_t>(const std::vector<TimeSeriesView<float>>&);
+template Quantization fitQuantization<std::int8_t>(const std::vector<TimeSeriesView<double>>&);
+template Quantization fitQuantization<std::int8_t>(const std::vector<TimeSeriesView<float>>&);
+
+template void quantize(const TimeSeriesView<double>&, const Quantization&, std::int16_t*);
+template void quantize(const TimeSeriesView<float>&, const Quantization&, std::int16_t*);
+template void quantize(const TimeSeriesView<double>&, const Quantization&, std::int8_t*);
+template void quantize(const TimeSeriesView<float>&, const Quantization&, std::int8_t*);
+
+template void dequantize(const TimeSeriesView<std::int16_t>&, const Quantization&, double*);
+template void dequantize(const TimeSeriesView<std::int16_t>&, const Quantization&, float*);
+template void dequantize(const TimeSeriesView<std::int8_t>&, const Quantization&, double*);
+template void dequantize(const TimeSeriesView<std::int8_t>&, const Quantization&, float*);
+
+template void quantizeEnvelop(const double*, const double*, int, const Quantization&,
+                              int*, int*);
+template void quantizeEnvelop(const float*, const float*, int, const Quantization&,
+                              int*, int*);
+
+template double lbKeoghQuantized(const TimeSeriesView<std::int16_t>&, int,
+                                 const int*, const int*, const Quantization&);
+template double lbKeoghQuantized(const TimeSeriesView<std::int8_t>&, int,
+                                 const int*, const int*, const Quantization&);
+
+}
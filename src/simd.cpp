@@ -0,0 +1,33 @@
+#include "simd.h"
+
+namespace TSdist {
+
+// ================================================================================================
+/* Runtime CPU feature detection */
+// ================================================================================================
+static SimdLevel querySimdLevel()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f"))
+        return SimdLevel::AVX512;
+
+    if (__builtin_cpu_supports("avx2"))
+        return SimdLevel::AVX2;
+
+    if (__builtin_cpu_supports("sse2"))
+        return SimdLevel::SSE2;
+#endif
+
+    return SimdLevel::Scalar;
+}
+
+SimdLevel detectSimdLevel()
+{
+    // thread-safe initialization since C++11
+    static const SimdLevel level = querySimdLevel();
+    return level;
+}
+
+}
@@ -0,0 +1,218 @@
+#include <algorithm> // std::fill
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "ts.h"
+#include "kernels.h"
+#include "streaming.h"
+
+namespace TSdist {
+
+static const double INF = std::numeric_limits<double>::infinity();
+
+// ================================================================================================
+/* Construction */
+// ================================================================================================
+StreamingDTW::StreamingDTW(int length, int num_vars, double threshold, int p) :
+    _length(length) ,
+    _num_vars(num_vars) ,
+    _p(p) ,
+    _threshold(threshold) ,
+    _bound(std::pow(threshold, p))
+{
+    if (p < 1)
+        throw("Parameter p must be positive.");
+
+    if (_length < 1)
+        throw("Query cannot be empty.");
+
+    if (threshold < 0)
+        throw("Threshold cannot be negative.");
+
+    _query.resize((std::size_t) _length * _num_vars);
+    _costs.resize(_length + 1);
+    _starts.resize(_length + 1);
+
+    reset();
+}
+
+template<typename Series>
+void StreamingDTW::copyQuery(const Series& query)
+{
+    for (int i = 0; i < _length; i++)
+        for (int k = 0; k < _num_vars; k++)
+            _query[(std::size_t) i * _num_vars + k] = query[i][k];
+}
+
+StreamingDTW::StreamingDTW(const TimeSeriesBase& query, double threshold, int p) :
+    StreamingDTW(query.length(), query.numVars(), threshold, p)
+{
+    copyQuery(query);
+}
+
+template<typename T>
+StreamingDTW::StreamingDTW(const TimeSeriesView<T>& query, double threshold, int p) :
+    StreamingDTW(query.length(), query.numVars(), threshold, p)
+{
+    copyQuery(query);
+}
+
+void StreamingDTW::reset()
+{
+    std::fill(_costs.begin(), _costs.end(), INF);
+    std::fill(_starts.begin(), _starts.end(), 0);
+
+    _costs[0] = 0;
+    _time = 0;
+    _pending = false;
+    _best_cost = INF;
+    _best_start = -1;
+    _best_end = -1;
+}
+
+// ================================================================================================
+/* Updates */
+// ================================================================================================
+bool StreamingDTW::update(const double* sample, StreamMatch& match)
+{
+    // cell (i - 1) of the previous column, before it is overwritten
+    double diag_cost = 0;
+    long long diag_start = _time;
+
+    for (int i = 1; i <= _length; i++)
+    {
+        const double* y = _query.data() + (std::size_t) (i - 1) * _num_vars;
+        double cost = 0;
+
+        for (int k = 0; k < _num_vars; k++)
+            cost += pointCost(sample[k] - y[k], _p);
+
+        // first row: a new match starts here, nothing is cheaper
+        double best = 0;
+        long long start = _time;
+
+        if (i > 1) {
+            best = _costs[i - 1];
+            start = _starts[i - 1];
+
+            if (_costs[i] < best) {
+                best = _costs[i];
+                start = _starts[i];
+            }
+
+            if (diag_cost < best) {
+                best = diag_cost;
+                start = diag_start;
+            }
+        }
+
+        diag_cost = _costs[i];
+        diag_start = _starts[i];
+
+        _costs[i] = cost + best;
+        _starts[i] = start;
+    }
+
+    bool reported = false;
+
+    /*
+     * The pending match is final once every path still alive either costs at least as much or
+     * starts after it ends, since only those could overlap it with a smaller distance.
+     */
+    if (_pending) {
+        bool final = true;
+
+        for (int i = 1; i <= _length && final; i++)
+            final = _costs[i] >= _best_cost || _starts[i] > _best_end;
+
+        if (final) {
+            report(match);
+            reported = true;
+        }
+    }
+
+    if (_costs[_length] <= _bound && _costs[_length] < _best_cost) {
+        _pending = true;
+        _best_cost = _costs[_length];
+        _best_start = _starts[_length];
+        _best_end = _time;
+    }
+
+    _time++;
+    return reported;
+}
+
+bool StreamingDTW::update(double value, StreamMatch& match)
+{
+    if (_num_vars != 1)
+        throw("Only univariate series are supported.");
+
+    return update(&value, match);
+}
+
+template<typename Series>
+int StreamingDTW::updateKernel(const Series& samples, std::vector<StreamMatch>& matches)
+{
+    if (samples.numVars() != _num_vars)
+        throw("Series must have the same number of variables.");
+
+    std::vector<double> sample(_num_vars);
+    StreamMatch match;
+    int count = 0;
+
+    for (int t = 0; t < samples.length(); t++)
+    {
+        for (int k = 0; k < _num_vars; k++) sample[k] = samples[t][k];
+
+        if (update(sample.data(), match)) {
+            matches.push_back(match);
+            count++;
+        }
+    }
+
+    return count;
+}
+
+int StreamingDTW::update(const TimeSeriesBase& samples, std::vector<StreamMatch>& matches)
+{
+    return updateKernel(samples, matches);
+}
+
+template<typename T>
+int StreamingDTW::update(const TimeSeriesView<T>& samples, std::vector<StreamMatch>& matches)
+{
+    return updateKernel(samples, matches);
+}
+
+bool StreamingDTW::flush(StreamMatch& match)
+{
+    if (!_pending) return false;
+
+    report(match);
+    return true;
+}
+
+// Reports the pending match and discards the paths that overlap it
+void StreamingDTW::report(StreamMatch& match)
+{
+    match.start = _best_start;
+    match.end = _best_end;
+    match.distance = std::pow(_best_cost, 1.0 / _p);
+
+    for (int i = 1; i <= _length; i++)
+        if (_starts[i] <= _best_end) _costs[i] = INF;
+
+    _pending = false;
+    _best_cost = INF;
+}
+
+// ================================================================================================
+/* Explicit instantiations */
+// ================================================================================================
+template StreamingDTW::StreamingDTW(const TimeSeriesView<double>&, double, int);
+template int StreamingDTW::update(const TimeSeriesView<double>&, std::vector<StreamMatch>&);
+
+template StreamingDTW::StreamingDTW(const TimeSeriesView<float>&, double, int);
+template int StreamingDTW::update(const TimeSeriesView<float>&, std::vector<StreamMatch>&);
+
+}
@@ -0,0 +1,375 @@
+#include <algorithm> // std::min, std::max, std::sort, std::fill
+#include <cmath>
+#include <limits>
+#include "ts.h"
+#include "kernels.h"
+#include "lb.h"
+#include "subsequence.h"
+#include "workspace.h"
+#include "stats.h"
+
+namespace TSdist {
+
+static const double INF = std::numeric_limits<double>::infinity();
+
+// Observations of the stream copied (and enveloped) at a time
+static const int SUBSEQUENCE_CHUNK = 100000;
+
+// ================================================================================================
+/* Lower bounds and DTW, everything works with p-th powers */
+// ================================================================================================
+/*
+ * LB_Kim with the first and last three observations: the cells matching them form L-shaped
+ * bands at both corners of the cost matrix that every warping path crosses. 't' is the raw
+ * candidate, normalized here.
+ */
+static double lbKimHierarchy(const double* t, const double* q, int m, double mean, double std,
+                             int p, double bsf)
+{
+    double x0 = (t[0] - mean) / std;
+    double y0 = (t[m - 1] - mean) / std;
+
+    double lb = pointCost(x0 - q[0], p);
+    if (m > 1) lb += pointCost(y0 - q[m - 1], p);
+
+    // the second and third bands on each side must not overlap
+    if (m < 4 || lb >= bsf) return lb;
+
+    double x1 = (t[1] - mean) / std;
+    lb += std::min(pointCost(x1 - q[0], p), std::min(pointCost(x0 - q[1], p),
+                                                     pointCost(x1 - q[1], p)));
+    if (lb >= bsf) return lb;
+
+    double y1 = (t[m - 2] - mean) / std;
+    lb += std::min(pointCost(y1 - q[m - 1], p), std::min(pointCost(y0 - q[m - 2], p),
+                                                         pointCost(y1 - q[m - 2], p)));
+    if (m < 6 || lb >= bsf) return lb;
+
+    double x2 = (t[2] - mean) / std;
+    double d = std::min(pointCost(x0 - q[2], p), pointCost(x1 - q[2], p));
+    d = std::min(d, std::min(pointCost(x2 - q[2], p), pointCost(x2 - q[1], p)));
+    lb += std::min(d, pointCost(x2 - q[0], p));
+    if (lb >= bsf) return lb;
+
+    double y2 = (t[m - 3] - mean) / std;
+    d = std::min(pointCost(y0 - q[m - 3], p), pointCost(y1 - q[m - 3], p));
+    d = std::min(d, std::min(pointCost(y2 - q[m - 3], p), pointCost(y2 - q[m - 2], p)));
+    lb += std::min(d, pointCost(y2 - q[m - 1], p));
+
+    return lb;
+}
+
+/*
+ * LB_Keogh of the (normalized) candidate against the query envelope, visiting the positions in
+ * 'order'. The contribution of each position is saved in 'cb'.
+ */
+static double lbKeoghCumulative(const int* order, const double* t, const double* uo,
+                                const double* lo, double* cb, int m, double mean, double std,
+                                int p, double bsf)
+{
+    double lb = 0;
+
+    for (int i = 0; i < m && lb < bsf; i++)
+    {
+        double x = (t[order[i]] - mean) / std;
+        double d = 0;
+
+        if (x > uo[i])
+            d = pointCost(x - uo[i], p);
+        else if (x < lo[i])
+            d = pointCost(lo[i] - x, p);
+
+        lb += d;
+        cb[order[i]] = d;
+    }
+
+    return lb;
+}
+
+// Same with the query against the (normalized) candidate envelope
+static double lbKeoghReverse(const int* order, const double* qo, const double* lower,
+                             const double* upper, double* cb, int m, double mean, double std,
+                             int p, double bsf)
+{
+    double lb = 0;
+
+    for (int i = 0; i < m && lb < bsf; i++)
+    {
+        double u = (upper[order[i]] - mean) / std;
+        double l = (lower[order[i]] - mean) / std;
+        double d = 0;
+
+        if (qo[i] > u)
+            d = pointCost(qo[i] - u, p);
+        else if (qo[i] < l)
+            d = pointCost(l - qo[i], p);
+
+        lb += d;
+        cb[order[i]] = d;
+    }
+
+    return lb;
+}
+
+/*
+ * DTW between 'a' and 'b' (both of length m) with window r. After each row, the minimum of the
+ * row plus the lower bound of the positions that no cell computed so far can reach (cb[k] is
+ * the bound of positions k and beyond) is compared with the best-so-far. Returns the p-th power
+ * of the distance, or something not smaller than bsf if abandoned.
+ */
+static double dtwCumulative(const double* a, const double* b, const double* cb, int m, int r,
+                            int p, double bsf, double* rows, DTWWorkspace& workspace)
+{
+    // only for the statistics
+    (void) workspace;
+
+    double* prev = rows;
+    double* cur = rows + m + 1;
+    std::fill(rows, rows + 2 * (m + 1), INF);
+
+    TSDIST_STATS_ONLY(long long cells = 0;)
+
+    for (int i = 1; i <= m; i++)
+    {
+        int j1 = std::max(1, i - r);
+        int j2 = std::min(m, i + r);
+        double row_min = INF;
+
+        cur[j1 - 1] = INF;
+
+        for (int j = j1; j <= j2; j++)
+        {
+            double cost = pointCost(a[i - 1] - b[j - 1], p);
+
+            if (i > 1 || j > 1)
+                cost += std::min(std::min(prev[j - 1], prev[j]), cur[j - 1]);
+
+            cur[j] = cost;
+            row_min = std::min(row_min, cost);
+        }
+
+        // next row may read one cell further
+        if (j2 < m) cur[j2 + 1] = INF;
+
+        TSDIST_STATS_ONLY(cells += j2 - j1 + 1;)
+
+        double tail = (i + r < m) ? cb[i + r] : 0;
+        if (row_min + tail >= bsf) {
+            TSDIST_STATS_ONLY(recordDTW(workspace, cells, cells, true);)
+            return row_min + tail;
+        }
+
+        std::swap(prev, cur);
+    }
+
+    TSDIST_STATS_ONLY(recordDTW(workspace, cells, cells, false);)
+    return prev[m];
+}
+
+// ================================================================================================
+/* Search */
+// ================================================================================================
+template<typename Series>
+static SubsequenceMatch subsequenceKernel(const Series& stream, const Series& query,
+                                          int window_size, int p, DTWWorkspace& workspace)
+{
+    if (p < 1)
+        throw("Parameter p must be positive.");
+
+    if (stream.numVars() != 1 || query.numVars() != 1)
+        throw("Only univariate series are supported.");
+
+    int m = query.length();
+    int n = stream.length();
+
+    if (m < 1)
+        throw("Query cannot be empty.");
+
+    SubsequenceMatch match = { -1, INF };
+    if (n < m) return match;
+
+    int r = (window_size < 1 || window_size > m - 1) ? m - 1 : window_size;
+
+    // query data: normalized, sorted, envelope, DTW scratch and cumulative bounds
+    double* q = workspace.envelops(10 * (m + 1));
+    double* qo = q + m + 1;
+    double* uo = qo + m + 1;
+    double* lo = uo + m + 1;
+    double* upper = lo + m + 1;
+    double* lower = upper + m + 1;
+    double* tz = lower + m + 1;
+    double* cb = tz + m + 1;
+    double* cb1 = cb + m + 1;
+    double* cb2 = cb1 + m + 1;
+    int* order = workspace.limits(m);
+    double* rows = workspace.costs(2 * (m + 1));
+
+    double ex = 0, ex2 = 0;
+    for (int i = 0; i < m; i++) {
+        q[i] = query[i][0];
+        ex += q[i];
+        ex2 += q[i] * q[i];
+    }
+
+    double mean = ex / m;
+    double std = std::sqrt(std::max(0.0, ex2 / m - mean * mean));
+    if (std == 0) std = 1;
+
+    for (int i = 0; i < m; i++) q[i] = (q[i] - mean) / std;
+
+    // envelope window must be positive, it is clamped to the length anyway
+    computeEnvelop(TimeSeriesView<double>(q, m), std::max(r, 1), lower, upper, workspace);
+
+    // visit the query by decreasing absolute value
+    for (int i = 0; i < m; i++) order[i] = i;
+    std::sort(order, order + m, [q](int i, int j) { return std::abs(q[i]) > std::abs(q[j]); });
+
+    for (int i = 0; i < m; i++) {
+        qo[i] = q[order[i]];
+        uo[i] = upper[order[i]];
+        lo[i] = lower[order[i]];
+    }
+
+    // chunks overlap by m - 1 so that every subsequence lies inside one of them
+    int capacity = std::max(SUBSEQUENCE_CHUNK, m);
+    double* chunk = workspace.candidates(3 * (std::size_t) capacity);
+    double* chunk_lower = chunk + capacity;
+    double* chunk_upper = chunk_lower + capacity;
+
+    double bsf = INF;
+
+    for (int start = 0; start + m <= n; start += capacity - m + 1)
+    {
+        int length = std::min(capacity, n - start);
+
+        for (int i = 0; i < length; i++) chunk[i] = stream[start + i][0];
+
+        computeEnvelop(TimeSeriesView<double>(chunk, length), std::max(r, 1),
+                       chunk_lower, chunk_upper, workspace);
+
+        // running sums over the current subsequence, restarted with every chunk
+        ex = 0;
+        ex2 = 0;
+
+        for (int i = 0; i < length; i++)
+        {
+            ex += chunk[i];
+            ex2 += chunk[i] * chunk[i];
+
+            if (i < m - 1) continue;
+
+            int s = i - m + 1;
+            mean = ex / m;
+            std = std::sqrt(std::max(0.0, ex2 / m - mean * mean));
+            if (std == 0) std = 1;
+
+            const double* t = chunk + s;
+
+            TSDIST_STATS_ONLY(SearchStats* stats = workspace.stats();)
+            TSDIST_STATS_ONLY(if (stats) stats->candidates++;)
+
+            double lb_kim = lbKimHierarchy(t, q, m, mean, std, p, bsf);
+
+            if (lb_kim < bsf) {
+                double lb_k = lbKeoghCumulative(order, t, uo, lo, cb1, m, mean, std, p, bsf);
+
+                if (lb_k < bsf) {
+                    double lb_k2 = lbKeoghReverse(order, qo, chunk_lower + s, chunk_upper + s,
+                                                  cb2, m, mean, std, p, bsf);
+
+                    if (lb_k2 < bsf) {
+                        // cumulative bound from the end, using the tighter LB_Keogh
+                        const double* source = (lb_k > lb_k2) ? cb1 : cb2;
+
+                        cb[m] = 0;
+                        for (int k = m - 1; k >= 0; k--) cb[k] = cb[k + 1] + source[k];
+
+                        for (int k = 0; k < m; k++) tz[k] = (t[k] - mean) / std;
+
+                        double dist = dtwCumulative(tz, q, cb, m, r, p, bsf, rows, workspace);
+
+                        if (dist < bsf) {
+                            bsf = dist;
+                            match.position = start + s;
+                        }
+
+                    } else {
+                        TSDIST_STATS_ONLY(
+                            if (stats) stats->pruned[(int) LowerBound::ReverseKeogh]++;
+                        )
+                    }
+
+                } else {
+                    TSDIST_STATS_ONLY(if (stats) stats->pruned[(int) LowerBound::Keogh]++;)
+                }
+
+            } else {
+                TSDIST_STATS_ONLY(if (stats) stats->pruned[(int) LowerBound::Kim]++;)
+            }
+
+            ex -= chunk[s];
+            ex2 -= chunk[s] * chunk[s];
+        }
+
+        if (start + length == n) break;
+    }
+
+    match.distance = std::pow(bsf, 1.0 / p);
+    return match;
+}
+
+template<typename T>
+SubsequenceMatch subsequenceSearchDTW(const TimeSeriesView<T>& stream,
+                                      const TimeSeriesView<T>& query,
+                                      int window_size, int p,
+                                      DTWWorkspace& workspace)
+{
+    return subsequenceKernel(stream, query, window_size, p, workspace);
+}
+
+template<typename T>
+SubsequenceMatch subsequenceSearchDTW(const TimeSeriesView<T>& stream,
+                                      const TimeSeriesView<T>& query,
+                                      int window_size, int p)
+{
+    DTWWorkspace workspace;
+    return subsequenceSearchDTW(stream, query, window_size, p, workspace);
+}
+
+SubsequenceMatch subsequenceSearchDTW(const TimeSeriesBase& stream, const TimeSeriesBase& query,
+                                      int window_size, int p,
+                                      DTWWorkspace& workspace)
+{
+    if (isContiguous(stream) && isContiguous(query))
+        return subsequenceSearchDTW(viewOf(stream), viewOf(query), window_size, p, workspace);
+
+    return subsequenceKernel(stream, query, window_size, p, workspace);
+}
+
+SubsequenceMatch subsequenceSearchDTW(const TimeSeriesBase& stream, const TimeSeriesBase& query,
+                                      int window_size, int p)
+{
+    DTWWorkspace workspace;
+    return subsequenceSearchDTW(stream, query, window_size, p, workspace);
+}
+
+// ================================================================================================
+/* Explicit instantiations */
+// ================================================================================================
+template SubsequenceMatch subsequenceSearchDTW(const TimeSeriesView<double>&,
+                                               const TimeSeriesView<double>&,
+                                               int, int);
+template SubsequenceMatch subsequenceSearchDTW(const TimeSeriesView<double>&,
+                                               const TimeSeriesView<double>&,
+                                               int, int,
+                                               DTWWorkspace&);
+
+template SubsequenceMatch subsequenceSearchDTW(const TimeSeriesView<float>&,
+                                               const TimeSeriesView<float>&,
+                                               int, int);
+template SubsequenceMatch subsequenceSearchDTW(const TimeSeriesView<float>&,
+                                               const TimeSeriesView<float>&,
+                                               int, int,
+                                               DTWWorkspace&);
+
+}
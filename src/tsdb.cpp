@@ -0,0 +1,247 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <vector>
+#include "ts.h"
+#include "tsdb.h"
+#include "mmap.h"
+#include "quantized.h"
+
+namespace TSdist {
+
+// ================================================================================================
+/* File format */
+// ================================================================================================
+
+// Followed by the table of entries and the values of each series, 64-byte aligned
+struct DatabaseHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t value_type;
+    std::uint64_t size;
+    double scale;
+    double offset;
+    char padding[24];
+};
+
+static_assert(sizeof(DatabaseHeader) == 64, "Unexpected padding in DatabaseHeader.");
+
+static const char DATABASE_MAGIC[8] = { 'T', 'S', 'D', 'B', 'D', 'A', 'T', 'A' };
+static const std::uint32_t DATABASE_VERSION = 1;
+static const std::size_t DATABASE_ALIGNMENT = 64;
+
+static std::size_t align(std::size_t offset)
+{
+    return (offset + DATABASE_ALIGNMENT - 1) / DATABASE_ALIGNMENT * DATABASE_ALIGNMENT;
+}
+
+static std::size_t valueSize(ValueType type)
+{
+    switch (type)
+    {
+        case ValueType::Float64: return sizeof(double);
+        case ValueType::Float32: return sizeof(float);
+        case ValueType::Int16: return sizeof(std::int16_t);
+        case ValueType::Int8: return sizeof(std::int8_t);
+    }
+
+    throw("Unknown value type.");
+}
+
+static bool isQuantized(ValueType type)
+{
+    return type == ValueType::Int16 || type == ValueType::Int8;
+}
+
+// Codes of the values of 'series' written to 'file'
+template<typename Q>
+static void writeCodes(std::ofstream& file, const TimeSeriesView<double>& series,
+                       const Quantization& quantization)
+{
+    std::vector<Q> codes((std::size_t) series.length() * series.numVars());
+    quantize(series, quantization, codes.data());
+
+    file.write(reinterpret_cast<const char*>(codes.data()), codes.size() * sizeof(Q));
+}
+
+// ================================================================================================
+/* Writing */
+// ================================================================================================
+void TimeSeriesDatabase::write(const std::string& path,
+                               const std::vector<TimeSeriesView<double>>& tsdb, ValueType type)
+{
+    std::vector<Shape> shapes;
+    Range range;
+
+    for (const TimeSeriesView<double>& series : tsdb)
+    {
+        shapes.push_back(Shape{ series.length(), series.numVars() });
+
+        // only needed for the quantized types
+        if (isQuantized(type)) {
+            for (int i = 0; i < series.length(); i++)
+                for (int k = 0; k < series.numVars(); k++)
+                    range.add(series[i][k]);
+        }
+    }
+
+    std::ofstream file;
+    Quantization quantization = writeHeader(file, path, shapes, type, range);
+
+    for (const TimeSeriesView<double>& series : tsdb)
+        writeSeries(file, series, type, quantization);
+
+    if (!file)
+        throw("Could not write file.");
+}
+
+Quantization TimeSeriesDatabase::writeHeader(std::ofstream& file, const std::string& path,
+                                             const std::vector<Shape>& shapes, ValueType type,
+                                             const Range& range)
+{
+    if (type > ValueType::Int8)
+        throw("Unknown value type.");
+
+    // identity for the floating-point types and for empty databases
+    Quantization quantization = { 1, 0 };
+
+    if (range.min <= range.max) {
+        if (type == ValueType::Int16)
+            quantization = fitQuantization<std::int16_t>(range.min, range.max);
+        else if (type == ValueType::Int8)
+            quantization = fitQuantization<std::int8_t>(range.min, range.max);
+    }
+
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+        throw("Could not open file.");
+
+    DatabaseHeader header;
+    std::memset(&header, 0, sizeof(header));
+
+    std::memcpy(header.magic, DATABASE_MAGIC, sizeof(DATABASE_MAGIC));
+    header.version = DATABASE_VERSION;
+    header.value_type = (std::uint32_t) type;
+    header.size = shapes.size();
+    header.scale = quantization.scale;
+    header.offset = quantization.offset;
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    // the values start after the table, each series on a new 64-byte boundary
+    std::size_t offset = align(sizeof(header) + shapes.size() * sizeof(Entry));
+
+    for (const Shape& shape : shapes)
+    {
+        Entry entry;
+        entry.offset = offset;
+        entry.length = shape.length;
+        entry.num_vars = shape.num_vars;
+
+        file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+        offset = align(offset + (std::size_t) shape.length * shape.num_vars * valueSize(type));
+    }
+
+    std::size_t written = sizeof(header) + shapes.size() * sizeof(Entry);
+    std::vector<char> padding(align(written) - written, 0);
+    file.write(padding.data(), padding.size());
+
+    return quantization;
+}
+
+void TimeSeriesDatabase::writeSeries(std::ofstream& file, const TimeSeriesView<double>& series,
+                                     ValueType type, const Quantization& quantization)
+{
+    std::size_t count = (std::size_t) series.length() * series.numVars();
+
+    if (type == ValueType::Int16) {
+        writeCodes<std::int16_t>(file, series, quantization);
+
+    } else if (type == ValueType::Int8) {
+        writeCodes<std::int8_t>(file, series, quantization);
+
+    } else {
+        for (int i = 0; i < series.length(); i++)
+        {
+            for (int k = 0; k < series.numVars(); k++)
+            {
+                if (type == ValueType::Float64) {
+                    double value = series[i][k];
+                    file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+
+                } else {
+                    float value = series[i][k];
+                    file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+                }
+            }
+        }
+    }
+
+    std::size_t written = count * valueSize(type);
+    std::vector<char> padding(align(written) - written, 0);
+    file.write(padding.data(), padding.size());
+}
+
+// ================================================================================================
+/* Reading */
+// ================================================================================================
+TimeSeriesDatabase::TimeSeriesDatabase(const std::string& path) :
+    _size(0) ,
+    _type(ValueType::Float64) ,
+    _quantization{ 1, 0 } ,
+    _entries(nullptr) ,
+    _file(path)
+{
+    DatabaseHeader header;
+
+    if (_file.size() < sizeof(header))
+        throw("Invalid database file.");
+
+    std::memcpy(&header, _file.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, DATABASE_MAGIC, sizeof(DATABASE_MAGIC)) != 0 ||
+        header.version != DATABASE_VERSION ||
+        header.value_type > (std::uint32_t) ValueType::Int8 ||
+        header.size > (std::uint64_t) std::numeric_limits<int>::max() ||
+        header.size > (_file.size() - sizeof(header)) / sizeof(Entry))
+    {
+        throw("Invalid database file.");
+    }
+
+    _size = header.size;
+    _type = (ValueType) header.value_type;
+
+    if (isQuantized(_type)) {
+        if (!(header.scale > 0) || !std::isfinite(header.scale) || !std::isfinite(header.offset))
+            throw("Invalid database file.");
+
+        _quantization = Quantization{ header.scale, header.offset };
+    }
+    _entries = reinterpret_cast<const Entry*>(_file.data() + sizeof(header));
+}
+
+const unsigned char* TimeSeriesDatabase::values(int k, std::size_t value_size) const
+{
+    const Entry& e = entry(k);
+    std::size_t bytes = (std::size_t) e.length * e.num_vars * value_size;
+
+    // the table is only checked when used, so that opening takes constant time
+    if (e.length < 0 || e.num_vars < 1 || e.offset % DATABASE_ALIGNMENT != 0 ||
+        e.offset > _file.size() || bytes > _file.size() - e.offset)
+    {
+        throw("Invalid database file.");
+    }
+
+    return _file.data() + e.offset;
+}
+
+void TimeSeriesDatabase::checkType(ValueType type) const
+{
+    if (type != _type)
+        throw("Value type mismatch with the database.");
+}
+
+}
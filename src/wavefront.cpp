@@ -0,0 +1,402 @@
+#include <algorithm> // std::min, std::max, std::fill
+#include <cmath>
+#include <limits>
+#include "ts.h"
+#include "dtw.h"
+#include "simd.h"
+#include "workspace.h"
+#include "kernels.h"
+#include "stats.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TSDIST_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace TSdist {
+
+static const double INF = std::numeric_limits<double>::infinity();
+
+/*
+ * Same role as NOT_VISITED in dtw.cpp, but it can take part in the minimum directly. Infinity
+ * (and not DBL_MAX) so that a window leaving no warping path gives infinity, like the row-based
+ * kernels.
+ */
+static const double UNVISITED = INF;
+
+/*
+ * Cell (i, j) of the cost matrix (1-based like in dtw.cpp) lies on anti-diagonal k = i + j, and
+ * only depends on cells of diagonals k - 1 and k - 2, so all cells of a diagonal are independent.
+ * Each diagonal is stored in a buffer indexed by i, hence for cell (i, j):
+ *
+ *   diagonal step: prev2[i - 1]
+ *   up step:       prev1[i - 1]
+ *   left step:     prev1[i]
+ *
+ * For the univariate p = 1 and p = 2 cases, x is contiguous and yr is y reversed, so that
+ * y[j - 1] == yr[offset + i] with offset = ny - k, and both are read with ascending addresses.
+ */
+
+// ================================================================================================
+/* Diagonal sweeps for univariate series, one per instruction set */
+// ================================================================================================
+template<int P>
+static inline double univariateCost(double diff)
+{
+    return P == 1 ? std::abs(diff) : diff * diff;
+}
+
+// inlined in all versions to handle the remainder of the vectorized loops
+template<int P>
+static inline void sweepTail(const double* x, const double* yr, int offset,
+                             const double* prev2, const double* prev1, double* cur,
+                             int a, int b, double diag_weight)
+{
+    for (int i = a; i <= b; i++) {
+        double local_cost = univariateCost<P>(x[i - 1] - yr[offset + i]);
+        cur[i] = std::min(std::min(prev2[i - 1] + diag_weight * local_cost,
+                                   prev1[i - 1] + local_cost),
+                          prev1[i] + local_cost);
+    }
+}
+
+template<int P>
+static void sweepScalar(const double* x, const double* yr, int offset,
+                        const double* prev2, const double* prev1, double* cur,
+                        int a, int b, double diag_weight)
+{
+    sweepTail<P>(x, yr, offset, prev2, prev1, cur, a, b, diag_weight);
+}
+
+#ifdef TSDIST_X86_SIMD
+
+template<int P>
+__attribute__((target("sse2")))
+static void sweepSSE2(const double* x, const double* yr, int offset,
+                      const double* prev2, const double* prev1, double* cur,
+                      int a, int b, double diag_weight)
+{
+    const __m128d weight = _mm_set1_pd(diag_weight);
+    const __m128d sign = _mm_set1_pd(-0.0);
+    int i = a;
+
+    for (; i + 1 <= b; i += 2) {
+        __m128d diff = _mm_sub_pd(_mm_loadu_pd(x + i - 1), _mm_loadu_pd(yr + offset + i));
+        __m128d local_cost = P == 1 ? _mm_andnot_pd(sign, diff) : _mm_mul_pd(diff, diff);
+
+        __m128d cost = _mm_add_pd(_mm_loadu_pd(prev2 + i - 1), _mm_mul_pd(weight, local_cost));
+        cost = _mm_min_pd(cost, _mm_add_pd(_mm_loadu_pd(prev1 + i - 1), local_cost));
+        cost = _mm_min_pd(cost, _mm_add_pd(_mm_loadu_pd(prev1 + i), local_cost));
+
+        _mm_storeu_pd(cur + i, cost);
+    }
+
+    sweepTail<P>(x, yr, offset, prev2, prev1, cur, i, b, diag_weight);
+}
+
+template<int P>
+__attribute__((target("avx2")))
+static void sweepAVX2(const double* x, const double* yr, int offset,
+                      const double* prev2, const double* prev1, double* cur,
+                      int a, int b, double diag_weight)
+{
+    const __m256d weight = _mm256_set1_pd(diag_weight);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    int i = a;
+
+    for (; i + 3 <= b; i += 4) {
+        __m256d diff = _mm256_sub_pd(_mm256_loadu_pd(x + i - 1),
+                                     _mm256_loadu_pd(yr + offset + i));
+        __m256d local_cost = P == 1 ? _mm256_andnot_pd(sign, diff) : _mm256_mul_pd(diff, diff);
+
+        __m256d cost = _mm256_add_pd(_mm256_loadu_pd(prev2 + i - 1),
+                                     _mm256_mul_pd(weight, local_cost));
+        cost = _mm256_min_pd(cost, _mm256_add_pd(_mm256_loadu_pd(prev1 + i - 1), local_cost));
+        cost = _mm256_min_pd(cost, _mm256_add_pd(_mm256_loadu_pd(prev1 + i), local_cost));
+
+        _mm256_storeu_pd(cur + i, cost);
+    }
+
+    sweepTail<P>(x, yr, offset, prev2, prev1, cur, i, b, diag_weight);
+}
+
+template<int P>
+__attribute__((target("avx512f")))
+static void sweepAVX512(const double* x, const double* yr, int offset,
+                        const double* prev2, const double* prev1, double* cur,
+                        int a, int b, double diag_weight)
+{
+    const __m512d weight = _mm512_set1_pd(diag_weight);
+
+    // the tail is handled with masked loads/stores instead of a scalar loop
+    for (int i = a; i <= b; i += 8) {
+        __mmask8 mask = (b - i >= 7) ? 0xFF : (__mmask8) ((1u << (b - i + 1)) - 1);
+
+        __m512d diff = _mm512_sub_pd(_mm512_maskz_loadu_pd(mask, x + i - 1),
+                                     _mm512_maskz_loadu_pd(mask, yr + offset + i));
+        __m512d local_cost = P == 1 ? _mm512_abs_pd(diff) : _mm512_mul_pd(diff, diff);
+
+        __m512d cost = _mm512_add_pd(_mm512_maskz_loadu_pd(mask, prev2 + i - 1),
+                                     _mm512_mul_pd(weight, local_cost));
+        cost = _mm512_maskz_min_pd(mask, cost,
+                                   _mm512_add_pd(_mm512_maskz_loadu_pd(mask, prev1 + i - 1),
+                                                 local_cost));
+        cost = _mm512_maskz_min_pd(mask, cost,
+                                   _mm512_add_pd(_mm512_maskz_loadu_pd(mask, prev1 + i),
+                                                 local_cost));
+
+        _mm512_mask_storeu_pd(cur + i, mask, cost);
+    }
+}
+
+#endif // TSDIST_X86_SIMD
+
+typedef void (*DiagonalSweep)(const double*, const double*, int,
+                              const double*, const double*, double*,
+                              int, int, double);
+
+template<int P>
+static DiagonalSweep selectSweep(SimdLevel level)
+{
+    switch (level) {
+#ifdef TSDIST_X86_SIMD
+    case SimdLevel::AVX512:
+        return sweepAVX512<P>;
+    case SimdLevel::AVX2:
+        return sweepAVX2<P>;
+    case SimdLevel::SSE2:
+        return sweepSSE2<P>;
+#endif
+    default:
+        return sweepScalar<P>;
+    }
+}
+
+// ================================================================================================
+/* Anti-diagonal traversal of the cost matrix */
+// ================================================================================================
+/*
+ * With a finite bound, cells above it are dead like in the pruned row-wise kernel (pruned.cpp).
+ * A cell can only be alive if one of its predecessors is, so each diagonal is restricted to the
+ * rows adjacent to the live ranges of the previous two. Every warping path visits at least one
+ * of any two consecutive diagonals, so if both are dead the computation is abandoned.
+ */
+template<typename Sweep>
+static double wavefront(int nx, int ny, int window_size, double first_cost, double bound,
+                        Sweep sweep, DTWWorkspace& workspace)
+{
+    // row i lies inside the window for the diagonals in [lo[i], hi[i]], both strictly increasing
+    int* lo = workspace.limits(2 * (nx + 1));
+    int* hi = lo + nx + 1;
+
+    TSDIST_STATS_ONLY(long long cells_computed = 0, cells_in_window = 0;)
+
+    for (int i = 1; i <= nx; i++)
+    {
+        int j1, j2;
+        windowLimits(i, nx, ny, window_size, j1, j2);
+
+        lo[i] = i + j1;
+        hi[i] = i + j2;
+
+        TSDIST_STATS_ONLY(cells_in_window += std::max(0, j2 - j1 + 1);)
+    }
+
+    // three rotating diagonals, cells outside of [dirty_lo, dirty_hi] are always UNVISITED
+    double* buffer = workspace.costs(3 * (nx + 2));
+    std::fill(buffer, buffer + 3 * (nx + 2), UNVISITED);
+    double* diagonals[3] = { buffer, buffer + nx + 2, buffer + 2 * (nx + 2) };
+    int dirty_lo[3] = { 1, 1, 1 };
+    int dirty_hi[3] = { 0, 0, 0 };
+
+    // live rows of each diagonal, diagonal 1 (before the first one) has none
+    int live_lo[3] = { 1, 1, 1 };
+    int live_hi[3] = { 0, 0, 0 };
+    bool pruning = bound < INF;
+
+    // rows inside the window for the current diagonal are [a, b]
+    int a = 1, b = 0;
+
+    for (int k = 2; k <= nx + ny; k++)
+    {
+        double* cur = diagonals[k % 3];
+        const double* prev1 = diagonals[(k - 1) % 3];
+        const double* prev2 = diagonals[(k - 2) % 3];
+
+        while (a <= nx && hi[a] < k) a++;
+        while (b < nx && lo[b + 1] <= k) b++;
+
+        // very first value is always set, even if the window would exclude it
+        int first = (k == 2) ? 1 : a;
+        int last = (k == 2) ? 1 : b;
+
+        if (pruning && k > 2) {
+            int lo1 = live_lo[(k - 1) % 3], hi1 = live_hi[(k - 1) % 3];
+            int lo2 = live_lo[(k - 2) % 3], hi2 = live_hi[(k - 2) % 3];
+
+            // early abandoning
+            if (lo1 > hi1 && lo2 > hi2) {
+                TSDIST_STATS_ONLY(recordDTW(workspace, cells_computed, cells_in_window, true);)
+                return INF;
+            }
+
+            // rows reachable from live cells: [lo1, hi1 + 1] and [lo2 + 1, hi2 + 1]
+            int reach_lo = (lo1 > hi1) ? lo2 + 1 : (lo2 > hi2) ? lo1 : std::min(lo1, lo2 + 1);
+            int reach_hi = (lo1 > hi1) ? hi2 + 1 : (lo2 > hi2) ? hi1 + 1 : std::max(hi1, hi2) + 1;
+
+            first = std::max(first, reach_lo);
+            last = std::min(last, reach_hi);
+        }
+
+        // clear what is left from diagonal k - 3
+        int& dlo = dirty_lo[k % 3];
+        int& dhi = dirty_hi[k % 3];
+        for (int i = dlo; i <= std::min(dhi, first - 1); i++) cur[i] = UNVISITED;
+        for (int i = std::max(dlo, last + 1); i <= dhi; i++) cur[i] = UNVISITED;
+
+        if (k == 2)
+            cur[1] = first_cost;
+        else if (first <= last)
+            sweep(k, first, last, prev2, prev1, cur);
+
+        dlo = first;
+        dhi = last;
+
+        TSDIST_STATS_ONLY(cells_computed += std::max(0, last - first + 1);)
+
+        if (pruning) {
+            int l = first, h = last;
+            while (l <= h && cur[l] > bound) l++;
+            while (h >= l && cur[h] > bound) h--;
+
+            live_lo[k % 3] = l;
+            live_hi[k % 3] = h;
+        }
+    }
+
+    double cost = diagonals[(nx + ny) % 3][nx];
+    TSDIST_STATS_ONLY(recordDTW(workspace, cells_computed, cells_in_window, cost > bound);)
+
+    return cost <= bound ? cost : INF;
+}
+
+// ================================================================================================
+/* DTW distance */
+// ================================================================================================
+template<typename T>
+double wavefrontCost(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                     int window_size, int p, int diag_weight, double bound, SimdLevel level,
+                     DTWWorkspace& workspace)
+{
+    int nx = x.length();
+    int ny = y.length();
+    double weight = diag_weight;
+    double first_cost = localCost(x, y, p, 0, 0);
+    double cost;
+
+    if (x.numVars() == 1 && (p == 1 || p == 2))
+    {
+        // contiguous x and reversed y
+        double* xc = workspace.series(nx + ny);
+        double* yr = xc + nx;
+        for (int i = 0; i < nx; i++) xc[i] = x[i][0];
+        for (int j = 0; j < ny; j++) yr[j] = y[ny - 1 - j][0];
+
+        DiagonalSweep simd_sweep = (p == 1) ? selectSweep<1>(level) : selectSweep<2>(level);
+
+        cost = wavefront(nx, ny, window_size, first_cost, bound,
+                         [&](int k, int a, int b,
+                             const double* prev2, const double* prev1, double* cur)
+        {
+            simd_sweep(xc, yr, ny - k, prev2, prev1, cur, a, b, weight);
+        }, workspace);
+
+    } else {
+        cost = wavefront(nx, ny, window_size, first_cost, bound,
+                         [&](int k, int a, int b,
+                             const double* prev2, const double* prev1, double* cur)
+        {
+            for (int i = a; i <= b; i++) {
+                double local_cost = localCost(x, y, p, i - 1, k - i - 1);
+                cur[i] = std::min(std::min(prev2[i - 1] + weight * local_cost,
+                                           prev1[i - 1] + local_cost),
+                                  prev1[i] + local_cost);
+            }
+        }, workspace);
+    }
+
+    return cost;
+}
+
+template<typename T>
+double computeWavefrontDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                           int window_size, int p, int diag_weight, SimdLevel level,
+                           DTWWorkspace& workspace)
+{
+    checkDTWParameters(x, y, p, diag_weight);
+
+    if (level > detectSimdLevel())
+        throw("SIMD level not supported by this CPU.");
+
+    double cost = wavefrontCost(x, y, window_size, p, diag_weight, INF, level, workspace);
+
+    // calculate p-root on the very last value
+    return std::pow(cost, 1.0 / p);
+}
+
+template<typename T>
+double computeWavefrontDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                           int window_size, int p, int diag_weight, SimdLevel level)
+{
+    DTWWorkspace workspace;
+    return computeWavefrontDTW(x, y, window_size, p, diag_weight, level, workspace);
+}
+
+template<typename T>
+double computeWavefrontDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                           int window_size, int p, int diag_weight,
+                           DTWWorkspace& workspace)
+{
+    return computeWavefrontDTW(x, y, window_size, p, diag_weight, detectSimdLevel(), workspace);
+}
+
+template<typename T>
+double computeWavefrontDTW(const TimeSeriesView<T>& x, const TimeSeriesView<T>& y,
+                           int window_size, int p, int diag_weight)
+{
+    DTWWorkspace workspace;
+    return computeWavefrontDTW(x, y, window_size, p, diag_weight, detectSimdLevel(), workspace);
+}
+
+// ================================================================================================
+/* Explicit instantiations */
+// ================================================================================================
+template double wavefrontCost(const TimeSeriesView<double>&, const TimeSeriesView<double>&,
+                              int, int, int, double, SimdLevel,
+                              DTWWorkspace&);
+template double computeWavefrontDTW(const TimeSeriesView<double>&, const TimeSeriesView<double>&,
+                                    int, int, int, SimdLevel);
+template double computeWavefrontDTW(const TimeSeriesView<double>&, const TimeSeriesView<double>&,
+                                    int, int, int, SimdLevel,
+                                    DTWWorkspace&);
+template double computeWavefrontDTW(const TimeSeriesView<double>&, const TimeSeriesView<double>&,
+                                    int, int, int);
+template double computeWavefrontDTW(const TimeSeriesView<double>&, const TimeSeriesView<double>&,
+                                    int, int, int,
+                                    DTWWorkspace&);
+
+template double wavefrontCost(const TimeSeriesView<float>&, const TimeSeriesView<float>&,
+                              int, int, int, double, SimdLevel,
+                              DTWWorkspace&);
+template double computeWavefrontDTW(const TimeSeriesView<float>&, const TimeSeriesView<float>&,
+                                    int, int, int, SimdLevel);
+template double computeWavefrontDTW(const TimeSeriesView<float>&, const TimeSeriesView<float>&,
+                                    int, int, int, SimdLevel,
+                                    DTWWorkspace&);
+template double computeWavefrontDTW(const TimeSeriesView<float>&, const TimeSeriesView<float>&,
+                                    int, int, int);
+template double computeWavefrontDTW(const TimeSeriesView<float>&, const TimeSeriesView<float>&,
+                                    int, int, int,
+                                    DTWWorkspace&);
+
+}